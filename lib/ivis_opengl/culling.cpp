@@ -23,6 +23,11 @@
 #include <algorithm>
 #include <functional>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+# include <xmmintrin.h>
+# define WZ_CULLING_SSE
+#endif
+
 BoundingBox transformBoundingBox(const glm::mat4& worldViewProjectionMatrix, const BoundingBox& worldSpaceBoundingBox)
 {
 	BoundingBox bboxInClipSpace;
@@ -52,3 +57,84 @@ bool isBBoxInClipSpace(const IntersectionOfHalfSpace& intersectionOfHalfSpace, c
 	}
 	return true;
 }
+
+ViewFrustumPlanes extractFrustumPlanes(const glm::mat4& perspectiveViewMatrix)
+{
+	// Gribb & Hartmann: each plane is the last row of the matrix plus or minus one of the others.
+	// The near plane is w >= 0, which holds whichever clip space depth convention the backend uses.
+	const glm::mat4 m = glm::transpose(perspectiveViewMatrix);
+	ViewFrustumPlanes result;
+	result.planes[0] = m[3] + m[0]; // left
+	result.planes[1] = m[3] - m[0]; // right
+	result.planes[2] = m[3] + m[1]; // bottom
+	result.planes[3] = m[3] - m[1]; // top
+	result.planes[4] = m[3];        // near
+	for (auto& plane : result.planes)
+	{
+		// Normalise, so the signed distance can be compared against the radius
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return result;
+}
+
+void cullBoundingSpheres(const ViewFrustumPlanes& frustum, const BoundingSpheres& spheres, std::vector<uint8_t>& visible)
+{
+	const size_t count = spheres.size();
+	visible.resize(count);
+	size_t i = 0;
+
+#ifdef WZ_CULLING_SSE
+	// Four spheres at a time against each plane
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&spheres.x[i]);
+		const __m128 y = _mm_loadu_ps(&spheres.y[i]);
+		const __m128 z = _mm_loadu_ps(&spheres.z[i]);
+		const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+		__m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps()); // All bits set
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			__m128 distance = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_set1_ps(plane.w));
+			distance = _mm_add_ps(distance, _mm_mul_ps(y, _mm_set1_ps(plane.y)));
+			distance = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(plane.z)));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+		}
+		const int mask = _mm_movemask_ps(inside);
+		visible[i] = mask & 1;
+		visible[i + 1] = (mask >> 1) & 1;
+		visible[i + 2] = (mask >> 2) & 1;
+		visible[i + 3] = (mask >> 3) & 1;
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		bool inside = true;
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			inside &= plane.x * spheres.x[i] + plane.y * spheres.y[i] + plane.z * spheres.z[i] + plane.w >= -spheres.radius[i];
+		}
+		visible[i] = inside;
+	}
+}
+
+FrustumIntersection intersectBoundingBox(const ViewFrustumPlanes& frustum, const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+	FrustumIntersection result = FrustumIntersection::Inside;
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		const glm::vec3 normal(plane);
+		// The corners furthest along and against the plane normal
+		const glm::vec3 positive(normal.x >= 0 ? boxMax.x : boxMin.x, normal.y >= 0 ? boxMax.y : boxMin.y, normal.z >= 0 ? boxMax.z : boxMin.z);
+		const glm::vec3 negative(normal.x >= 0 ? boxMin.x : boxMax.x, normal.y >= 0 ? boxMin.y : boxMax.y, normal.z >= 0 ? boxMin.z : boxMax.z);
+		if (glm::dot(normal, positive) + plane.w < 0)
+		{
+			return FrustumIntersection::Outside;
+		}
+		if (glm::dot(normal, negative) + plane.w < 0)
+		{
+			result = FrustumIntersection::Intersecting;
+		}
+	}
+	return result;
+}
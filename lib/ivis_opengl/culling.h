@@ -24,6 +24,8 @@
 #include <glm/glm.hpp>
 #include <algorithm>
 #include <functional>
+#include <vector>
+#include <cstdint>
 
 using BoundingBox = std::array<glm::vec3, 8>;
 
@@ -36,3 +38,45 @@ using HalfSpaceCheck = std::function<bool(const glm::vec3&)>;
 using IntersectionOfHalfSpace = std::array< HalfSpaceCheck, 6>;
 
 bool isBBoxInClipSpace(const IntersectionOfHalfSpace& intersectionOfHalfSpace, const BoundingBox& points);
+
+/// View frustum side planes, as (a, b, c, d) with a x + b y + c z + d >= 0 on the inside.
+/// Only the left, right, bottom, top and near planes are kept, draw distance is limited by other means.
+struct ViewFrustumPlanes
+{
+	std::array<glm::vec4, 5> planes;
+};
+
+/// Extract the frustum planes of a (perspective * view) matrix, in the space that matrix takes points from
+ViewFrustumPlanes extractFrustumPlanes(const glm::mat4& perspectiveViewMatrix);
+
+/// Bounding spheres stored one component per array, so that several can be tested at once
+struct BoundingSpheres
+{
+	std::vector<float> x, y, z, radius;
+
+	void clear()
+	{
+		x.clear(); y.clear(); z.clear(); radius.clear();
+	}
+	size_t size() const
+	{
+		return radius.size();
+	}
+	void push_back(const glm::vec3& centre, float r)
+	{
+		x.push_back(centre.x); y.push_back(centre.y); z.push_back(centre.z); radius.push_back(r);
+	}
+};
+
+/// Sets visible[i] to 1 for every sphere that is at least partly inside the frustum, 0 otherwise
+void cullBoundingSpheres(const ViewFrustumPlanes& frustum, const BoundingSpheres& spheres, std::vector<uint8_t>& visible);
+
+enum class FrustumIntersection
+{
+	Outside,
+	Intersecting,
+	Inside
+};
+
+/// Whether an axis aligned bounding box is entirely outside, partly inside or entirely inside the frustum
+FrustumIntersection intersectBoundingBox(const ViewFrustumPlanes& frustum, const glm::vec3& boxMin, const glm::vec3& boxMax);
@@ -23,8 +23,11 @@
 #include "gfx_api_image_compress_priv.h"
 #include "gfx_api_image_basis_priv.h"
 #include "lib/framework/physfs_ext.h"
+#include "lib/framework/wzapp.h"
 #include <unordered_map>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 static gfx_api::backend_type backend = gfx_api::backend_type::opengl_backend;
 bool uses_gfx_debug = false;
@@ -424,8 +427,9 @@ static std::vector<std::unique_ptr<iV_Image>> generateMipMapsFromUncompressedIma
 	return results;
 }
 
-// Takes an iv_Image and texture_type and loads a texture as appropriate / possible
-gfx_api::texture* gfx_api::context::loadTextureFromUncompressedImage(iV_Image&& image, gfx_api::texture_type textureType, const std::string& filename, int maxWidth /*= -1*/, int maxHeight /*= -1*/)
+// Takes an iv_Image and texture_type and does all the CPU-side work of loading a texture as appropriate / possible
+// Does not touch the GPU, so it may be called from any thread
+static std::unique_ptr<gfx_api::prepared_texture> prepareTextureFromUncompressedImage(iV_Image&& image, gfx_api::texture_type textureType, const std::string& filename, int maxWidth /*= -1*/, int maxHeight /*= -1*/)
 {
 	// 1.) Convert to expected # of channels based on textureType
 	if (!uncompressedPNGImageConvertChannels(image, gfx_api::pixel_format_target::texture_2d, textureType, filename))
@@ -442,7 +446,7 @@ gfx_api::texture* gfx_api::context::loadTextureFromUncompressedImage(iV_Image&&
 	// 4.) Extend channels, if needed, to a supported uncompressed format
 	auto channels = image.channels();
 	// Verify that the gfx backend supports this format
-	auto closestSupportedChannels = getClosestSupportedUncompressedImageFormatChannels(gfx_api::pixel_format_target::texture_2d, channels);
+	auto closestSupportedChannels = gfx_api::context::get().getClosestSupportedUncompressedImageFormatChannels(gfx_api::pixel_format_target::texture_2d, channels);
 	ASSERT_OR_RETURN(nullptr, closestSupportedChannels.has_value(), "Exhausted all possible uncompressed formats??");
 	for (auto i = image.channels(); i < closestSupportedChannels; ++i)
 	{
@@ -459,60 +463,106 @@ gfx_api::texture* gfx_api::context::loadTextureFromUncompressedImage(iV_Image&&
 		}
 		else
 		{
-			debug(LOG_WZ, "Texture compression override prevented compressing to %s for file: %s", format_to_str(bestAvailableCompressedFormat.value()), filename.c_str());
+			debug(LOG_WZ, "Texture compression override prevented compressing to %s for file: %s", gfx_api::format_to_str(bestAvailableCompressedFormat.value()), filename.c_str());
 		}
 	}
 
-	// 5.) Create a new compatible gpu texture object
-	std::unique_ptr<gfx_api::texture> pTexture = std::unique_ptr<gfx_api::texture>(gfx_api::context::get().create_texture(mipmap_levels, image.width(), image.height(), uploadFormat, filename));
+	auto prepared = std::make_unique<gfx_api::prepared_texture>();
+	prepared->filename = filename;
+	prepared->format = uploadFormat;
 
-	// 6.) Upload initial (full) level
-	if (uploadFormat == image.pixel_format())
+	// 5.) If this image was compressed before, use the cached mip chain
+	optional<gfx_api::CompressedImageCacheKey> compressedCacheKey;
+	if (uploadFormat != image.pixel_format())
 	{
-		bool uploadResult = pTexture->upload(0, image);
-		ASSERT_OR_RETURN(nullptr, uploadResult, "Failed to upload buffer to image");
+		compressedCacheKey = gfx_api::compressedImageCacheKey(image, uploadFormat, textureType, mipmap_levels);
+		if (compressedCacheKey.has_value())
+		{
+			prepared->mipLevels = gfx_api::loadCompressedImagesFromCache(compressedCacheKey.value());
+			if (!prepared->mipLevels.empty())
+			{
+				return prepared;
+			}
+		}
 	}
-	else
+
+	// 6.) Generate mipmaps (if needed)
+	auto miplevels = generateMipMapsFromUncompressedImage(image, mipmap_levels, textureType);
+	miplevels.insert(miplevels.begin(), std::unique_ptr<iV_Image>(new iV_Image(std::move(image))));
+
+	if (uploadFormat == miplevels.front()->pixel_format())
 	{
-		// Run-time compression
-		auto compressedImage = gfx_api::compressImage(image, uploadFormat);
-		ASSERT_OR_RETURN(nullptr, compressedImage != nullptr, "Failed to compress image to format: %zu", static_cast<size_t>(uploadFormat));
-		bool uploadResult = pTexture->upload(0, *compressedImage);
-		ASSERT_OR_RETURN(nullptr, uploadResult, "Failed to upload buffer to image");
+		prepared->mipLevels.insert(prepared->mipLevels.end(), std::make_move_iterator(miplevels.begin()), std::make_move_iterator(miplevels.end()));
+		return prepared;
 	}
 
-	// 7.) Generate and upload mipmaps (if needed)
-	for (size_t i = 1; i < mipmap_levels; i++)
+	// 7.) Run-time compression
+	for (auto& level : miplevels)
 	{
-		optional<int> alphaChannelOverride;
-		if (textureType == gfx_api::texture_type::alpha_mask)
-		{
-			alphaChannelOverride = 0;
-		}
+		auto compressedImage = gfx_api::compressImage(*level, uploadFormat);
+		ASSERT_OR_RETURN(nullptr, compressedImage != nullptr, "Failed to compress image to format: %zu", static_cast<size_t>(uploadFormat));
+		prepared->mipLevels.push_back(std::move(compressedImage));
+		level.reset();
+	}
 
-		unsigned int output_w = std::max<unsigned int>(1, image.width() >> 1);
-		unsigned int output_h = std::max<unsigned int>(1, image.height() >> 1);
+	// 8.) Store the compressed mip chain, so the next load can skip all of the above
+	if (compressedCacheKey.has_value())
+	{
+		gfx_api::saveCompressedImagesToCache(compressedCacheKey.value(), prepared->mipLevels);
+	}
 
-		image.resize(output_w, output_h, alphaChannelOverride);
+	return prepared;
+}
 
-		if (uploadFormat == image.pixel_format())
-		{
-			bool uploadResult = pTexture->upload(i, image);
-			ASSERT_OR_RETURN(nullptr, uploadResult, "Failed to upload buffer to image");
-		}
-		else
+std::unique_ptr<gfx_api::prepared_texture> gfx_api::prepareTextureFromFile(const char *filename, gfx_api::texture_type textureType, int maxWidth /*= -1*/, int maxHeight /*= -1*/, bool quiet /*= false*/)
+{
+	auto imageLoadFilename = imageLoadFilenameFromInputFilename(filename);
+	if (!imageLoadFilename.endsWith(".png"))
+	{
+		if (!quiet)
 		{
-			// Run-time compression
-			auto compressedImage = gfx_api::compressImage(image, uploadFormat);
-			ASSERT_OR_RETURN(nullptr, compressedImage != nullptr, "Failed to compress image to format: %zu", static_cast<size_t>(uploadFormat));
-			bool uploadResult = pTexture->upload(i, *compressedImage);
-			ASSERT_OR_RETURN(nullptr, uploadResult, "Failed to upload buffer to image");
+			debug(LOG_ERROR, "Unable to prepare image file: %s", filename);
 		}
+		return nullptr;
+	}
+
+	iV_Image loadedUncompressedImage;
+	bool forceRGB = (textureType == gfx_api::texture_type::game_texture) || (textureType == gfx_api::texture_type::user_interface);
+	if (!iV_loadImage_PNG2(imageLoadFilename.toUtf8().c_str(), loadedUncompressedImage, forceRGB, quiet))
+	{
+		// Failed to load the image
+		return nullptr;
 	}
 
+	return prepareTextureFromUncompressedImage(std::move(loadedUncompressedImage), textureType, imageLoadFilename.toUtf8(), maxWidth, maxHeight);
+}
+
+// Creates a texture from prepared data, and uploads all of its mip levels
+gfx_api::texture* gfx_api::context::uploadPreparedTexture(const gfx_api::prepared_texture& prepared)
+{
+	ASSERT_OR_RETURN(nullptr, !prepared.mipLevels.empty(), "No image data: %s", prepared.filename.c_str());
+	const iV_BaseImage& baseLevel = *prepared.mipLevels.front();
+	std::unique_ptr<gfx_api::texture> pTexture = std::unique_ptr<gfx_api::texture>(create_texture(prepared.mipLevels.size(), baseLevel.width(), baseLevel.height(), prepared.format, prepared.filename));
+	ASSERT_OR_RETURN(nullptr, pTexture != nullptr, "Failed to create texture: %s", prepared.filename.c_str());
+	for (size_t i = 0; i < prepared.mipLevels.size(); i++)
+	{
+		bool uploadResult = pTexture->upload(i, *prepared.mipLevels[i]);
+		ASSERT_OR_RETURN(nullptr, uploadResult, "Failed to upload buffer to image");
+	}
 	return pTexture.release();
 }
 
+// Takes an iv_Image and texture_type and loads a texture as appropriate / possible
+gfx_api::texture* gfx_api::context::loadTextureFromUncompressedImage(iV_Image&& image, gfx_api::texture_type textureType, const std::string& filename, int maxWidth /*= -1*/, int maxHeight /*= -1*/)
+{
+	auto prepared = prepareTextureFromUncompressedImage(std::move(image), textureType, filename, maxWidth, maxHeight);
+	if (!prepared)
+	{
+		return nullptr;
+	}
+	return uploadPreparedTexture(*prepared);
+}
+
 std::unique_ptr<iV_Image> gfx_api::loadUncompressedImageFromFile(const char *filename, gfx_api::pixel_format_target target, gfx_api::texture_type textureType, int maxWidth /*= -1*/, int maxHeight /*= -1*/, bool forceRGBA8 /*= false*/)
 {
 	auto imageLoadFilename = imageLoadFilenameFromInputFilename(filename);
@@ -896,6 +946,24 @@ static std::vector<std::unique_ptr<iV_BaseImage>> loadUncompressedImageWithMips(
 	return results;
 }
 
+#define TEXTURE_ARRAY_PREFETCH_THREADS 4
+
+typedef wz::packaged_task<std::vector<std::unique_ptr<iV_BaseImage>>()> PrefetchedLayerTask;
+typedef wz::future<std::vector<std::unique_ptr<iV_BaseImage>>> PrefetchedLayerFuture;
+
+struct TextureArrayPrefetchThreads
+{
+	std::vector<wz::thread> threads;
+
+	~TextureArrayPrefetchThreads()
+	{
+		for (auto &thread : threads)
+		{
+			thread.join();
+		}
+	}
+};
+
 gfx_api::texture_array* gfx_api::context::loadTextureArrayFromFiles(const std::vector<WzString>& filenames, gfx_api::texture_type textureType, int maxWidth /*= -1*/, int maxHeight /*= -1*/, const GenerateDefaultTextureFunc& defaultTextureGenerator, const std::function<void ()>& progressCallback, const std::string& debugName /*= ""*/)
 {
 	ASSERT_OR_RETURN(nullptr, filenames.size() <= gfx_api::context::get().get_context_value(gfx_api::context::context_value::MAX_ARRAY_TEXTURE_LAYERS), "Too many layers");
@@ -986,6 +1054,37 @@ gfx_api::texture_array* gfx_api::context::loadTextureArrayFromFiles(const std::v
 	size_t mipmap_levels = 0;
 	size_t layers_count = imageLoadFilenames.size();
 
+	// Decode the .png layers (and generate their mipmaps) on a few background threads, while the loop below uploads them in order
+	const bool forceRGBA8 = desiredImageExtractionFormat == gfx_api::pixel_format::FORMAT_RGBA8_UNORM_PACK8;
+	std::vector<PrefetchedLayerTask> prefetchTasks;
+	std::vector<PrefetchedLayerFuture> prefetchFutures;
+	std::vector<size_t> prefetchTaskForLayer(layers_count, SIZE_MAX);
+	for (size_t layer = 0; layer < layers_count; ++layer)
+	{
+		WzString imageLoadFilename = imageLoadFilenames[layer];
+		if (!imageLoadFilename.endsWith(".png"))
+		{
+			continue;
+		}
+		prefetchTaskForLayer[layer] = prefetchTasks.size();
+		prefetchTasks.emplace_back([imageLoadFilename, textureType, maxWidth, maxHeight, forceRGBA8]() {
+			return loadUncompressedImageWithMips(imageLoadFilename.toUtf8(), textureType, maxWidth, maxHeight, forceRGBA8);
+		});
+		prefetchFutures.push_back(prefetchTasks.back().get_future());
+	}
+	std::atomic<size_t> nextPrefetchTask(0);
+	TextureArrayPrefetchThreads prefetchThreads;  // Joined on scope exit, before the tasks go away
+	const size_t numPrefetchThreads = std::min<size_t>(prefetchTasks.size(), std::min<unsigned>(std::max<unsigned>(std::thread::hardware_concurrency(), 2) - 1, TEXTURE_ARRAY_PREFETCH_THREADS));
+	for (size_t i = 0; i < numPrefetchThreads; ++i)
+	{
+		prefetchThreads.threads.emplace_back([&prefetchTasks, &nextPrefetchTask]() {
+			for (size_t task = nextPrefetchTask++; task < prefetchTasks.size(); task = nextPrefetchTask++)
+			{
+				prefetchTasks[task]();
+			}
+		});
+	}
+
 	for (size_t layer = 0; layer < layers_count; ++layer)
 	{
 		const WzString& imageLoadFilename = imageLoadFilenames[layer];
@@ -1001,7 +1100,18 @@ gfx_api::texture_array* gfx_api::context::loadTextureArrayFromFiles(const std::v
 		else if (uncompressedExtractionFormat || imageLoadFilename.endsWith(".png"))
 		{
 			// load into an uncompressed format
-			loadedImagesForLayer = loadUncompressedImageWithMips(imageLoadFilename.toUtf8(), textureType, maxWidth, maxHeight, desiredImageExtractionFormat == gfx_api::pixel_format::FORMAT_RGBA8_UNORM_PACK8);
+			if (prefetchTaskForLayer[layer] < prefetchTasks.size())
+			{
+				if (numPrefetchThreads == 0)
+				{
+					prefetchTasks[prefetchTaskForLayer[layer]]();  // No spare cores, decode it here
+				}
+				loadedImagesForLayer = prefetchFutures[prefetchTaskForLayer[layer]].get();
+			}
+			else
+			{
+				loadedImagesForLayer = loadUncompressedImageWithMips(imageLoadFilename.toUtf8(), textureType, maxWidth, maxHeight, forceRGBA8);
+			}
 			if (!loadedImagesForLayer.empty())
 			{
 				pImagesForLayer = &loadedImagesForLayer;
@@ -107,6 +107,14 @@ namespace gfx_api
 		texture() {};
 	};
 
+	// Texture data that has been decoded, mipmapped and (possibly) compressed, and only needs uploading
+	struct prepared_texture
+	{
+		std::string filename;
+		gfx_api::pixel_format format = gfx_api::pixel_format::invalid;
+		std::vector<std::unique_ptr<iV_BaseImage>> mipLevels;
+	};
+
 	struct texture_array : abstract_texture
 	{
 		virtual bool upload_layer(const size_t& layer, const size_t& mip_level, const iV_BaseImage& image) = 0;
@@ -118,6 +126,16 @@ namespace gfx_api
 		texture_array() {};
 	};
 
+	// Offscreen colour (plus depth / stencil) target that drawing can be redirected into, and later drawn from as a texture.
+	// The colour is premultiplied by alpha, and its rows are stored bottom-up.
+	struct render_target
+	{
+		virtual abstract_texture* color_texture() = 0;
+		virtual size_t width() const = 0;
+		virtual size_t height() const = 0;
+		virtual ~render_target() {};
+	};
+
 	// An abstract base that manages a single gfx buffer
 	struct buffer
 	{
@@ -336,6 +354,17 @@ namespace gfx_api
 		}
 	};
 
+	// Work handed to the backend during one frame. Only counted by backends that report it (see context::getLastFrameStats)
+	struct frame_stats
+	{
+		size_t drawCalls = 0;
+		size_t pipelineBinds = 0;       ///< Binds that actually changed the pipeline
+		size_t bufferUploads = 0;       ///< Includes streamed vertex data, constants and uniforms
+		size_t bufferUploadBytes = 0;
+		size_t textureUploads = 0;
+		size_t textureUploadBytes = 0;
+	};
+
 	struct context
 	{
 		enum class buffer_storage_hint
@@ -434,8 +463,18 @@ namespace gfx_api
 		virtual void draw_elements_instanced(const std::size_t& offset, const std::size_t& count, const primitive_type& primitive, const index_type& index, std::size_t instance_count) = 0;
 		// debug apis for recompiling pipelines
 		virtual bool debugRecompileAllPipelines() = 0;
+		// stats of the last completed frame, for backends that count them
+		virtual optional<frame_stats> getLastFrameStats() const { return nullopt; }
+		// make a backend without any output (null) still go through all the drawing, for measuring the CPU side of rendering
+		virtual bool setHeadlessDrawing(bool /*enabled*/) { return false; }
+		// offscreen targets for caching 2D drawing (sizes in drawable pixels); backends without them return nullptr, and callers draw directly
+		virtual render_target* create_render_target(size_t /*width*/, size_t /*height*/, const std::string& /*debugName*/ = "") { return nullptr; }
+		// redirect drawing into the (cleared) target, which then stands for the drawable's pixels from (x, y) (top-left origin) on
+		virtual bool beginRenderTarget(render_target* /*target*/, int32_t /*x*/, int32_t /*y*/) { return false; }
+		virtual void endRenderTarget() { }
 	public:
 		// High-level API for getting a texture object from file / uncompressed bitmap
+		gfx_api::texture* uploadPreparedTexture(const prepared_texture& prepared);
 		gfx_api::texture* loadTextureFromFile(const char *filename, gfx_api::texture_type textureType, int maxWidth = -1, int maxHeight = -1, bool quiet = false);
 		gfx_api::texture* loadTextureFromUncompressedImage(iV_Image&& image, gfx_api::texture_type textureType, const std::string& filename, int maxWidth = -1, int maxHeight = -1);
 		typedef std::function<std::unique_ptr<iV_Image> (int width, int height, int channels)> GenerateDefaultTextureFunc;
@@ -453,6 +492,10 @@ namespace gfx_api
 		virtual bool _initialize(const backend_Impl_Factory& impl, int32_t antialiasing, swap_interval_mode mode, optional<float> mipLodBias, uint32_t depthMapResolution) = 0;
 	};
 
+	// High-level API for doing all the CPU work of loadTextureFromFile (decode, mipmaps, run-time compression) without touching the GPU
+	// May be called from any thread. Returns nullptr on failure, or for files that can only be loaded straight to a texture (.ktx2)
+	std::unique_ptr<prepared_texture> prepareTextureFromFile(const char *filename, gfx_api::texture_type textureType, int maxWidth = -1, int maxHeight = -1, bool quiet = false);
+
 	// High-level API for getting an uncompressed image (iV_Image) from a file
 	std::unique_ptr<iV_Image> loadUncompressedImageFromFile(const char *filename, gfx_api::pixel_format_target target, gfx_api::texture_type textureType, int maxWidth = -1, int maxHeight = -1, bool forceRGBA8 = false);
 
@@ -1258,6 +1301,13 @@ namespace gfx_api
 	vertex_buffer_description<4, gfx_api::vertex_attribute_input_rate::vertex, vertex_attribute_description<position, gfx_api::vertex_attribute_type::u8x4_norm, 0>>
 	>, std::tuple<texture_description<0, sampler_type::anisotropic>>, SHADER_TEXRECT>;
 
+	// Draws the (premultiplied, bottom-up) contents of a render_target, see iV_DrawRenderTarget
+	using DrawRenderTargetPSO = typename gfx_api::pipeline_state_helper<rasterizer_state<REND_PREMULTIPLIED, DEPTH_CMP_ALWAYS_WRT_OFF, 255, polygon_offset::disabled, stencil_mode::stencil_disabled, cull_mode::back>, primitive_type::triangle_strip, index_type::u16,
+	std::tuple<constant_buffer_type<SHADER_TEXRECT>>,
+	std::tuple<
+	vertex_buffer_description<4, gfx_api::vertex_attribute_input_rate::vertex, vertex_attribute_description<position, gfx_api::vertex_attribute_type::u8x4_norm, 0>>
+	>, std::tuple<texture_description<0, sampler_type::nearest_clamped>>, SHADER_TEXRECT>;
+
 	using BoxFillPSO = typename gfx_api::pipeline_state_helper<rasterizer_state<REND_OPAQUE, DEPTH_CMP_ALWAYS_WRT_OFF, 255, polygon_offset::disabled, stencil_mode::stencil_disabled, cull_mode::back>, primitive_type::triangle_strip, index_type::u16,
 	std::tuple<constant_buffer_type<SHADER_RECT>>,
 	std::tuple<
@@ -99,6 +99,7 @@ OPENGL_DATA opengl;
 static GLuint perfpos[PERF_COUNT] = {};
 static bool perfStarted = false;
 #endif
+static bool renderTargetBound = false; ///< Between gl_context::beginRenderTarget() and endRenderTarget()
 
 #if defined(WZ_DEBUG_GFX_API_LEAKS)
 static std::unordered_set<const gl_texture*> debugLiveTextures;
@@ -1259,7 +1260,15 @@ void gl_pipeline_state_object::bind()
 
 		case REND_ALPHA:
 			glEnable(GL_BLEND);
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			if (renderTargetBound)
+			{
+				// Keep the target premultiplied, so it can be drawn over something else afterwards
+				glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+			}
+			else
+			{
+				glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			}
 			break;
 
 		case REND_ADDITIVE:
@@ -5215,6 +5224,100 @@ gfx_api::abstract_texture* gl_context::getSceneTexture()
 	return sceneTexture;
 }
 
+gl_render_target::~gl_render_target()
+{
+	if (fbo != 0)
+	{
+		glDeleteFramebuffers(1, &fbo);
+	}
+	if (depthStencilRBO != 0)
+	{
+		glDeleteRenderbuffers(1, &depthStencilRBO);
+	}
+	delete colour;
+}
+
+gfx_api::render_target* gl_context::create_render_target(size_t width, size_t height, const std::string& debugName)
+{
+#if !defined(__EMSCRIPTEN__)
+	if ( ! ((!gles && GLAD_GL_VERSION_3_0) || (gles && GLAD_GL_ES_VERSION_3_0)) )
+	{
+		// The following requires OpenGL 3.0+ or OpenGL ES 3.0+
+		return nullptr;
+	}
+#endif
+	ASSERT_OR_RETURN(nullptr, width > 0 && height > 0, "Empty render target");
+
+	wzGLClearErrors(); // clear OpenGL error states
+
+	std::unique_ptr<gl_render_target> target(new gl_render_target());
+	target->_width = width;
+	target->_height = height;
+	target->colour = create_framebuffer_color_texture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height, debugName);
+	ASSERT_GL_NOERRORS_OR_RETURN(nullptr);
+	ASSERT_OR_RETURN(nullptr, target->colour != nullptr, "Failed to create render target texture (%zu x %zu)", width, height);
+	target->colour->bind();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	target->colour->unbind();
+	ASSERT_GL_NOERRORS_OR_RETURN(nullptr);
+
+	// Buttons draw 3D models, which need depth (and stencil for their shadows)
+	glGenRenderbuffers(1, &target->depthStencilRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, target->depthStencilRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	ASSERT_GL_NOERRORS_OR_RETURN(nullptr);
+
+	GLint previousFBO = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFBO);
+	glGenFramebuffers(1, &target->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->colour->id(), 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target->depthStencilRBO);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFBO));
+	ASSERT_GL_NOERRORS_OR_RETURN(nullptr);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		debug(LOG_ERROR, "Failed to create render target framebuffer (%zu x %zu) with error: %s", width, height, cbframebuffererror(status));
+		return nullptr;
+	}
+
+	return target.release();
+}
+
+bool gl_context::beginRenderTarget(gfx_api::render_target* target, int32_t x, int32_t y)
+{
+	ASSERT_OR_RETURN(false, target != nullptr, "No render target");
+	ASSERT_OR_RETURN(false, renderTargetPreviousFBO < 0, "Render targets can't be nested");
+	gl_render_target* glTarget = static_cast<gl_render_target*>(target);
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &renderTargetPreviousFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, glTarget->fbo);
+	// Keep the viewport the size of the drawable, shifted so that (x, y) lands on the target's top-left corner.
+	// Then everything is drawn exactly as it would be on screen, without touching any projection.
+	glViewport(-x, y + static_cast<GLint>(glTarget->_height) - static_cast<GLint>(viewportHeight), viewportWidth, viewportHeight);
+	glClearColor(0.f, 0.f, 0.f, 0.f);
+	glDepthMask(GL_TRUE);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+	renderTargetBound = true;
+	current_program = nullptr; // The blend state depends on renderTargetBound, so pipelines must be bound again
+	return true;
+}
+
+void gl_context::endRenderTarget()
+{
+	ASSERT_OR_RETURN(, renderTargetPreviousFBO >= 0, "No render target bound");
+	glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(renderTargetPreviousFBO));
+	glViewport(0, 0, viewportWidth, viewportHeight);
+	renderTargetPreviousFBO = -1;
+
+	renderTargetBound = false;
+	current_program = nullptr;
+}
+
 #if defined(__EMSCRIPTEN__)
 
 static std::vector<std::string> getEmscriptenSupportedGLExtensions()
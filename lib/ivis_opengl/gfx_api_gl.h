@@ -123,6 +123,7 @@ struct gl_gpurendered_texture final : public gfx_api::abstract_texture
 {
 private:
 	friend struct gl_context;
+	friend struct gl_render_target;
 	GLuint _id;
 	bool gles = false;
 	bool _isArray = false;
@@ -141,6 +142,24 @@ public:
 	void unbind();
 };
 
+struct gl_render_target final : public gfx_api::render_target
+{
+private:
+	friend struct gl_context;
+	GLuint fbo = 0;
+	GLuint depthStencilRBO = 0;
+	gl_gpurendered_texture* colour = nullptr;
+	size_t _width = 0;
+	size_t _height = 0;
+
+	gl_render_target() { }
+public:
+	virtual ~gl_render_target() override;
+	virtual gfx_api::abstract_texture* color_texture() override { return colour; }
+	virtual size_t width() const override { return _width; }
+	virtual size_t height() const override { return _height; }
+};
+
 struct gl_buffer final : public gfx_api::buffer
 {
 	gfx_api::buffer::usage usage;
@@ -325,6 +344,9 @@ struct gl_context final : public gfx_api::context
 	virtual void beginSceneRenderPass() override;
 	virtual void endSceneRenderPass() override;
 	virtual gfx_api::abstract_texture* getSceneTexture() override;
+	virtual gfx_api::render_target* create_render_target(size_t width, size_t height, const std::string& debugName = "") override;
+	virtual bool beginRenderTarget(gfx_api::render_target* target, int32_t x, int32_t y) override;
+	virtual void endRenderTarget() override;
 	virtual void beginRenderPass() override;
 	virtual void endRenderPass() override;
 	virtual void debugStringMarker(const char *str) override;
@@ -425,4 +447,6 @@ private:
 	GLuint sceneMsaaRBO = 0;
 	GLuint sceneDepthStencilRBO = 0;
 	size_t sceneFBOIdx = 0;
+
+	GLint renderTargetPreviousFBO = -1; ///< Framebuffer to go back to after endRenderTarget(), -1 when no render target is bound
 };
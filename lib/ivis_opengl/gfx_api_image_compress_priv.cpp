@@ -19,10 +19,13 @@
 
 #include "gfx_api_image_compress_priv.h"
 #include "gfx_api.h"
+#include "lib/framework/crc.h"
+#include "lib/framework/physfs_ext.h"
 
 #include <vector>
 #include <array>
 #include <algorithm>
+#include <cstring>
 
 // Return the formats for which real-time compression support has been included in this executable
 static std::vector<gfx_api::pixel_format> builtInRealTimeFormatCompressors =
@@ -414,3 +417,134 @@ std::unique_ptr<iV_BaseImage> gfx_api::compressImage(const iV_Image& image, gfx_
 
 	return nullptr;
 }
+
+// MARK: - Compressed image cache
+
+#define COMPRESSED_IMAGE_CACHE_DIR		"cache/texcompress"
+#define COMPRESSED_IMAGE_CACHE_EXTENSION	".wzct"
+#define COMPRESSED_IMAGE_CACHE_VERSION		1	// Bump whenever the output of the compressors changes
+#define COMPRESSED_IMAGE_CACHE_MAX_FILES	2048
+#define COMPRESSED_IMAGE_CACHE_MIN_PIXELS	(128 * 128)	// Smaller images compress faster than we can look them up
+
+static_assert(sizeof(gfx_api::CompressedImageCacheKey) == 64, "CompressedImageCacheKey must not have padding, it is hashed and written as-is");
+static_assert(Sha256::Bytes == sizeof(gfx_api::CompressedImageCacheKey::sourceHash), "Unexpected Sha256 size");
+
+static std::string compressedImageCachePath(const gfx_api::CompressedImageCacheKey& key)
+{
+	return std::string(COMPRESSED_IMAGE_CACHE_DIR "/") + sha256Sum(&key, sizeof(key)).toString() + COMPRESSED_IMAGE_CACHE_EXTENSION;
+}
+
+optional<gfx_api::CompressedImageCacheKey> gfx_api::compressedImageCacheKey(const iV_Image& image, gfx_api::pixel_format compressedFormat, gfx_api::texture_type textureType, size_t mipmapLevels)
+{
+	if (static_cast<size_t>(image.width()) * image.height() < COMPRESSED_IMAGE_CACHE_MIN_PIXELS)
+	{
+		return nullopt;
+	}
+
+	gfx_api::CompressedImageCacheKey key;
+	memset(&key, 0, sizeof(key));
+	memcpy(key.magic, "WZCT", sizeof(key.magic));
+	key.version = COMPRESSED_IMAGE_CACHE_VERSION;
+	key.sourceFormat = static_cast<uint32_t>(image.pixel_format());
+	key.compressedFormat = static_cast<uint32_t>(compressedFormat);
+	key.textureType = static_cast<uint32_t>(textureType);
+	key.mipmapLevels = static_cast<uint32_t>(mipmapLevels);
+	key.width = image.width();
+	key.height = image.height();
+	Sha256 sourceHash = sha256Sum(image.data(), image.data_size());
+	memcpy(key.sourceHash, sourceHash.bytes, sizeof(key.sourceHash));
+	return key;
+}
+
+std::vector<std::unique_ptr<iV_BaseImage>> gfx_api::loadCompressedImagesFromCache(const gfx_api::CompressedImageCacheKey& key)
+{
+	std::vector<std::unique_ptr<iV_BaseImage>> mipLevels;
+	const std::string path = compressedImageCachePath(key);
+	if (!PHYSFS_exists(path.c_str()))
+	{
+		return mipLevels;
+	}
+	PHYSFS_file *fileHandle = PHYSFS_openRead(path.c_str());
+	if (fileHandle == nullptr)
+	{
+		return mipLevels;
+	}
+
+	const auto format = static_cast<gfx_api::pixel_format>(key.compressedFormat);
+	gfx_api::CompressedImageCacheKey storedKey;
+	bool valid = WZ_PHYSFS_readBytes(fileHandle, &storedKey, sizeof(storedKey)) == static_cast<PHYSFS_sint64>(sizeof(storedKey))
+		&& memcmp(&storedKey, &key, sizeof(key)) == 0;
+	for (uint32_t level = 0; valid && level < key.mipmapLevels; ++level)
+	{
+		uint32_t width = 0, height = 0, dataSize = 0;
+		valid = PHYSFS_readULE32(fileHandle, &width) && PHYSFS_readULE32(fileHandle, &height) && PHYSFS_readULE32(fileHandle, &dataSize)
+			&& width == std::max<uint32_t>(1, key.width >> level) && height == std::max<uint32_t>(1, key.height >> level)
+			&& dataSize == gfx_api::format_memory_size(format, width, height);
+		if (!valid)
+		{
+			break;
+		}
+		auto image = std::make_unique<iV_CompressedImage>();
+		valid = image->allocate(format, dataSize, 0, 0, width, height, false)
+			&& WZ_PHYSFS_readBytes(fileHandle, image->uint64_w(), dataSize) == dataSize;
+		mipLevels.push_back(std::move(image));
+	}
+	PHYSFS_close(fileHandle);
+
+	if (!valid)
+	{
+		debug(LOG_WZ, "Discarding invalid compressed image cache file: %s", path.c_str());
+		mipLevels.clear();
+	}
+	return mipLevels;
+}
+
+void gfx_api::saveCompressedImagesToCache(const gfx_api::CompressedImageCacheKey& key, const std::vector<std::unique_ptr<iV_BaseImage>>& mipLevels)
+{
+	ASSERT_OR_RETURN(, mipLevels.size() == key.mipmapLevels, "Expected %" PRIu32 " mip levels, got %zu", key.mipmapLevels, mipLevels.size());
+
+	// Textures may be prepared on several threads at once, so check the cache dir exactly once
+	static const bool cacheDirReady = []() {
+		if (!WZ_PHYSFS_isDirectory(COMPRESSED_IMAGE_CACHE_DIR) && PHYSFS_mkdir(COMPRESSED_IMAGE_CACHE_DIR) == 0)
+		{
+			debug(LOG_WARNING, "Failed to create compressed image cache folder: %s", WZ_PHYSFS_getLastError());
+			return false;
+		}
+		// Keep the cache from growing forever as textures and mods come and go
+		WZ_PHYSFS_cleanupOldFilesInFolder(COMPRESSED_IMAGE_CACHE_DIR, COMPRESSED_IMAGE_CACHE_EXTENSION, COMPRESSED_IMAGE_CACHE_MAX_FILES - 1, [](const char *fileName) {
+			return PHYSFS_delete(fileName) != 0;
+		});
+		return true;
+	}();
+	if (!cacheDirReady)
+	{
+		return;
+	}
+
+	const std::string path = compressedImageCachePath(key);
+	PHYSFS_file *fileHandle = PHYSFS_openWrite(path.c_str());
+	if (fileHandle == nullptr)
+	{
+		debug(LOG_WZ, "Unable to write compressed image cache file %s: %s", path.c_str(), WZ_PHYSFS_getLastError());
+		return;
+	}
+	bool ok = WZ_PHYSFS_writeBytes(fileHandle, &key, sizeof(key)) == static_cast<PHYSFS_sint64>(sizeof(key));
+	for (const auto& image : mipLevels)
+	{
+		if (!ok)
+		{
+			break;
+		}
+		const uint32_t dataSize = static_cast<uint32_t>(image->data_size());
+		ok = PHYSFS_writeULE32(fileHandle, image->width()) && PHYSFS_writeULE32(fileHandle, image->height()) && PHYSFS_writeULE32(fileHandle, dataSize)
+			&& WZ_PHYSFS_writeBytes(fileHandle, image->data(), dataSize) == dataSize;
+	}
+	PHYSFS_close(fileHandle);
+
+	if (!ok)
+	{
+		// A truncated file would fail validation anyway, but don't leave it lying around
+		debug(LOG_WZ, "Failed to write compressed image cache file %s: %s", path.c_str(), WZ_PHYSFS_getLastError());
+		PHYSFS_delete(path.c_str());
+	}
+}
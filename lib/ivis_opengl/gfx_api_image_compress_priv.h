@@ -23,6 +23,7 @@
 #include "gfx_api_formats_def.h"
 
 #include <memory>
+#include <vector>
 
 #include <nonstd/optional.hpp>
 using nonstd::optional;
@@ -38,6 +39,27 @@ namespace gfx_api
 
 	// Compresses an iV_Image to the desired compressed image format (if possible)
 	std::unique_ptr<iV_BaseImage> compressImage(const iV_Image& image, gfx_api::pixel_format desiredFormat);
+
+	// Everything a run-time compressed mip chain depends on
+	// Stored at the start of each compressed image cache file, and hashed to name it
+	struct CompressedImageCacheKey
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t sourceFormat;
+		uint32_t compressedFormat;
+		uint32_t textureType;
+		uint32_t mipmapLevels;
+		uint32_t width;
+		uint32_t height;
+		uint8_t sourceHash[32];
+	};
+
+	// Returns nullopt if the image isn't worth caching
+	optional<CompressedImageCacheKey> compressedImageCacheKey(const iV_Image& image, gfx_api::pixel_format compressedFormat, gfx_api::texture_type textureType, size_t mipmapLevels);
+	// Returns the cached mip chain, or an empty vector if there is no valid cache entry
+	std::vector<std::unique_ptr<iV_BaseImage>> loadCompressedImagesFromCache(const CompressedImageCacheKey& key);
+	void saveCompressedImagesToCache(const CompressedImageCacheKey& key, const std::vector<std::unique_ptr<iV_BaseImage>>& mipLevels);
 }
 
 // An image in a compressed format
@@ -20,6 +20,22 @@
 #include "lib/framework/frame.h"
 #include "gfx_api_null.h"
 #include "lib/exceptionhandler/dumpinfo.h"
+#include "pieclip.h"
+
+// Work submitted during the current frame, handed over to null_context::lastFrameStats by endRenderPass
+static gfx_api::frame_stats currentFrameStats;
+
+static void countTextureUpload(const iV_BaseImage& image)
+{
+	++currentFrameStats.textureUploads;
+	currentFrameStats.textureUploadBytes += image.data_size();
+}
+
+static void countBufferUpload(size_t size)
+{
+	++currentFrameStats.bufferUploads;
+	currentFrameStats.bufferUploadBytes += size;
+}
 
 // MARK: null_texture
 
@@ -45,7 +61,7 @@ bool null_texture::upload(const size_t& mip_level, const iV_BaseImage& image)
 	size_t width = image.width();
 	size_t height = image.height();
 	ASSERT(width > 0 && height > 0, "Attempt to upload texture with width or height of 0 (width: %zu, height: %zu)", width, height);
-	// no-op
+	countTextureUpload(image);
 	return true;
 }
 
@@ -56,7 +72,7 @@ bool null_texture::upload_sub(const size_t& mip_level, const size_t& offset_x, c
 	size_t width = image.width();
 	size_t height = image.height();
 	ASSERT(width > 0 && height > 0, "Attempt to upload texture with width or height of 0 (width: %zu, height: %zu)", width, height);
-	// no-op
+	countTextureUpload(image);
 	return true;
 }
 
@@ -94,7 +110,7 @@ bool null_texture_array::upload_layer(const size_t& layer, const size_t& mip_lev
 	size_t width = image.width();
 	size_t height = image.height();
 	ASSERT(width > 0 && height > 0, "Attempt to upload texture with width or height of 0 (width: %zu, height: %zu)", width, height);
-	// no-op
+	countTextureUpload(image);
 	return true;
 }
 
@@ -137,7 +153,7 @@ void null_buffer::upload(const size_t & size, const void * data)
 
 	ASSERT(size > 0, "Attempt to upload buffer of size 0");
 	buffer_size = size;
-	// no-op
+	countBufferUpload(size);
 }
 
 void null_buffer::update(const size_t & start, const size_t & size, const void * data, const update_flag flag)
@@ -155,7 +171,7 @@ void null_buffer::update(const size_t & start, const size_t & size, const void *
 		debug(LOG_WARNING, "Attempt to update buffer with 0 bytes of new data");
 		return;
 	}
-	// no-op
+	countBufferUpload(size);
 }
 
 size_t null_buffer::current_buffer_size()
@@ -209,6 +225,7 @@ void null_context::bind_pipeline(gfx_api::pipeline_state_object* pso, bool notex
 	if (current_program != new_program)
 	{
 		current_program = new_program;
+		++currentFrameStats.pipelineBinds;
 	}
 }
 
@@ -242,7 +259,7 @@ void null_context::bind_streamed_vertex_buffers(const void* data, const std::siz
 {
 	ASSERT_OR_RETURN(, current_program != nullptr, "current_program == NULL");
 	ASSERT(size > 0, "bind_streamed_vertex_buffers called with size 0");
-	// no-op
+	countBufferUpload(size);
 }
 
 void null_context::bind_index_buffer(gfx_api::buffer& _buffer, const gfx_api::index_type&)
@@ -268,33 +285,39 @@ void null_context::bind_textures(const std::vector<gfx_api::texture_input>& text
 void null_context::set_constants(const void* buffer, const size_t& size)
 {
 	ASSERT_OR_RETURN(, current_program != nullptr, "current_program == NULL");
-	// no-op
+	countBufferUpload(size);
 }
 
 void null_context::set_uniforms(const size_t& first, const std::vector<std::tuple<const void*, size_t>>& uniform_blocks)
 {
 	ASSERT_OR_RETURN(, current_program != nullptr, "current_program == NULL");
-	// no-op
+	for (const auto& uniform_block : uniform_blocks)
+	{
+		if (std::get<0>(uniform_block) != nullptr)
+		{
+			countBufferUpload(std::get<1>(uniform_block));
+		}
+	}
 }
 
 void null_context::draw(const size_t& offset, const size_t &count, const gfx_api::primitive_type &primitive)
 {
-	// no-op
+	++currentFrameStats.drawCalls;
 }
 
 void null_context::draw_instanced(const std::size_t& offset, const std::size_t &count, const gfx_api::primitive_type &primitive, std::size_t instance_count)
 {
-	// no-op
+	++currentFrameStats.drawCalls;
 }
 
 void null_context::draw_elements(const size_t& offset, const size_t &count, const gfx_api::primitive_type &primitive, const gfx_api::index_type& index)
 {
-	// no-op
+	++currentFrameStats.drawCalls;
 }
 
 void null_context::draw_elements_instanced(const std::size_t& offset, const std::size_t &count, const gfx_api::primitive_type &primitive, const gfx_api::index_type& index, std::size_t instance_count)
 {
-	// no-op
+	++currentFrameStats.drawCalls;
 }
 
 void null_context::set_polygon_offset(const float& offset, const float& slope)
@@ -428,6 +451,8 @@ void null_context::beginRenderPass()
 void null_context::endRenderPass()
 {
 	frameNum = std::max<size_t>(frameNum + 1, 1);
+	lastFrameStats = currentFrameStats;
+	currentFrameStats = gfx_api::frame_stats();
 
 	// Backend is expected to handle throttling / sleeping
 	backend_impl->swapWindow();
@@ -442,12 +467,28 @@ void null_context::handleWindowSizeChange(unsigned int oldWidth, unsigned int ol
 
 std::pair<uint32_t, uint32_t> null_context::getDrawableDimensions()
 {
+	if (headlessDrawing)
+	{
+		// Pretend to be a window the size of the (configured) video buffer, so the whole scene gets "drawn"
+		return {static_cast<uint32_t>(pie_GetVideoBufferWidth()), static_cast<uint32_t>(pie_GetVideoBufferHeight())};
+	}
 	return {0,0};
 }
 
 bool null_context::shouldDraw()
 {
-	return false;
+	return headlessDrawing;
+}
+
+optional<gfx_api::frame_stats> null_context::getLastFrameStats() const
+{
+	return lastFrameStats;
+}
+
+bool null_context::setHeadlessDrawing(bool enabled)
+{
+	headlessDrawing = enabled;
+	return true;
 }
 
 void null_context::shutdown()
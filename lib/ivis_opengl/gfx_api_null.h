@@ -161,9 +161,13 @@ public:
 	virtual void draw_elements_instanced(const std::size_t& offset, const std::size_t& count, const gfx_api::primitive_type& primitive, const gfx_api::index_type& index, std::size_t instance_count) override;
 	// debug apis for recompiling pipelines
 	virtual bool debugRecompileAllPipelines() override;
+	virtual optional<gfx_api::frame_stats> getLastFrameStats() const override;
+	virtual bool setHeadlessDrawing(bool enabled) override;
 private:
 	virtual bool _initialize(const gfx_api::backend_Impl_Factory& impl, int32_t antialiasing, swap_interval_mode mode, optional<float> mipLodBias, uint32_t depthMapResolution) override;
 private:
 
 	size_t frameNum = 0;
+	gfx_api::frame_stats lastFrameStats;
+	bool headlessDrawing = false;
 };
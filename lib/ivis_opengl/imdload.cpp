@@ -28,6 +28,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <array>
+#include <algorithm>
+#include <type_traits>
 
 #include "lib/framework/frame.h"
 #include "lib/framework/string_ext.h"
@@ -35,6 +37,7 @@
 #include "lib/framework/fixedpoint.h"
 #include "lib/framework/file.h"
 #include "lib/framework/physfs_ext.h"
+#include "lib/framework/crc.h"
 #include "lib/ivis_opengl/piematrix.h"
 #include "lib/ivis_opengl/pienormalize.h"
 #include "lib/ivis_opengl/piestate.h"
@@ -49,16 +52,124 @@ using Vector4f = glm::vec4;
 // Scale animation numbers from int to float
 #define INT_SCALE       1000
 
+// Processed models are cached here (see IMDCacheWriter), one file per source .pie
+#define IMD_CACHE_DIR       "cache/models"
+#define IMD_CACHE_MAGIC     0x43454950  // "PIEC"
+#define IMD_CACHE_VERSION   2           // Bump whenever the loader changes what ends up in an iIMDShape
+
+/// Serializes a processed model: everything _imd_load_level puts in an iIMDShape, plus the vertex data it
+/// generates for the GPU. The cache is local to this machine (native endianness and layout), and is only
+/// used if the SHA-256 of the source file and IMD_CACHE_VERSION match.
+class IMDCacheWriter
+{
+public:
+	template <typename T>
+	void writeValue(const T &value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Cached values must be trivially copyable");
+		const uint8_t *pBytes = reinterpret_cast<const uint8_t *>(&value);
+		data.insert(data.end(), pBytes, pBytes + sizeof(T));
+	}
+
+	template <typename T>
+	void writeVector(const std::vector<T> &values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Cached values must be trivially copyable");
+		writeValue<uint32_t>(static_cast<uint32_t>(values.size()));
+		const uint8_t *pBytes = reinterpret_cast<const uint8_t *>(values.data());
+		data.insert(data.end(), pBytes, pBytes + values.size() * sizeof(T));
+	}
+
+	void writeString(const std::string &value)
+	{
+		writeValue<uint32_t>(static_cast<uint32_t>(value.size()));
+		data.insert(data.end(), value.begin(), value.end());
+	}
+
+	std::vector<uint8_t> data;
+};
+
+/// Reads back what IMDCacheWriter wrote. A read past the end fails, and so does every read after it.
+class IMDCacheReader
+{
+public:
+	IMDCacheReader(const char *pData, size_t size) : pCurrent(pData), pEnd(pData + size) {}
+
+	template <typename T>
+	bool readValue(T &value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Cached values must be trivially copyable");
+		if (!take(sizeof(T)))
+		{
+			return false;
+		}
+		memcpy(&value, pCurrent - sizeof(T), sizeof(T));
+		return true;
+	}
+
+	template <typename T>
+	bool readVector(std::vector<T> &values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Cached values must be trivially copyable");
+		uint32_t count = 0;
+		if (!readValue(count) || !take(static_cast<size_t>(count) * sizeof(T)))
+		{
+			return false;
+		}
+		const size_t size = static_cast<size_t>(count) * sizeof(T);
+		values.resize(count);
+		if (size > 0)
+		{
+			memcpy(values.data(), pCurrent - size, size);
+		}
+		return true;
+	}
+
+	bool readString(std::string &value)
+	{
+		uint32_t length = 0;
+		if (!readValue(length) || !take(length))
+		{
+			return false;
+		}
+		value.assign(pCurrent - length, length);
+		return true;
+	}
+
+	size_t remaining() const { return (failed) ? 0 : static_cast<size_t>(pEnd - pCurrent); }
+	bool ok() const { return !failed; }
+
+private:
+	bool take(size_t size)
+	{
+		if (failed || size > static_cast<size_t>(pEnd - pCurrent))
+		{
+			failed = true;
+			return false;
+		}
+		pCurrent += size;
+		return true;
+	}
+
+	const char *pCurrent;
+	const char *pEnd;
+	bool failed = false;
+};
+
 typedef std::unordered_map<std::string, std::unique_ptr<iIMDBaseShape>> ModelMap;
 static ModelMap models;
 static size_t currentTilesetIdx = 0;
 
-static std::unique_ptr<iIMDShape> iV_ProcessIMD(const WzString &filename, const char **ppFileData, const char *FileDataEnd, bool skipGPUData);
+static std::unique_ptr<iIMDShape> iV_ProcessIMD(const WzString &filename, const char **ppFileData, const char *FileDataEnd, bool skipGPUData, IMDCacheWriter *pCache);
+static IMDCacheWriter _imd_cache_begin(const Sha256 &sourceHash);
+static std::unique_ptr<iIMDShape> _imd_cache_load(const std::string &cachePath, const Sha256 &sourceHash, const WzString &filename, bool skipGPUData);
+static void _imd_cache_save(const std::string &cachePath, const IMDCacheWriter &cache);
+static void _imd_init_lod(iIMDShape &lod, iIMDShape &s);
+static void _imd_generate_lods(iIMDShape &s, bool withTangents, IMDCacheWriter *pCache);
 static bool _imd_load_level_textures(const iIMDShape& s, size_t tilesetIdx, iIMDShapeTextures& output);
 
 iIMDShape::~iIMDShape()
 {
-	free(shadowEdgeList);
 	for (auto* buffer : buffers)
 	{
 		delete buffer;
@@ -67,6 +178,10 @@ iIMDShape::~iIMDShape()
 
 const iIMDShapeTextures& iIMDShape::getTextures() const
 {
+	if (lodOf != nullptr)
+	{
+		return lodOf->getTextures();
+	}
 	if (!m_textures->initialized)
 	{
 		// Load the textures on-demand
@@ -176,8 +291,24 @@ static std::unique_ptr<iIMDShape> tryLoadDisplayModelInternal(const WzString &pa
 			return nullptr;
 		}
 		fileEnd = pFileData + size;
-		const char *pFileDataPt = pFileData;
-		auto result = iV_ProcessIMD(filename, (const char **)&pFileDataPt, fileEnd, skipGPUupload);
+
+		// Parsing the text and generating the vertex data is slow, so try the model processed by an earlier run first
+		const Sha256 sourceHash = sha256Sum(pFileData, size);
+		std::string cachePath = WzString(path + filename).toStdString();
+		std::replace(cachePath.begin(), cachePath.end(), '/', '_');
+		cachePath = IMD_CACHE_DIR "/" + cachePath + ".bin";
+		auto result = _imd_cache_load(cachePath, sourceHash, filename, skipGPUupload);
+		if (result == nullptr)
+		{
+			// The cache includes the GPU data, so it can only be written when that was generated
+			IMDCacheWriter cache = _imd_cache_begin(sourceHash);
+			const char *pFileDataPt = pFileData;
+			result = iV_ProcessIMD(filename, (const char **)&pFileDataPt, fileEnd, skipGPUupload, (skipGPUupload) ? nullptr : &cache);
+			if (result != nullptr && !skipGPUupload)
+			{
+				_imd_cache_save(cachePath, cache);
+			}
+		}
 		free(pFileData);
 		return result;
 	}
@@ -1126,6 +1257,276 @@ static std::vector<gfx_api::gfxFloat> bitangents;
 static std::vector<uint16_t> indices; // size is npolys * 3 * numFrames
 static uint16_t vertexCount = 0;
 
+static void _imd_upload_level_buffers(iIMDShape &s, const WzString &filename, const std::string &key)
+{
+	if (!tangents.empty())
+	{
+		if (!s.buffers[VBO_TANGENT])
+			s.buffers[VBO_TANGENT] = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer, gfx_api::context::buffer_storage_hint::static_draw, "tangent buffer");
+		s.buffers[VBO_TANGENT]->upload(tangents.size() * sizeof(gfx_api::gfxFloat), tangents.data());
+	}
+
+	if (!s.buffers[VBO_VERTEX])
+		s.buffers[VBO_VERTEX] = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer, gfx_api::context::buffer_storage_hint::static_draw, "vertex buffer");
+	if (vertices.empty())
+	{
+		debug(LOG_ERROR, "_imd_load_level: file corrupt? - no vertices?: %s (key: %s)", filename.toUtf8().c_str(), key.c_str());
+	}
+	s.buffers[VBO_VERTEX]->upload(vertices.size() * sizeof(gfx_api::gfxFloat), vertices.data());
+
+	if (!s.buffers[VBO_NORMAL])
+		s.buffers[VBO_NORMAL] = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer, gfx_api::context::buffer_storage_hint::static_draw, "normals buffer");
+	if (normals.empty())
+	{
+		debug(LOG_ERROR, "_imd_load_level: file corrupt? - no normals?: %s (key: %s)", filename.toUtf8().c_str(), key.c_str());
+	}
+	s.buffers[VBO_NORMAL]->upload(normals.size() * sizeof(gfx_api::gfxFloat), normals.data());
+
+	if (!s.buffers[VBO_INDEX])
+		s.buffers[VBO_INDEX] = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::index_buffer, gfx_api::context::buffer_storage_hint::static_draw, "index buffer");
+	if (indices.empty())
+	{
+		debug(LOG_ERROR, "_imd_load_level: file corrupt? - no indices?: %s (key: %s)", filename.toUtf8().c_str(), key.c_str());
+	}
+	s.buffers[VBO_INDEX]->upload(indices.size() * sizeof(uint16_t), indices.data());
+
+	if (!s.buffers[VBO_TEXCOORD])
+		s.buffers[VBO_TEXCOORD] = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer, gfx_api::context::buffer_storage_hint::static_draw, "tex coords buffer");
+	if (texcoords.empty())
+	{
+		debug(LOG_ERROR, "_imd_load_level: file corrupt? - no texcoords?: %s (key: %s)", filename.toUtf8().c_str(), key.c_str());
+	}
+	s.buffers[VBO_TEXCOORD]->upload(texcoords.size() * sizeof(gfx_api::gfxFloat), texcoords.data());
+}
+
+static void _imd_clear_level_buffers()
+{
+	indices.resize(0);
+	vertices.resize(0);
+	texcoords.resize(0);
+	normals.resize(0);
+	tangents.resize(0);
+	bitangents.resize(0);
+}
+
+static void _imd_cache_write_polys(IMDCacheWriter &cache, const std::vector<iIMDPoly> &polys)
+{
+	cache.writeValue<uint32_t>(static_cast<uint32_t>(polys.size()));
+	for (const iIMDPoly &poly : polys)
+	{
+		cache.writeVector(poly.texCoord);
+		cache.writeValue(poly.texAnim);
+		cache.writeValue(poly.flags);
+		cache.writeValue(poly.zcentre);
+		cache.writeValue(poly.normal);
+		cache.writeValue(poly.pindex);
+	}
+}
+
+static bool _imd_cache_read_polys(IMDCacheReader &cache, std::vector<iIMDPoly> &polys, size_t npoints)
+{
+	uint32_t npolys = 0;
+	// Check there is enough data left for that many polygons, before allocating them
+	if (!cache.readValue(npolys) || npolys > cache.remaining() / (sizeof(uint32_t) + sizeof(iIMDPoly::pindex)))
+	{
+		return false;
+	}
+	polys.resize(npolys);
+	for (iIMDPoly &poly : polys)
+	{
+		if (!cache.readVector(poly.texCoord) || !cache.readValue(poly.texAnim) || !cache.readValue(poly.flags)
+		    || !cache.readValue(poly.zcentre) || !cache.readValue(poly.normal) || !cache.readValue(poly.pindex))
+		{
+			return false;
+		}
+		if (poly.pindex[0] >= npoints || poly.pindex[1] >= npoints || poly.pindex[2] >= npoints)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Writes the GPU data generated for the current level or LOD
+static void _imd_cache_write_buffers(IMDCacheWriter &cache)
+{
+	cache.writeValue(vertexCount);
+	cache.writeVector(vertices);
+	cache.writeVector(normals);
+	cache.writeVector(texcoords);
+	cache.writeVector(tangents);
+	cache.writeVector(indices);
+}
+
+/// Reads the data written by _imd_cache_write_buffers into the level buffers, and checks that it fits together
+static bool _imd_cache_read_buffers(IMDCacheReader &cache)
+{
+	cache.readValue(vertexCount);
+	cache.readVector(vertices);
+	cache.readVector(normals);
+	cache.readVector(texcoords);
+	cache.readVector(tangents);
+	cache.readVector(indices);
+
+	const size_t numVertices = vertexCount;
+	return cache.ok()
+		&& vertices.size() == numVertices * 3 && normals.size() == numVertices * 3 && texcoords.size() == numVertices * 4
+		&& (tangents.empty() || tangents.size() == numVertices * 4) && indices.size() % 3 == 0
+		&& std::all_of(indices.begin(), indices.end(), [](uint16_t index) { return index < vertexCount; });
+}
+
+/// Must be called after the LOD's GPU data has been generated, and before it is cleared
+static void _imd_cache_write_lod(IMDCacheWriter &cache, const iIMDShape &lod)
+{
+	cache.writeValue<uint8_t>(1);  // another LOD follows, see _imd_cache_read_lods
+	cache.writeVector(lod.points);
+	_imd_cache_write_polys(cache, lod.polys);
+	_imd_cache_write_buffers(cache);
+}
+
+/// The cached counterpart of _imd_generate_lods
+static bool _imd_cache_read_lods(IMDCacheReader &cache, iIMDShape &s, const std::string &key, bool skipGPUData)
+{
+	uint8_t more = 0;
+	while (cache.readValue(more) && more != 0)
+	{
+		if (s.lods.size() >= IMD_MAX_LODS)
+		{
+			return false;
+		}
+		auto pLod = std::make_unique<iIMDShape>();
+		iIMDShape &lod = *pLod;
+		_imd_init_lod(lod, s);
+		cache.readVector(lod.points);
+		if (!_imd_cache_read_polys(cache, lod.polys, lod.points.size()))
+		{
+			return false;
+		}
+		const bool valid = _imd_cache_read_buffers(cache);
+		if (valid && !skipGPUData)
+		{
+			lod.vertexCount = vertexCount;
+			_imd_upload_level_buffers(lod, s.modelName, key);
+			s.lods.push_back(std::move(pLod));
+		}
+		_imd_clear_level_buffers();
+		if (!valid)
+		{
+			return false;
+		}
+	}
+	return cache.ok();
+}
+
+/// Must be called after the level's GPU data has been generated, and before it is cleared
+static void _imd_cache_write_level(IMDCacheWriter &cache, const iIMDShape &s)
+{
+	cache.writeValue(s.flags);
+	cache.writeValue(s.interpolate);
+	cache.writeValue(s.numFrames);
+	cache.writeValue(s.animInterval);
+	cache.writeValue(s.min);
+	cache.writeValue(s.max);
+	cache.writeValue(s.sradius);
+	cache.writeValue(s.radius);
+	cache.writeValue(s.ocen);
+	cache.writeVector(s.connectors);
+	cache.writeVector(s.points);
+	_imd_cache_write_polys(cache, s.polys);
+	cache.writeVector(s.altShadowPoints);
+	_imd_cache_write_polys(cache, s.altShadowPolys);
+	cache.writeVector(s.objanimdata);
+	cache.writeValue(s.objanimframes);
+	cache.writeValue(s.objanimtime);
+	cache.writeValue(s.objanimcycles);
+	for (const TilesetTextureFiles &files : s.tilesetTextureFiles)
+	{
+		cache.writeString(files.texfile);
+		cache.writeString(files.tcmaskfile);
+		cache.writeString(files.normalfile);
+		cache.writeString(files.specfile);
+	}
+	_imd_cache_write_buffers(cache);
+}
+
+/// The cached counterpart of _imd_load_level
+static std::unique_ptr<iIMDShape> _imd_cache_read_level(IMDCacheReader &cache, const WzString &filename, uint32_t level, bool skipGPUData)
+{
+	std::string key = filename.toStdString();
+	if (level > 0)
+	{
+		key += "_" + std::to_string(level);
+	}
+	ASSERT(models.count(key) == 0, "Duplicate model load for %s!", key.c_str());
+	auto pAllocatedShape = std::make_unique<iIMDShape>();
+	iIMDShape &s = *pAllocatedShape;
+	s.modelName = WzString::fromUtf8(key);
+	s.modelLevel = level;
+
+	// Reads after a failed one fail too, so only check once they are all done
+	cache.readValue(s.flags);
+	cache.readValue(s.interpolate);
+	cache.readValue(s.numFrames);
+	cache.readValue(s.animInterval);
+	cache.readValue(s.min);
+	cache.readValue(s.max);
+	cache.readValue(s.sradius);
+	cache.readValue(s.radius);
+	cache.readValue(s.ocen);
+	cache.readVector(s.connectors);
+	cache.readVector(s.points);
+	if (!_imd_cache_read_polys(cache, s.polys, s.points.size()))
+	{
+		return nullptr;
+	}
+	cache.readVector(s.altShadowPoints);
+	if (!_imd_cache_read_polys(cache, s.altShadowPolys, s.altShadowPoints.size()))
+	{
+		return nullptr;
+	}
+	cache.readVector(s.objanimdata);
+	cache.readValue(s.objanimframes);
+	cache.readValue(s.objanimtime);
+	cache.readValue(s.objanimcycles);
+	for (TilesetTextureFiles &files : s.tilesetTextureFiles)
+	{
+		cache.readString(files.texfile);
+		cache.readString(files.tcmaskfile);
+		cache.readString(files.normalfile);
+		cache.readString(files.specfile);
+	}
+	const bool valid = _imd_cache_read_buffers(cache);
+	if (valid && !skipGPUData)
+	{
+		s.vertexCount = vertexCount;
+		_imd_upload_level_buffers(s, filename, key);
+	}
+	_imd_clear_level_buffers();
+	if (!valid)
+	{
+		return nullptr;
+	}
+
+	if (!s.altShadowPolys.empty())
+	{
+		s.pShadowPoints = &s.altShadowPoints;
+		s.pShadowPolys = &s.altShadowPolys;
+	}
+	else
+	{
+		s.pShadowPoints = &s.points;
+		s.pShadowPolys = &s.polys;
+	}
+
+	// The LODs share the shadow data set up above
+	if (!_imd_cache_read_lods(cache, s, key, skipGPUData))
+	{
+		return nullptr;
+	}
+
+	return pAllocatedShape;
+}
+
 static bool ReadNormals(const char **ppFileData, const char *FileDataEnd, std::vector<Vector3f> &pie_level_normals, uint32_t num_normal_lines)
 {
 	const char *pFileData = *ppFileData;
@@ -1296,6 +1697,148 @@ void finishTangentsGeneration()
    }
 }
 
+/// Fills in the tangents of the vertices in the level buffers, which must have normals
+static void _imd_generate_tangents()
+{
+	tangents.resize(vertexCount * 4);
+	bitangents.resize(vertexCount * 3);
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+		calculateTangentsForTriangle(indices[i], indices[i+1], indices[i+2]);
+	finishTangentsGeneration();
+}
+
+// Resolution of the grid (cells along the longest side of the bounding box) each generated LOD is snapped to
+static const uint32_t lodGridSizes[IMD_MAX_LODS] = { 12, 6 };
+// Levels with fewer polygons aren't worth simplifying
+#define IMD_LOD_MIN_POLYS           48
+// A LOD is only kept if it has at most this fraction of the polygons of the mesh before it
+#define IMD_LOD_MAX_POLY_FRACTION   0.7f
+
+/// Simplifies a level by vertex clustering: points are snapped to a grid over the bounding box, the points in
+/// each cell are merged into their average, and triangles that collapse are dropped. Polygons keep their own
+/// texture coordinates, so the texture mostly stays where it was.
+static std::unique_ptr<iIMDShape> _imd_generate_lod(const iIMDShape &s, uint32_t gridSize)
+{
+	const Vector3f boundsMin(s.min);
+	const Vector3f boundsSize(s.max - s.min);
+	const float cellSize = std::max(std::max(boundsSize.x, boundsSize.y), std::max(boundsSize.z, 1.f)) / gridSize;
+
+	auto pLod = std::make_unique<iIMDShape>();
+	iIMDShape &lod = *pLod;
+	std::unordered_map<uint32_t, uint32_t> cellPoints;
+	std::vector<uint32_t> mergedPoint(s.points.size());
+	std::vector<uint32_t> mergedCount;
+	for (size_t i = 0; i < s.points.size(); ++i)
+	{
+		const glm::ivec3 cell = glm::clamp(glm::ivec3((s.points[i] - boundsMin) / cellSize), 0, static_cast<int>(gridSize));
+		const uint32_t key = (cell.x * (gridSize + 1) + cell.y) * (gridSize + 1) + cell.z;
+		auto it = cellPoints.emplace(key, static_cast<uint32_t>(lod.points.size()));
+		if (it.second)
+		{
+			lod.points.push_back(Vector3f(0.f, 0.f, 0.f));
+			mergedCount.push_back(0);
+		}
+		mergedPoint[i] = it.first->second;
+		lod.points[it.first->second] += s.points[i];
+		++mergedCount[it.first->second];
+	}
+	for (size_t i = 0; i < lod.points.size(); ++i)
+	{
+		lod.points[i] /= static_cast<float>(mergedCount[i]);
+	}
+
+	for (const iIMDPoly &poly : s.polys)
+	{
+		iIMDPoly merged = poly;
+		for (int j = 0; j < 3; ++j)
+		{
+			merged.pindex[j] = mergedPoint[poly.pindex[j]];
+		}
+		if (merged.pindex[0] == merged.pindex[1] || merged.pindex[1] == merged.pindex[2] || merged.pindex[2] == merged.pindex[0])
+		{
+			continue;  // collapsed
+		}
+		merged.normal = pie_SurfaceNormal3fv(lod.points[merged.pindex[0]], lod.points[merged.pindex[1]], lod.points[merged.pindex[2]]);
+		lod.polys.push_back(std::move(merged));
+	}
+
+	return pLod;
+}
+
+/// Copies what a LOD shares with its level
+static void _imd_init_lod(iIMDShape &lod, iIMDShape &s)
+{
+	lod.modelName = s.modelName;
+	lod.modelLevel = s.modelLevel;
+	lod.lodOf = &s;
+	lod.flags = s.flags;
+	lod.interpolate = s.interpolate;
+	lod.numFrames = s.numFrames;
+	lod.animInterval = s.animInterval;
+	lod.min = s.min;
+	lod.max = s.max;
+	lod.sradius = s.sradius;
+	lod.radius = s.radius;
+	lod.ocen = s.ocen;
+	// Shadows are always cast from the full level, the clustered mesh isn't closed. See InstancedMeshRenderer::Draw3DShape.
+	lod.pShadowPoints = s.pShadowPoints;
+	lod.pShadowPolys = s.pShadowPolys;
+}
+
+/// Fills in iIMDShape::lods, and uploads their buffers. Generates tangents if the level is normal mapped.
+/// Each LOD is added to the cache, if any, so must be called right after the level has been written to it.
+static void _imd_generate_lods(iIMDShape &s, bool withTangents, IMDCacheWriter *pCache)
+{
+	size_t previousPolys = s.polys.size();
+	if (previousPolys < IMD_LOD_MIN_POLYS)
+	{
+		if (pCache != nullptr)
+		{
+			pCache->writeValue<uint8_t>(0);  // no LODs
+		}
+		return;
+	}
+	std::vector<Vector3f> noNormals;  // weld vertices, the normals of the original mesh don't fit anymore anyway
+	for (uint32_t gridSize : lodGridSizes)
+	{
+		std::unique_ptr<iIMDShape> pLod = _imd_generate_lod(s, gridSize);
+		iIMDShape &lod = *pLod;
+		if (lod.polys.empty() || lod.polys.size() > previousPolys * IMD_LOD_MAX_POLY_FRACTION)
+		{
+			continue;
+		}
+		_imd_init_lod(lod, s);
+
+		vertexCount = 0;
+		for (size_t npol = 0; npol < lod.polys.size(); ++npol)
+		{
+			const iIMDPoly& p = lod.polys[npol];
+			indices.emplace_back(addVertex(lod, 0, &p, npol, noNormals));
+			indices.emplace_back(addVertex(lod, 1, &p, npol, noNormals));
+			indices.emplace_back(addVertex(lod, 2, &p, npol, noNormals));
+		}
+		lod.vertexCount = vertexCount;
+		if (withTangents)
+		{
+			_imd_generate_tangents();
+		}
+		_imd_upload_level_buffers(lod, s.modelName, s.modelName.toStdString());
+		if (pCache != nullptr)
+		{
+			_imd_cache_write_lod(*pCache, lod);
+		}
+		_imd_clear_level_buffers();
+
+		previousPolys = lod.polys.size();
+		s.lods.push_back(std::move(pLod));
+	}
+	if (pCache != nullptr)
+	{
+		pCache->writeValue<uint8_t>(0);  // no more LODs
+	}
+}
+
 /*!
  * Load shape levels recursively
  * \param ppFileData Pointer to the data (usually read from a file)
@@ -1306,7 +1849,7 @@ void finishTangentsGeneration()
  * \post s allocated
  */
 static_assert(PATH_MAX >= 255, "PATH_MAX is insufficient!");
-static std::unique_ptr<iIMDShape> _imd_load_level(const WzString &filename, const char **ppFileData, const char *FileDataEnd, int pieVersion, uint32_t level, const LevelSettings &globalLevelSettings, bool skipGPUData)
+static std::unique_ptr<iIMDShape> _imd_load_level(const WzString &filename, const char **ppFileData, const char *FileDataEnd, int pieVersion, uint32_t level, const LevelSettings &globalLevelSettings, bool skipGPUData, IMDCacheWriter *pCache)
 {
 	const char *pFileData = *ppFileData;
 	char buffer[PATH_MAX] = {'\0'}; uint32_t value = 0;
@@ -1590,61 +2133,12 @@ static std::unique_ptr<iIMDShape> _imd_load_level(const WzString &filename, cons
 		// Tangents are optional, only if normals were loaded and passed sanity check above
 		if (!pie_level_normals.empty())
 		{
-			tangents.resize(vertexCount * 4);
-			bitangents.resize(vertexCount * 3);
-
-			for (size_t i = 0; i < indices.size(); i += 3)
-				calculateTangentsForTriangle(indices[i], indices[i+1], indices[i+2]);
-			finishTangentsGeneration();
-
-			if (!tangents.empty())
-			{
-				if (!s.buffers[VBO_TANGENT])
-					s.buffers[VBO_TANGENT] = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer, gfx_api::context::buffer_storage_hint::static_draw, "tangent buffer");
-				s.buffers[VBO_TANGENT]->upload(tangents.size() * sizeof(gfx_api::gfxFloat), tangents.data());
-			}
-		}
-
-		if (!s.buffers[VBO_VERTEX])
-			s.buffers[VBO_VERTEX] = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer, gfx_api::context::buffer_storage_hint::static_draw, "vertex buffer");
-		if (vertices.empty())
-		{
-			debug(LOG_ERROR, "_imd_load_level: file corrupt? - no vertices?: %s (key: %s)", filename.toUtf8().c_str(), key.c_str());
+			_imd_generate_tangents();
 		}
-		s.buffers[VBO_VERTEX]->upload(vertices.size() * sizeof(gfx_api::gfxFloat), vertices.data());
 
-		if (!s.buffers[VBO_NORMAL])
-			s.buffers[VBO_NORMAL] = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer, gfx_api::context::buffer_storage_hint::static_draw, "normals buffer");
-		if (normals.empty())
-		{
-			debug(LOG_ERROR, "_imd_load_level: file corrupt? - no normals?: %s (key: %s)", filename.toUtf8().c_str(), key.c_str());
-		}
-		s.buffers[VBO_NORMAL]->upload(normals.size() * sizeof(gfx_api::gfxFloat), normals.data());
-
-		if (!s.buffers[VBO_INDEX])
-			s.buffers[VBO_INDEX] = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::index_buffer, gfx_api::context::buffer_storage_hint::static_draw, "index buffer");
-		if (indices.empty())
-		{
-			debug(LOG_ERROR, "_imd_load_level: file corrupt? - no indices?: %s (key: %s)", filename.toUtf8().c_str(), key.c_str());
-		}
-		s.buffers[VBO_INDEX]->upload(indices.size() * sizeof(uint16_t), indices.data());
-
-		if (!s.buffers[VBO_TEXCOORD])
-			s.buffers[VBO_TEXCOORD] = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer, gfx_api::context::buffer_storage_hint::static_draw, "tex coords buffer");
-		if (texcoords.empty())
-		{
-			debug(LOG_ERROR, "_imd_load_level: file corrupt? - no texcoords?: %s (key: %s)", filename.toUtf8().c_str(), key.c_str());
-		}
-		s.buffers[VBO_TEXCOORD]->upload(texcoords.size() * sizeof(gfx_api::gfxFloat), texcoords.data());
+		_imd_upload_level_buffers(s, filename, key);
 	}
 
-	indices.resize(0);
-	vertices.resize(0);
-	texcoords.resize(0);
-	normals.resize(0);
-	tangents.resize(0);
-	bitangents.resize(0);
-
 	*ppFileData = pFileData;
 
 	// decide which flags to use (local level override or global)
@@ -1656,6 +2150,18 @@ static std::unique_ptr<iIMDShape> _imd_load_level(const WzString &filename, cons
 
 	_imd_determine_tileset_texture_files(s, globalLevelSettings, levelSettings);
 
+	if (pCache != nullptr && !skipGPUData)
+	{
+		_imd_cache_write_level(*pCache, s);
+	}
+	_imd_clear_level_buffers();
+
+	if (!skipGPUData)
+	{
+		// Simplified meshes for drawing at a distance, normal mapped if the level is
+		_imd_generate_lods(s, !pie_level_normals.empty(), pCache);
+	}
+
 	return pAllocatedShape;
 }
 
@@ -1666,7 +2172,7 @@ static std::unique_ptr<iIMDShape> _imd_load_level(const WzString &filename, cons
  * \return The shape, constructed from the data read
  */
 // ppFileData is incremented to the end of the file on exit!
-static std::unique_ptr<iIMDShape> iV_ProcessIMD(const WzString &filename, const char **ppFileData, const char *FileDataEnd, bool skipGPUData)
+static std::unique_ptr<iIMDShape> iV_ProcessIMD(const WzString &filename, const char **ppFileData, const char *FileDataEnd, bool skipGPUData, IMDCacheWriter *pCache)
 {
 	const char *pFileData = *ppFileData;
 	char buffer[PATH_MAX] = {};
@@ -1675,6 +2181,7 @@ static std::unique_ptr<iIMDShape> iV_ProcessIMD(const WzString &filename, const
 	unsigned nlevels = 0;
 	int32_t imd_version;
 	iIMDBaseShape *objanimpie[ANIM_EVENT_COUNT];
+	std::array<std::string, ANIM_EVENT_COUNT> objanimpieNames;
 
 	IMD_Line lineToProcess;
 	if (!_imd_get_next_line(pFileData, FileDataEnd, lineToProcess) || sscanf(lineToProcess.lineContents.c_str(), "%255s %d", buffer, &imd_version) != 2)
@@ -1748,6 +2255,10 @@ static std::unique_ptr<iIMDShape> iV_ProcessIMD(const WzString &filename, const
 		}
 
 		objanimpie[value] = modelGet(animpie);
+		if (value < ANIM_EVENT_COUNT)
+		{
+			objanimpieNames[value] = animpie;
+		}
 
 		/* Try -yet again- to read in LEVELS directive */
 		if (!getNextPossibleCommandLine())
@@ -1764,6 +2275,15 @@ static std::unique_ptr<iIMDShape> iV_ProcessIMD(const WzString &filename, const
 	}
 	nlevels = value;
 
+	if (pCache != nullptr)
+	{
+		for (const std::string &name : objanimpieNames)
+		{
+			pCache->writeString(name);
+		}
+		pCache->writeValue<uint32_t>(nlevels);
+	}
+
 	std::unique_ptr<iIMDShape> firstLevel = nullptr;
 	iIMDShape *lastLevel = nullptr;
 	for (uint32_t level = 0; level < nlevels; ++level)
@@ -1785,7 +2305,7 @@ static std::unique_ptr<iIMDShape> iV_ProcessIMD(const WzString &filename, const
 			return nullptr;
 		}
 
-		std::unique_ptr<iIMDShape> shape = _imd_load_level(filename, &lineToProcess.pNextLineBegin, FileDataEnd, imd_version, level, globalLevelSettings, skipGPUData);
+		std::unique_ptr<iIMDShape> shape = _imd_load_level(filename, &lineToProcess.pNextLineBegin, FileDataEnd, imd_version, level, globalLevelSettings, skipGPUData, pCache);
 		if (shape == nullptr)
 		{
 			debug(LOG_ERROR, "%s: Unsuccessful loading level %" PRIu32, filename.toUtf8().c_str(), (level + 1));
@@ -1820,3 +2340,99 @@ static std::unique_ptr<iIMDShape> iV_ProcessIMD(const WzString &filename, const
 	*ppFileData = pFileData;
 	return firstLevel;
 }
+
+static IMDCacheWriter _imd_cache_begin(const Sha256 &sourceHash)
+{
+	IMDCacheWriter cache;
+	cache.writeValue<uint32_t>(IMD_CACHE_MAGIC);
+	cache.writeValue<uint32_t>(IMD_CACHE_VERSION);
+	cache.writeValue(sourceHash.bytes);
+	return cache;
+}
+
+/// The cached counterpart of iV_ProcessIMD. Returns nullptr if the cache doesn't belong to this version of the source.
+static std::unique_ptr<iIMDShape> _imd_cache_read_model(IMDCacheReader &cache, const Sha256 &sourceHash, const WzString &filename, bool skipGPUData)
+{
+	uint32_t magic = 0, version = 0;
+	Sha256 cachedHash;
+	cache.readValue(magic);
+	cache.readValue(version);
+	cache.readValue(cachedHash.bytes);
+	if (!cache.ok() || magic != IMD_CACHE_MAGIC || version != IMD_CACHE_VERSION || cachedHash != sourceHash)
+	{
+		return nullptr;
+	}
+
+	std::array<std::string, ANIM_EVENT_COUNT> objanimpieNames;
+	for (std::string &name : objanimpieNames)
+	{
+		cache.readString(name);
+	}
+	uint32_t nlevels = 0;
+	if (!cache.readValue(nlevels) || nlevels == 0)
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<iIMDShape> firstLevel = nullptr;
+	iIMDShape *lastLevel = nullptr;
+	for (uint32_t level = 0; level < nlevels; ++level)
+	{
+		std::unique_ptr<iIMDShape> shape = _imd_cache_read_level(cache, filename, level, skipGPUData);
+		if (shape == nullptr)
+		{
+			return nullptr;
+		}
+		if (lastLevel)
+		{
+			lastLevel->next = std::move(shape);
+			lastLevel = lastLevel->next.get();
+		}
+		else
+		{
+			firstLevel = std::move(shape);
+			lastLevel = firstLevel.get();
+		}
+	}
+
+	for (int i = 0; i < ANIM_EVENT_COUNT; i++)
+	{
+		firstLevel->objanimpie[i] = (objanimpieNames[i].empty()) ? nullptr : modelGet(WzString::fromUtf8(objanimpieNames[i]));
+	}
+
+	return firstLevel;
+}
+
+static std::unique_ptr<iIMDShape> _imd_cache_load(const std::string &cachePath, const Sha256 &sourceHash, const WzString &filename, bool skipGPUData)
+{
+	if (!PHYSFS_exists(cachePath.c_str()))
+	{
+		return nullptr;
+	}
+	char *pFileData = nullptr;
+	UDWORD size = 0;
+	if (!loadFile(cachePath.c_str(), &pFileData, &size, false))
+	{
+		return nullptr;
+	}
+	IMDCacheReader cache(pFileData, size);
+	auto result = _imd_cache_read_model(cache, sourceHash, filename, skipGPUData);
+	free(pFileData);
+	if (result == nullptr)
+	{
+		debug(LOG_3D, "%s: Cached model is out of date, reloading", filename.toUtf8().c_str());
+	}
+	return result;
+}
+
+static void _imd_cache_save(const std::string &cachePath, const IMDCacheWriter &cache)
+{
+	if (PHYSFS_getWriteDir() == nullptr)
+	{
+		return;
+	}
+	if (!saveFile(cachePath.c_str(), reinterpret_cast<const char *>(cache.data.data()), static_cast<UDWORD>(cache.data.size())))
+	{
+		debug(LOG_WARNING, "Failed to write model cache: %s", cachePath.c_str());
+	}
+}
@@ -164,6 +164,9 @@ struct TilesetTextureFiles
 	std::string specfile;
 };
 
+/// Most simplified meshes generated for each display level (see iIMDShape::lods)
+#define IMD_MAX_LODS 2
+
 // DISPLAY-ONLY
 // NOTE: Do *NOT* use any data from iIMDShape in game state calculations - instead, use the data in an iIMDBaseShape
 struct iIMDShape
@@ -186,8 +189,8 @@ struct iIMDShape
 	unsigned short numFrames = 0;
 	unsigned short animInterval = 0;
 
-	EDGE *shadowEdgeList = nullptr;
-	size_t nShadowEdges = 0;
+	/// Silhouette edges used by pie_STATIC_SHADOW, keyed by light direction bucket (see pie_DrawShadow)
+	std::unordered_map<uint32_t, std::vector<EDGE>> shadowEdgeLists;
 
 	// The old rendering data
 	std::vector<Vector3f> points; // NOTE: This is used to calculate some of the values above on imd load (in _imd_calc_bounds)
@@ -221,6 +224,11 @@ struct iIMDShape
 
 	std::unique_ptr<iIMDShape> next = nullptr;  // next pie in multilevel pies (NULL for non multilevel !)
 
+	/// Simplified meshes of this level, each coarser than the one before, drawn instead of it when it is small on screen.
+	/// They have their own buffers, but use the textures of the level they were made from.
+	std::vector<std::unique_ptr<iIMDShape>> lods;
+	iIMDShape *lodOf = nullptr;
+
 protected:
 	friend void modelUpdateTilesetIdx(size_t tilesetIdx);
 	void reloadTexturesIfLoaded();
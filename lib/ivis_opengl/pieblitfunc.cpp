@@ -586,6 +586,22 @@ void iV_DrawImageText(gfx_api::texture& TextureID, Vector2f Position, Vector2f o
 	iv_DrawImageImpl<gfx_api::DrawImageTextPSO>(TextureID, offset, size, Vector2f(0.f, 0.f), Vector2f(1.f, 1.f), colour, mvp, SHADER_TEXT);
 }
 
+void iV_DrawRenderTarget(gfx_api::render_target &target, float x, float y, float width, float height)
+{
+	glm::mat4 transformMat = defaultProjectionMatrix() * glm::translate(glm::vec3(x, y, 0.f)) * glm::scale(glm::vec3(width, height, 1.f));
+
+	gfx_api::DrawRenderTargetPSO::get().bind();
+	// The target's rows are stored bottom-up, so flip V
+	gfx_api::DrawRenderTargetPSO::get().bind_constants({ transformMat,
+		glm::vec2(0.f, 1.f),
+		glm::vec2(1.f, -1.f),
+		glm::vec4(1.f, 1.f, 1.f, 1.f), 0});
+	gfx_api::DrawRenderTargetPSO::get().bind_textures(target.color_texture());
+	gfx_api::DrawRenderTargetPSO::get().bind_vertex_buffers(pie_internal::rectBuffer);
+	gfx_api::DrawRenderTargetPSO::get().draw(4, 0);
+	gfx_api::DrawRenderTargetPSO::get().unbind_vertex_buffers(pie_internal::rectBuffer);
+}
+
 void iV_DrawImageTextClipped(gfx_api::texture& TextureID, Vector2i textureSize, Vector2f Position, Vector2f offset, Vector2f size, float angle, PIELIGHT colour, WzRect clippingRect)
 {
 	glm::mat4 mvp = defaultProjectionMatrix() * glm::translate(glm::vec3(Position.x, Position.y, 0)) * glm::rotate(RADIANS(angle), glm::vec3(0.f, 0.f, 1.f));
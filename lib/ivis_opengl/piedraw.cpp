@@ -42,6 +42,7 @@
 #include <string.h>
 #include <vector>
 #include <algorithm>
+#include <limits>
 #include <unordered_set>
 
 #include <glm/glm.hpp>
@@ -645,6 +646,26 @@ std::size_t hash_vec4(const glm::vec4& vec)
 	return h;
 }
 
+/// Light directions are snapped to steps of 1 / SHADOW_LIGHT_STEPS per component. Silhouettes and shadow
+/// volumes are then shared by every instance (and every frame) whose light falls into the same bucket.
+#define SHADOW_LIGHT_STEPS	64
+/// Most silhouettes kept per shape, so a long game of camera spinning doesn't grow them forever
+#define SHADOW_MAX_EDGE_LISTS	256
+
+static inline glm::vec4 shadowLightBucket(const glm::vec4 &light, uint32_t &bucket)
+{
+	// Keep the length, the shadow volume extrusion depends on it, but round it so instances of equal scale match exactly
+	const float length = std::round(glm::length(glm::vec3(light)));
+	if (length <= 0.f)
+	{
+		bucket = 0;
+		return glm::vec4(0.f, 0.f, 0.f, 0.f);
+	}
+	const glm::ivec3 steps = glm::ivec3(glm::round(glm::vec3(light) * (SHADOW_LIGHT_STEPS / length)));
+	bucket = (uint32_t)(steps.x + SHADOW_LIGHT_STEPS) << 16 | (uint32_t)(steps.y + SHADOW_LIGHT_STEPS) << 8 | (uint32_t)(steps.z + SHADOW_LIGHT_STEPS);
+	return glm::vec4(glm::vec3(steps) * (length / SHADOW_LIGHT_STEPS), 0.f);
+}
+
 struct ShadowDrawParameters {
 	int flag;
 	int flag_data;
@@ -802,26 +823,33 @@ enum DrawShadowResult {
 ///			glDisableVertexAttribArray(program.locVertex);
 ///			pie_DeactivateShader();
 ///		The only place this is currently called is pie_ShadowDrawLoop(), which handles this properly.
-static inline DrawShadowResult pie_DrawShadow(ShadowCache &shadowCache, iIMDShape *shape, int flag, int flag_data, const glm::vec4 &light, const glm::mat4 &modelViewMatrix)
+static inline DrawShadowResult pie_DrawShadow(ShadowCache &shadowCache, iIMDShape *shape, int flag, int flag_data, const glm::vec4 &exactLight, const glm::mat4 &modelViewMatrix)
 {
 	static std::vector<EDGE> edgelist;  // Static, to save allocations.
 	static std::vector<EDGE> edgelistFlipped;  // Static, to save allocations.
 	static std::vector<EDGE> edgelistFiltered;  // Static, to save allocations.
-	EDGE *drawlist = nullptr;
+	const EDGE *drawlist = nullptr;
 
 	size_t edge_count;
 	DrawShadowResult result;
 
+	// Snap the light to its direction bucket, so all instances facing roughly the same way share one silhouette
+	uint32_t lightBucket;
+	const glm::vec4 light = shadowLightBucket(exactLight, lightBucket);
+
 	// Find cached data (if available)
 	// Note: The modelViewMatrix is not used for calculating the sorted / filtered vertices, so it's not included
 	const ShadowCache::CachedShadowData *pCached = shadowCache.findCacheForShadowDraw(shape, flag, flag_data, light);
 	if (pCached == nullptr)
 	{
 		const Vector3f *pVertices = shape->pShadowPoints->data();
-		if (flag & pie_STATIC_SHADOW && shape->shadowEdgeList)
+		// Silhouettes of shapes that aren't squashed by their flags only depend on the light direction, so keep them with the shape
+		const bool storeEdges = (flag & pie_STATIC_SHADOW) && !(flag & (pie_RAISE | pie_HEIGHT_SCALED));
+		auto it_edges = storeEdges ? shape->shadowEdgeLists.find(lightBucket) : shape->shadowEdgeLists.end();
+		if (it_edges != shape->shadowEdgeLists.end())
 		{
-			drawlist = shape->shadowEdgeList;
-			edge_count = shape->nShadowEdges;
+			drawlist = it_edges->second.data();
+			edge_count = it_edges->second.size();
 		}
 		else
 		{
@@ -864,15 +892,14 @@ static inline DrawShadowResult pie_DrawShadow(ShadowCache &shadowCache, iIMDShap
 			drawlist = edgelistFiltered.data();
 			//debug(LOG_WARNING, "we have %i edges", edge_count);
 
-			if (flag & pie_STATIC_SHADOW)
+			if (storeEdges)
 			{
 				// then store it in the imd
-				shape->nShadowEdges = edge_count;
-				if (edge_count > 0)
+				if (shape->shadowEdgeLists.size() >= SHADOW_MAX_EDGE_LISTS)
 				{
-					shape->shadowEdgeList = (EDGE *)realloc(shape->shadowEdgeList, sizeof(EDGE) * shape->nShadowEdges);
-					std::copy(drawlist, drawlist + edge_count, shape->shadowEdgeList);
+					shape->shadowEdgeLists.clear();  // The camera has been spun all the way round, start over
 				}
+				shape->shadowEdgeLists.emplace(lightBucket, edgelistFiltered);
 			}
 		}
 
@@ -948,6 +975,8 @@ class InstancedMeshRenderer
 public:
 	// Queues a mesh for drawing
 	bool Draw3DShape(iIMDShape *shape, int frame, PIELIGHT teamcolour, PIELIGHT colour, int pieFlag, int pieFlagData, const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix, float stretchDepth);
+	// Queues many instances of the same mesh, with the same flags, for drawing
+	bool Draw3DShapes(iIMDShape *shape, PIELIGHT teamcolour, int pieFlag, const PIE_SHAPE_INSTANCE *instances, size_t count, const glm::mat4 &viewMatrix);
 
 	// Finalizes queued meshes, ready for one or more DrawAll calls
 	// (After this is called, Draw3DShape should not be called until the InstancedMeshRenderer is clear()-ed)
@@ -978,6 +1007,9 @@ public:
 		lightmapTexture = _lightmapTexture;
 		modelUVLightmapMatrix = _modelUVLightmapMatrix;
 	}
+private:
+	templatedState shapeState(iIMDShape *shape, int pieFlag) const;
+
 private:
 	bool useInstancedRendering = false;
 
@@ -1060,7 +1092,7 @@ void InstancedMeshRenderer::reset()
 	instanceDataBuffers.clear();
 }
 
-bool InstancedMeshRenderer::Draw3DShape(iIMDShape *shape, int frame, PIELIGHT teamcolour, PIELIGHT colour, int pieFlag, int pieFlagData, const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix, float stretchDepth)
+templatedState InstancedMeshRenderer::shapeState(iIMDShape *shape, int pieFlag) const
 {
 	bool light = true;
 
@@ -1087,9 +1119,14 @@ bool InstancedMeshRenderer::Draw3DShape(iIMDShape *shape, int frame, PIELIGHT te
 		light = true;
 	}
 
+	return templatedState((light) ? ((useInstancedRendering) ? SHADER_COMPONENT_INSTANCED : SHADER_COMPONENT) : ((useInstancedRendering) ? SHADER_NOLIGHT_INSTANCED : SHADER_NOLIGHT), shape, pieFlag);
+}
+
+bool InstancedMeshRenderer::Draw3DShape(iIMDShape *shape, int frame, PIELIGHT teamcolour, PIELIGHT colour, int pieFlag, int pieFlagData, const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix, float stretchDepth)
+{
 	frame %= std::max<int>(1, shape->numFrames);
 
-	templatedState currentState = templatedState((light) ? ((useInstancedRendering) ? SHADER_COMPONENT_INSTANCED : SHADER_COMPONENT) : ((useInstancedRendering) ? SHADER_NOLIGHT_INSTANCED : SHADER_NOLIGHT), shape, pieFlag);
+	templatedState currentState = shapeState(shape, pieFlag);
 
 	SHAPE tshape;
 	tshape.shape = shape;
@@ -1155,7 +1192,7 @@ bool InstancedMeshRenderer::Draw3DShape(iIMDShape *shape, int frame, PIELIGHT te
 				glm::mat4 invmat = glm::inverse(scshape.modelViewMatrix);
 
 				scshape.light = invmat * pos_light0;
-				scshape.shape = shape;
+				scshape.shape = (shape->lodOf != nullptr) ? shape->lodOf : shape;  // Cast from the full level, level of detail meshes aren't closed.
 				scshape.flag = pieFlag;
 				scshape.flag_data = pieFlagData;
 
@@ -1177,6 +1214,67 @@ bool InstancedMeshRenderer::Draw3DShape(iIMDShape *shape, int frame, PIELIGHT te
 	return true;
 }
 
+bool InstancedMeshRenderer::Draw3DShapes(iIMDShape *shape, PIELIGHT teamcolour, int pieFlag, const PIE_SHAPE_INSTANCE *instances, size_t count, const glm::mat4 &viewMatrix)
+{
+	const bool isAdditive = (pieFlag & (pie_ADDITIVE | pie_PREMULTIPLIED)) != 0;
+	const bool isTranslucent = !isAdditive && (pieFlag & pie_TRANSLUCENT);
+	const bool castsStencilShadow = !isAdditive && !isTranslucent && shadows && (pieFlag & (pie_SHADOW | pie_STATIC_SHADOW)) && (shadowMode == ShadowMode::Fallback_Stencil_Shadows);
+	if (castsStencilShadow || (pieFlag & (pie_HEIGHT_SCALED | pie_RAISE)))
+	{
+		// Needs per-instance work anyway
+		for (size_t i = 0; i < count; ++i)
+		{
+			Draw3DShape(shape, instances[i].frame, teamcolour, instances[i].colour, pieFlag, instances[i].pieFlagData, instances[i].modelMatrix, viewMatrix, 0.f);
+		}
+		return true;
+	}
+
+	// Look up the destination list once, instead of once per instance
+	std::vector<SHAPE> *pDestination;
+	if (useInstancedRendering)
+	{
+		templatedState currentState = shapeState(shape, pieFlag);
+		pDestination = (isAdditive) ? &instanceAdditiveMeshes[currentState] : (isTranslucent) ? &instanceTranslucentMeshes[currentState] : &instanceMeshes[currentState];
+	}
+	else
+	{
+		pDestination = (isAdditive || isTranslucent) ? &tshapes : &shapes;
+	}
+
+	const int numFrames = std::max<int>(1, shape->numFrames);
+
+	SHAPE tshape;
+	tshape.shape = shape;
+	tshape.teamcolour = teamcolour;
+	tshape.flag = pieFlag;
+	tshape.stretch = 0.f;
+
+	pDestination->reserve(pDestination->size() + count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		tshape.modelMatrix = instances[i].modelMatrix;
+		tshape.frame = instances[i].frame % numFrames;
+		tshape.colour = instances[i].colour;
+		tshape.flag_data = instances[i].pieFlagData;
+		pDestination->push_back(tshape);
+	}
+
+	if (isAdditive)
+	{
+		additiveInstancesCount += count;
+	}
+	else if (isTranslucent)
+	{
+		translucentInstancesCount += count;
+	}
+	else
+	{
+		instancesCount += count;
+	}
+
+	return true;
+}
+
 static InstancedMeshRenderer instancedMeshRenderer;
 
 void pie_InitializeInstancedRenderer()
@@ -1195,6 +1293,41 @@ void pie_CleanUp()
 	}
 }
 
+// Heights on screen (in pixels) of a model's bounding sphere, below which it is drawn with its first / second LOD mesh
+static const float lodPixelHeights[IMD_MAX_LODS] = { 80.f, 32.f };
+// Models smaller than this on screen don't cast stencil shadows. Shadow maps draw all shadow casters anyway.
+#define SHADOW_MIN_PIXEL_HEIGHT 12.f
+
+/// Roughly how many pixels high the shape's bounding sphere is on screen
+static float pie_ProjectedHeight(const iIMDShape *shape, const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix)
+{
+	const glm::vec3 centre = glm::vec3(viewMatrix * modelMatrix * glm::vec4(shape->ocen, 1.f));
+	const float radius = shape->radius * glm::length(glm::vec3(modelMatrix[0]));
+	const float distance = glm::length(centre);
+	if (distance <= radius)
+	{
+		return std::numeric_limits<float>::max();
+	}
+	return radius / distance * pie_PerspectiveGet()[1][1] * pie_GetVideoBufferHeight();
+}
+
+/// 0 for full detail, up to IMD_MAX_LODS for the coarsest mesh
+static inline size_t pie_LODIndex(float pixelHeight)
+{
+	size_t lod = 0;
+	while (lod < IMD_MAX_LODS && pixelHeight < lodPixelHeights[lod])
+	{
+		++lod;
+	}
+	return lod;
+}
+
+static inline iIMDShape *pie_LODShape(iIMDShape *shape, size_t lod)
+{
+	lod = std::min(lod, shape->lods.size());
+	return (lod == 0) ? shape : shape->lods[lod - 1].get();
+}
+
 bool pie_Draw3DShape(iIMDShape *shape, int frame, int team, PIELIGHT colour, int pieFlag, int pieFlagData, const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix, float stretchDepth, bool onlySingleLevel)
 {
 	pieCount++;
@@ -1206,6 +1339,18 @@ bool pie_Draw3DShape(iIMDShape *shape, int frame, int team, PIELIGHT colour, int
 	const bool drawAllLevels = (shape->modelLevel == 0) && !onlySingleLevel;
 	const PIELIGHT teamcolour = pal_GetTeamColour(team);
 
+	// Small on screen: draw simplified meshes, and don't bother with a stencil shadow
+	size_t lod = 0;
+	if (!(pieFlag & pie_BUTTON))
+	{
+		const float pixelHeight = pie_ProjectedHeight(shape, modelMatrix, viewMatrix);
+		lod = pie_LODIndex(pixelHeight);
+		if (pixelHeight < SHADOW_MIN_PIXEL_HEIGHT && shadowMode == ShadowMode::Fallback_Stencil_Shadows)
+		{
+			pieFlag &= ~(pie_SHADOW | pie_STATIC_SHADOW);
+		}
+	}
+
 	iIMDShape *pCurrShape = shape;
 	do
 	{
@@ -1216,7 +1361,7 @@ bool pie_Draw3DShape(iIMDShape *shape, int frame, int team, PIELIGHT colour, int
 		}
 		else
 		{
-			retVal = instancedMeshRenderer.Draw3DShape(pCurrShape, frame, teamcolour, colour, pieFlag, pieFlagData, modelMatrix, viewMatrix, stretchDepth);
+			retVal = instancedMeshRenderer.Draw3DShape(pie_LODShape(pCurrShape, lod), frame, teamcolour, colour, pieFlag, pieFlagData, modelMatrix, viewMatrix, stretchDepth);
 		}
 
 		pCurrShape = pCurrShape->next.get();
@@ -1226,6 +1371,53 @@ bool pie_Draw3DShape(iIMDShape *shape, int frame, int team, PIELIGHT colour, int
 	return retVal;
 }
 
+bool pie_Draw3DShapeInstances(iIMDShape *shape, int team, int pieFlag, const PIE_SHAPE_INSTANCE *instances, size_t count, const glm::mat4 &viewMatrix)
+{
+	if (count == 0)
+	{
+		return true;
+	}
+	pieCount += count;
+
+	ASSERT(team >= 0, "Negative team %d", team);
+	ASSERT_OR_RETURN(false, !(pieFlag & pie_BUTTON), "Buttons can't be drawn as instances");
+
+	bool retVal = true;
+	const bool drawAllLevels = (shape->modelLevel == 0);
+	const PIELIGHT teamcolour = pal_GetTeamColour(team);
+
+	// Group the instances by the mesh detail they get, and whether they still cast a stencil shadow (see pie_Draw3DShape)
+	const bool stencilShadows = (pieFlag & (pie_SHADOW | pie_STATIC_SHADOW)) && shadowMode == ShadowMode::Fallback_Stencil_Shadows;
+	static std::vector<PIE_SHAPE_INSTANCE> groups[IMD_MAX_LODS + 1][2];
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float pixelHeight = pie_ProjectedHeight(shape, instances[i].modelMatrix, viewMatrix);
+		groups[pie_LODIndex(pixelHeight)][!stencilShadows || pixelHeight >= SHADOW_MIN_PIXEL_HEIGHT].push_back(instances[i]);
+	}
+
+	for (size_t lod = 0; lod <= IMD_MAX_LODS; ++lod)
+	{
+		for (int castsShadow = 0; castsShadow < 2; ++castsShadow)
+		{
+			std::vector<PIE_SHAPE_INSTANCE> &group = groups[lod][castsShadow];
+			if (group.empty())
+			{
+				continue;
+			}
+			const int groupFlag = (castsShadow) ? pieFlag : (pieFlag & ~(pie_SHADOW | pie_STATIC_SHADOW));
+			iIMDShape *pCurrShape = shape;
+			do
+			{
+				retVal = instancedMeshRenderer.Draw3DShapes(pie_LODShape(pCurrShape, lod), teamcolour, groupFlag, group.data(), group.size(), viewMatrix) && retVal;
+				pCurrShape = pCurrShape->next.get();
+			} while (drawAllLevels && pCurrShape);
+			group.clear();
+		}
+	}
+
+	return retVal;
+}
+
 static void pie_ShadowDrawLoop(ShadowCache &shadowCache, const glm::mat4& projectionMatrix)
 {
 //	size_t cachedShadowDraws = 0;
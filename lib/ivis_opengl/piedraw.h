@@ -30,6 +30,22 @@ namespace gfx_api
 	struct texture; // forward-declare
 }
 
+struct iIMDShape;
+
+/// Per-instance parameters for pie_Draw3DShapeInstances()
+struct PIE_SHAPE_INSTANCE
+{
+	glm::mat4 modelMatrix;
+	PIELIGHT colour;
+	int frame;
+	int pieFlagData;
+};
+
+/// Draws count instances of the same shape, with the same team colour and flags. Cheaper than calling pie_Draw3DShape() for each.
+/// Instances are queued in the order given, within each level of detail. Alpha blended shapes which need drawing back to front
+/// should use pie_Draw3DShape() instead.
+bool pie_Draw3DShapeInstances(iIMDShape *shape, int team, int pieFlag, const PIE_SHAPE_INSTANCE *instances, size_t count, const glm::mat4 &viewMatrix);
+
 void pie_StartMeshes();
 void pie_UpdateLightmap(gfx_api::texture* lightmapTexture, const glm::mat4& modelUVLightmapMatrix);
 void pie_FinalizeMeshes(uint64_t currentGameFrame);
@@ -102,6 +102,7 @@ void pie_ScreenFrameRenderBegin()
 		return;
 	}
 	renderingFrame = true;
+	pie_TexStreamUpdate();
 	gfx_api::context::get().beginRenderPass();
 	if (screen_GetBackDrop())
 	{
@@ -20,6 +20,7 @@
 
 #include "lib/framework/frame.h"
 #include "lib/framework/frameresource.h"
+#include "lib/framework/physfs_ext.h"
 
 #include "lib/ivis_opengl/ivisdef.h"
 #include "lib/ivis_opengl/piestate.h"
@@ -27,9 +28,13 @@
 #include "lib/ivis_opengl/piepalette.h"
 #include "lib/ivis_opengl/png_util.h"
 
+#include "lib/framework/wzapp.h"
+
 #include "screen.h"
 
 #include <algorithm>
+#include <deque>
+#include <thread>
 #include <unordered_map>
 
 #if defined(__clang__)
@@ -57,6 +62,7 @@ struct iTexPage
 	std::string filename;
 	gfx_api::texture* id = nullptr;
 	gfx_api::texture_type textureType = gfx_api::texture_type::user_interface;
+	uint32_t streamTicket = 0;	///< Non-zero while a placeholder is bound and the real texture is being loaded in the background
 
 	iTexPage() = default;
 
@@ -66,6 +72,7 @@ struct iTexPage
 		id = input.id;
 		input.id = nullptr;
 		std::swap(textureType, input.textureType);
+		std::swap(streamTicket, input.streamTicket);
 	}
 
 	~iTexPage()
@@ -122,6 +129,7 @@ static size_t pie_AddTexPage_Impl(gfx_api::texture *pTexture, const char *filena
 		delete _TEX_PAGE[page].id;
 	_TEX_PAGE[page].id = pTexture;
 	_TEX_PAGE[page].textureType = textureType;
+	_TEX_PAGE[page].streamTicket = 0;	// Drop any background load still in flight for this page
 
 	/* Send back the texpage number so we can store it in the IMD */
 	return page;
@@ -184,6 +192,245 @@ gfx_api::texture* loadTextureHandleGraphicsOverrides(const char *filename, gfx_a
 	return pTexture;
 }
 
+// MARK: - Texture streaming
+
+#define TEX_STREAM_MAX_THREADS		2
+#define TEX_STREAM_UPLOADS_PER_FRAME	8
+#define TEX_PLACEHOLDER_SIZE		4
+
+struct TexStreamJob
+{
+	size_t page;
+	uint32_t ticket;
+	std::string filename;
+	gfx_api::texture_type textureType;
+	int maxWidth;
+	int maxHeight;
+	std::unique_ptr<gfx_api::prepared_texture> result;
+};
+
+static std::vector<WZ_THREAD *> texStreamThreads;
+static WZ_MUTEX         *texStreamMutex = nullptr;
+static WZ_SEMAPHORE     *texStreamSemaphore = nullptr;  ///< Posted once per queued job, and once per thread to quit
+static bool             texStreamQuit = false;
+static uint32_t         texStreamNextTicket = 0;
+
+// Protected by texStreamMutex
+static std::deque<std::unique_ptr<TexStreamJob>> texStreamTodo;
+static std::deque<std::unique_ptr<TexStreamJob>> texStreamDone;
+
+/// Does the same as loadTextureHandleGraphicsOverrides, without touching the GPU
+static std::unique_ptr<gfx_api::prepared_texture> prepareTextureHandleGraphicsOverrides(const char *filename, gfx_api::texture_type textureType, int maxWidth, int maxHeight)
+{
+	std::string loadPath = WZ_CURRENT_GRAPHICS_OVERRIDES_PREFIX "/texpages/";
+	loadPath += filename;
+	auto prepared = gfx_api::prepareTextureFromFile(loadPath.c_str(), textureType, maxWidth, maxHeight, true);
+	if (!prepared)
+	{
+		loadPath = "texpages/";
+		loadPath += filename;
+		prepared = gfx_api::prepareTextureFromFile(loadPath.c_str(), textureType, maxWidth, maxHeight);
+	}
+	return prepared;
+}
+
+/** This runs in a separate thread */
+static int texStreamThreadFunc(void *)
+{
+	wzMutexLock(texStreamMutex);
+	while (!texStreamQuit)
+	{
+		if (texStreamTodo.empty())
+		{
+			wzMutexUnlock(texStreamMutex);
+			wzSemaphoreWait(texStreamSemaphore);  // Go to sleep until needed.
+			wzMutexLock(texStreamMutex);
+			continue;
+		}
+
+		std::unique_ptr<TexStreamJob> job = std::move(texStreamTodo.front());
+		texStreamTodo.pop_front();
+		wzMutexUnlock(texStreamMutex);
+
+		job->result = prepareTextureHandleGraphicsOverrides(job->filename.c_str(), job->textureType, job->maxWidth, job->maxHeight);
+
+		wzMutexLock(texStreamMutex);
+		texStreamDone.push_back(std::move(job));
+	}
+	wzMutexUnlock(texStreamMutex);
+	return 0;
+}
+
+static bool texStreamStart()
+{
+	if (!texStreamThreads.empty())
+	{
+		return true;
+	}
+	unsigned numThreads = std::min<unsigned>(std::thread::hardware_concurrency(), TEX_STREAM_MAX_THREADS + 1);
+	if (numThreads <= 1)
+	{
+		return false;  // Single core, or unknown. Load everything inline.
+	}
+	--numThreads;  // Leave a core for the main thread.
+
+	texStreamQuit = false;
+	texStreamMutex = wzMutexCreate();
+	texStreamSemaphore = wzSemaphoreCreate(0);
+	for (unsigned i = 0; i < numThreads; ++i)
+	{
+		WZ_THREAD *thread = wzThreadCreate(texStreamThreadFunc, nullptr, "wzTexStream");
+		wzThreadStart(thread);
+		texStreamThreads.push_back(thread);
+	}
+	return true;
+}
+
+static void texStreamShutdown()
+{
+	if (texStreamThreads.empty())
+	{
+		return;
+	}
+
+	// Signal the threads to quit, abandoning any jobs that haven't started yet
+	wzMutexLock(texStreamMutex);
+	texStreamQuit = true;
+	texStreamTodo.clear();
+	wzMutexUnlock(texStreamMutex);
+	for (size_t i = 0; i < texStreamThreads.size(); ++i)
+	{
+		wzSemaphorePost(texStreamSemaphore);  // Wake up thread.
+	}
+	for (WZ_THREAD *thread : texStreamThreads)
+	{
+		wzThreadJoin(thread);
+	}
+	texStreamThreads.clear();
+	texStreamDone.clear();
+
+	wzMutexDestroy(texStreamMutex);
+	texStreamMutex = nullptr;
+	wzSemaphoreDestroy(texStreamSemaphore);
+	texStreamSemaphore = nullptr;
+}
+
+/// A tiny flat texture that looks neutral for its texture type, bound while the real one loads
+static gfx_api::texture* pie_MakePlaceholderTexture(gfx_api::texture_type textureType, const char *filename)
+{
+	uint8_t value[4] = {128, 128, 128, 255};  // Grey
+	switch (textureType)
+	{
+		case gfx_api::texture_type::normal_map:
+			value[2] = 255;  // Flat
+			break;
+		case gfx_api::texture_type::alpha_mask:
+		case gfx_api::texture_type::specular_map:
+		case gfx_api::texture_type::height_map:
+			memset(value, 0, sizeof(value));  // No team colour, no shine
+			break;
+		default:
+			break;
+	}
+
+	iV_Image image;
+	ASSERT_OR_RETURN(nullptr, image.allocate(TEX_PLACEHOLDER_SIZE, TEX_PLACEHOLDER_SIZE, 4), "Failed to allocate placeholder image");
+	unsigned char *pixels = image.bmp_w();
+	for (size_t i = 0; i < TEX_PLACEHOLDER_SIZE * TEX_PLACEHOLDER_SIZE; ++i)
+	{
+		memcpy(pixels + i * 4, value, 4);
+	}
+	gfx_api::texture *pTexture = gfx_api::context::get().create_texture(1, TEX_PLACEHOLDER_SIZE, TEX_PLACEHOLDER_SIZE, image.pixel_format(), filename);
+	ASSERT_OR_RETURN(nullptr, pTexture != nullptr, "Failed to create placeholder texture");
+	pTexture->upload(0, image);
+	return pTexture;
+}
+
+/// Binds a placeholder to a new texture page, and queues the real texture to be loaded in the background
+static optional<size_t> pie_StreamTexture(const char *filename, gfx_api::texture_type textureType, int maxWidth, int maxHeight)
+{
+	gfx_api::texture *pPlaceholder = pie_MakePlaceholderTexture(textureType, filename);
+	if (!pPlaceholder)
+	{
+		return nullopt;
+	}
+	size_t page = pie_AddTexPage(pPlaceholder, filename, textureType);
+
+	auto job = std::make_unique<TexStreamJob>();
+	job->page = page;
+	if (++texStreamNextTicket == 0)
+	{
+		++texStreamNextTicket;  // 0 means "not streaming"
+	}
+	job->ticket = texStreamNextTicket;
+	job->filename = filename;
+	job->textureType = textureType;
+	job->maxWidth = maxWidth;
+	job->maxHeight = maxHeight;
+	_TEX_PAGE[page].streamTicket = job->ticket;
+
+	wzMutexLock(texStreamMutex);
+	texStreamTodo.push_back(std::move(job));
+	wzMutexUnlock(texStreamMutex);
+	wzSemaphorePost(texStreamSemaphore);
+	return page;
+}
+
+/// Whether iV_GetTexture may hand out a placeholder and load the texture in the background
+static bool pie_CanStreamTexture(const char *filename, gfx_api::texture_type textureType)
+{
+	if (textureType == gfx_api::texture_type::user_interface)
+	{
+		return false;  // The UI wants real images (and sizes) straight away
+	}
+	// Check the file is there and is a .png, so failures are still reported to the caller, and .ktx2 files take the direct path
+	for (const char *prefix : {WZ_CURRENT_GRAPHICS_OVERRIDES_PREFIX "/texpages/", "texpages/"})
+	{
+		WzString imageLoadFilename = gfx_api::imageLoadFilenameFromInputFilename(WzString::fromUtf8(std::string(prefix) + filename));
+		if (PHYSFS_exists(imageLoadFilename))
+		{
+			return imageLoadFilename.endsWith(".png") && texStreamStart();
+		}
+	}
+	return false;
+}
+
+void pie_TexStreamUpdate()
+{
+	if (texStreamThreads.empty())
+	{
+		return;
+	}
+
+	std::vector<std::unique_ptr<TexStreamJob>> finished;
+	wzMutexLock(texStreamMutex);
+	while (!texStreamDone.empty() && finished.size() < TEX_STREAM_UPLOADS_PER_FRAME)
+	{
+		finished.push_back(std::move(texStreamDone.front()));
+		texStreamDone.pop_front();
+	}
+	wzMutexUnlock(texStreamMutex);
+
+	for (auto &job : finished)
+	{
+		if (job->page >= _TEX_PAGE.size() || _TEX_PAGE[job->page].streamTicket != job->ticket)
+		{
+			continue;  // The page was replaced or unloaded meanwhile
+		}
+		_TEX_PAGE[job->page].streamTicket = 0;
+		if (!job->result)
+		{
+			debug(LOG_ERROR, "Failed to load %s", job->filename.c_str());
+			continue;  // Keep the placeholder
+		}
+		gfx_api::texture *pTexture = gfx_api::context::get().uploadPreparedTexture(*job->result);
+		if (pTexture)
+		{
+			pie_AssignTexture(job->page, pTexture);
+		}
+	}
+}
+
 /** Retrieve the texture number for a given texture resource.
  *
  *  @note We keep textures in a separate data structure _TEX_PAGE apart from the
@@ -208,6 +455,11 @@ optional<size_t> iV_GetTexture(const char *filename, gfx_api::texture_type textu
 		return it->second;
 	}
 
+	if (pie_CanStreamTexture(filename, textureType))
+	{
+		return pie_StreamTexture(filename, textureType, maxWidth, maxHeight);
+	}
+
 	gfx_api::texture *pTexture = loadTextureHandleGraphicsOverrides(filename, textureType, maxWidth, maxHeight);
 	if (!pTexture)
 	{
@@ -267,6 +519,7 @@ void pie_TexShutDown()
 {
 	// TODO, lazy deletions for faster loading of next level
 	debug(LOG_TEXTURE, "Cleaning out %u textures", static_cast<unsigned>(_TEX_PAGE.size()));
+	texStreamShutdown();
 	_TEX_PAGE.clear();
 	_NAME_TO_TEX_PAGE_MAP.clear();
 }
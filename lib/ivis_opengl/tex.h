@@ -58,6 +58,10 @@ std::string pie_MakeTexPageTCMaskName(const std::string& filename);
 
 bool debugReloadTexturesFromDisk(const std::unordered_set<size_t>& texPages);
 
+// Game textures requested through iV_GetTexture are decoded and compressed in the background, with a placeholder bound meanwhile
+// Uploads textures that have finished loading. Call once per frame.
+void pie_TexStreamUpdate();
+
 //*************************************************************************
 
 void pie_TexShutDown();
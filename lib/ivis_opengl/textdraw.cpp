@@ -375,83 +375,117 @@ namespace std {
 
 }
 
-struct FTCache
+struct FTRasterCacheKey
 {
-	FTCache()
-	: m_glyphCache(256, 16)
+	FTFace* face;
+	uint32_t codepoint;
+	Vector2i subpixeloffset64;
+
+	FTRasterCacheKey(FTFace& face, uint32_t codepoint, Vector2i subpixeloffset64)
+	: face(&face), codepoint(codepoint), subpixeloffset64(subpixeloffset64)
 	{ }
 
-	RasterizedGlyph get(FTFace& face, uint32_t codePoint, Vector2i subpixeloffset64)
+	bool operator==(const FTRasterCacheKey& other) const
 	{
-		FT_Glyph glyph = getGlyph(face, codePoint);
-		ASSERT_OR_RETURN({}, glyph != nullptr, "Failed to get glyph: %" PRIu32, codePoint);
+		return face == other.face && codepoint == other.codepoint && subpixeloffset64 == other.subpixeloffset64;
+	}
+};
 
-		FT_Vector delta;
-		delta.x = subpixeloffset64.x;
-		delta.y = subpixeloffset64.y;
+namespace std {
 
-		FT_Error error = FT_Glyph_To_Bitmap(&glyph, WZ_FT_RENDER_MODE, &delta, 0);
-		ASSERT_OR_RETURN({}, error == FT_Err_Ok, "Failed to render glyph: %" PRIu32, codePoint);
-		// After this point, glyph is actually a new FT_BitmapGlyph (which must be released when done)
+	template <>
+	struct hash<FTRasterCacheKey>
+	{
+		std::size_t operator()(const FTRasterCacheKey& k) const
+		{
+			// The subpixel offsets are in [-63, 63], so they fit in the low bits
+			return std::hash<FTFace*>()(k.face)
+				 ^ (std::hash<int>()(k.codepoint) << 1)
+				 ^ (std::hash<int>()(((k.subpixeloffset64.x & 0x7F) << 7) | (k.subpixeloffset64.y & 0x7F)) << 2);
+		}
+	};
 
-		FT_BitmapGlyph glyph_bitmap = (FT_BitmapGlyph)glyph;
-		FT_Bitmap ftBitmap = glyph_bitmap->bitmap;
+}
 
-		RasterizedGlyph g;
-		g.buffer.reset(new unsigned char[ftBitmap.pitch * ftBitmap.rows]);
-		if (ftBitmap.buffer != nullptr)
+// Rasterized glyphs are shared by every string that uses them, instead of being rendered again for each one
+#define FTCACHE_MAX_RASTERS	2048
+
+struct FTCache
+{
+	FTCache()
+	: m_glyphCache(256, 16)
+	, m_rasterCache(FTCACHE_MAX_RASTERS, FTCACHE_MAX_RASTERS / 8)
+	, m_emptyGlyph(std::make_shared<RasterizedGlyph>(RasterizedGlyph{nullptr, 0, 0, 0, 0, 0}))
+	{ }
+
+	std::shared_ptr<const RasterizedGlyph> get(FTFace& face, uint32_t codePoint, Vector2i subpixeloffset64)
+	{
+		const FTRasterCacheKey key(face, codePoint, subpixeloffset64);
+		std::shared_ptr<const RasterizedGlyph> cached;
+		if (m_rasterCache.tryGet(key, cached))
 		{
-			memcpy(g.buffer.get(), ftBitmap.buffer, ftBitmap.pitch * ftBitmap.rows);
+			return cached;
 		}
-		else
+		std::shared_ptr<const RasterizedGlyph> raster = rasterize(face, codePoint, subpixeloffset64);
+		if (raster)
 		{
-			ASSERT(ftBitmap.pitch == 0 || ftBitmap.rows == 0, "Glyph buffer missing (%d and %d)", ftBitmap.pitch, ftBitmap.rows);
+			m_rasterCache.insert(key, raster);
+			return raster;
 		}
-		g.width = ftBitmap.width / 3;
-		g.height = ftBitmap.rows;
-		g.bearing_x = glyph_bitmap->left;
-		g.bearing_y = glyph_bitmap->top;
-		g.pitch = ftBitmap.pitch;
-
-		FT_Done_Glyph(glyph);
-		return g;
+		return m_emptyGlyph;
 	}
 
 	GlyphMetrics getGlyphMetrics(FTFace& face, uint32_t codePoint, Vector2i subpixeloffset64)
+	{
+		// The raster is needed to draw the text anyway, and is cached, so take the metrics from it
+		std::shared_ptr<const RasterizedGlyph> glyph = get(face, codePoint, subpixeloffset64);
+		return GlyphMetrics {glyph->width, glyph->height, glyph->bearing_x, glyph->bearing_y};
+	}
+
+public:
+	void clear()
+	{
+		m_rasterCache.clear();
+		m_glyphCache.clear();
+	}
+
+private:
+	std::shared_ptr<RasterizedGlyph> rasterize(FTFace& face, uint32_t codePoint, Vector2i subpixeloffset64)
 	{
 		FT_Glyph glyph = getGlyph(face, codePoint);
-		ASSERT_OR_RETURN({}, glyph != nullptr, "Failed to get glyph: %" PRIu32, codePoint);
+		ASSERT_OR_RETURN(nullptr, glyph != nullptr, "Failed to get glyph: %" PRIu32, codePoint);
 
 		FT_Vector delta;
 		delta.x = subpixeloffset64.x;
 		delta.y = subpixeloffset64.y;
 
-		// FUTURE FIXME: Surely there is a better way of getting the metrics we need? ....
 		FT_Error error = FT_Glyph_To_Bitmap(&glyph, WZ_FT_RENDER_MODE, &delta, 0);
-		ASSERT_OR_RETURN({}, error == FT_Err_Ok, "Failed to render glyph: %" PRIu32, codePoint);
+		ASSERT_OR_RETURN(nullptr, error == FT_Err_Ok, "Failed to render glyph: %" PRIu32, codePoint);
 		// After this point, glyph is actually a new FT_BitmapGlyph (which must be released when done)
 
 		FT_BitmapGlyph glyph_bitmap = (FT_BitmapGlyph)glyph;
 		FT_Bitmap ftBitmap = glyph_bitmap->bitmap;
 
-		GlyphMetrics result {
-			ftBitmap.width / 3,
-			ftBitmap.rows,
-			glyph_bitmap->left, glyph_bitmap->top
-		};
+		std::shared_ptr<RasterizedGlyph> g = std::make_shared<RasterizedGlyph>();
+		g->buffer.reset(new unsigned char[ftBitmap.pitch * ftBitmap.rows]);
+		if (ftBitmap.buffer != nullptr)
+		{
+			memcpy(g->buffer.get(), ftBitmap.buffer, ftBitmap.pitch * ftBitmap.rows);
+		}
+		else
+		{
+			ASSERT(ftBitmap.pitch == 0 || ftBitmap.rows == 0, "Glyph buffer missing (%d and %d)", ftBitmap.pitch, ftBitmap.rows);
+		}
+		g->width = ftBitmap.width / 3;
+		g->height = ftBitmap.rows;
+		g->bearing_x = glyph_bitmap->left;
+		g->bearing_y = glyph_bitmap->top;
+		g->pitch = ftBitmap.pitch;
 
 		FT_Done_Glyph(glyph);
-
-		return result;
-	}
-
-public:
-	void clear()
-	{
-		m_glyphCache.clear();
+		return g;
 	}
 
-private:
 	// The glyph is owned by the cache - if transforms are needed, the caller should use FT_Glyph_Copy to make a copy and modify the copy!
 	FT_Glyph getGlyph(FTFace& face, uint32_t codepoint)
 	{
@@ -509,6 +543,8 @@ private:
 	};
 
 	lru11::Cache<FTGlyphCacheKey, WZOwnedFTGlyph> m_glyphCache;
+	lru11::Cache<FTRasterCacheKey, std::shared_ptr<const RasterizedGlyph>> m_rasterCache;
+	std::shared_ptr<const RasterizedGlyph> m_emptyGlyph; ///< Handed out when a glyph can't be rendered
 };
 
 static FTCache* glyphCache = nullptr;
@@ -620,6 +656,33 @@ struct DrawTextResult
 	TextLayoutMetrics layoutMetrics;
 };
 
+struct TextShapingCacheKey
+{
+	std::string text;
+	iV_fonts fontID;  ///< Also determines the size, and the caches are dropped when the scale changes
+
+	bool operator==(const TextShapingCacheKey& other) const
+	{
+		return fontID == other.fontID && text == other.text;
+	}
+};
+
+namespace std {
+
+	template <>
+	struct hash<TextShapingCacheKey>
+	{
+		std::size_t operator()(const TextShapingCacheKey& k) const
+		{
+			return std::hash<std::string>()(k.text)
+				 ^ (std::hash<int>()(k.fontID) << 1);
+		}
+	};
+
+}
+
+#define TEXT_SHAPING_CACHE_SIZE	1024
+
 // Note:
 // Technically glyph antialiasing is dependent of text rotation.
 // Rotated text needs to set transform inside freetype2.
@@ -643,17 +706,38 @@ struct TextShaper
 		int32_t y_advance = 0;
 	};
 
+	struct ShapedText
+	{
+		ShapingResult shaping;
+		optional<TextLayoutMetrics> metrics;  ///< Filled in the first time someone asks for them
+	};
+
 	TextShaper()
+	: m_shapingCache(TEXT_SHAPING_CACHE_SIZE, TEXT_SHAPING_CACHE_SIZE / 8)
 	{ }
 
 	~TextShaper()
 	{ }
 
+	// Must be called whenever the fonts are unloaded, the cached results point at their faces
+	void clearCache()
+	{
+		m_shapingCache.clear();
+	}
+
 	// Returns the text width and height *IN PIXELS*
 	TextLayoutMetrics getTextMetrics(const WzString& text, iV_fonts fontID)
 	{
-		const ShapingResult& shapingResult = shapeText(text, fontID);
+		std::shared_ptr<ShapedText> shapedText = getShapedText(text, fontID);
+		if (!shapedText->metrics.has_value())
+		{
+			shapedText->metrics = calculateTextMetrics(shapedText->shaping);
+		}
+		return shapedText->metrics.value();
+	}
 
+	TextLayoutMetrics calculateTextMetrics(const ShapingResult& shapingResult)
+	{
 		if (shapingResult.glyphes.empty())
 		{
 			return TextLayoutMetrics(shapingResult.x_advance / 64, shapingResult.y_advance / 64);
@@ -705,7 +789,8 @@ struct TextShaper
 	// Draws the text and returns the text buffer, width and height, etc *IN PIXELS*
 	DrawTextResult drawText(const WzString& text, iV_fonts fontID)
 	{
-		ShapingResult shapingResult = shapeText(text, fontID);
+		std::shared_ptr<ShapedText> shapedText = getShapedText(text, fontID);
+		const ShapingResult& shapingResult = shapedText->shaping;
 
 		if (shapingResult.glyphes.empty())
 		{
@@ -720,26 +805,28 @@ struct TextShaper
 		// build glyphes
 		struct glyphRaster
 		{
-			std::unique_ptr<unsigned char[]> buffer;
+			std::shared_ptr<const RasterizedGlyph> raster;
 			Vector2i pixelPosition;
 			Vector2i size;
 			uint32_t pitch;
 
-			glyphRaster(std::unique_ptr<unsigned char[]> &&b, Vector2i &&p, Vector2i &&s, uint32_t _pitch)
-				: buffer(std::move(b)), pixelPosition(p), size(s), pitch(_pitch) {}
+			glyphRaster(std::shared_ptr<const RasterizedGlyph> &&r, Vector2i &&p, Vector2i &&s, uint32_t _pitch)
+				: raster(std::move(r)), pixelPosition(p), size(s), pitch(_pitch) {}
 		};
 
 		std::vector<glyphRaster> glyphs;
 		std::transform(shapingResult.glyphes.begin(), shapingResult.glyphes.end(), std::back_inserter(glyphs),
 			[&] (const HarfbuzzPosition &g) {
-			RasterizedGlyph glyph = glyphCache->get(g.face, g.codepoint, g.penPosition % 64);
-			int32_t x0 = g.penPosition.x / 64 + glyph.bearing_x;
-			int32_t y0 = g.penPosition.y / 64 - glyph.bearing_y;
+			std::shared_ptr<const RasterizedGlyph> glyph = glyphCache->get(g.face, g.codepoint, g.penPosition % 64);
+			int32_t x0 = g.penPosition.x / 64 + glyph->bearing_x;
+			int32_t y0 = g.penPosition.y / 64 - glyph->bearing_y;
 			min_x = std::min(x0, min_x);
-			max_x = std::max(static_cast<int32_t>(x0 + glyph.width), max_x);
+			max_x = std::max(static_cast<int32_t>(x0 + glyph->width), max_x);
 			min_y = std::min(y0, min_y);
-			max_y = std::max(static_cast<int32_t>(y0 + glyph.height), max_y);
-			return glyphRaster(std::move(glyph.buffer), Vector2i(x0, y0), Vector2i(glyph.width, glyph.height), glyph.pitch);
+			max_y = std::max(static_cast<int32_t>(y0 + glyph->height), max_y);
+			const uint32_t pitch = glyph->pitch;
+			Vector2i size(glyph->width, glyph->height);
+			return glyphRaster(std::move(glyph), Vector2i(x0, y0), std::move(size), pitch);
 			});
 
 		const uint32_t texture_width = max_x - min_x + 1;
@@ -771,7 +858,7 @@ struct TextShaper
 						uint32_t j0 = g.pixelPosition.x - min_x;
 						const auto srcBufferPos = i * g.pitch + 3 * j;
 						ASSERT(srcBufferPos + 2 < glyphBufferSize, "Invalid source (%" PRIu32" / %" PRIu32") reading glyph %zu for string \"%s\"; (%d, %d, %d, %d, %" PRIu32 ", %d, %d, %d, %" PRIu32 ", %" PRIu32 ")", srcBufferPos, glyphBufferSize, glyphNum, text.toUtf8().c_str(), i, g.size.y, g.pixelPosition.y, min_y, i0, j, g.pixelPosition.x, min_x, j0, g.pitch);
-						uint8_t const *src = &g.buffer[srcBufferPos];
+						uint8_t const *src = &g.raster->buffer[srcBufferPos];
 						const auto stringTexturePos = 4 * ((i0 + i) * texture_width + j + j0);
 						ASSERT(stringTexturePos + 3 < stringTextureSize, "Invalid destination (%" PRIu32" / %zu) writing glyph %zu for string \"%s\"; (%d, %d, %d, %d, %" PRIu32 ", %d, %d, %d, %" PRIu32 ", %" PRIu32 ")", stringTexturePos, stringTextureSize, glyphNum, text.toUtf8().c_str(), i, g.size.y, g.pixelPosition.y, min_y, i0, j, g.pixelPosition.x, min_x, j0, texture_width);
 						uint8_t *dst = &stringTexture[stringTexturePos];
@@ -790,6 +877,21 @@ struct TextShaper
 		);
 	}
 
+	// Shaping is by far the most expensive part of measuring text, and the same strings get measured every frame
+	std::shared_ptr<ShapedText> getShapedText(const WzString& text, iV_fonts fontID)
+	{
+		TextShapingCacheKey key {text.toUtf8(), fontID};
+		std::shared_ptr<ShapedText> shapedText;
+		if (m_shapingCache.tryGet(key, shapedText))
+		{
+			return shapedText;
+		}
+		shapedText = std::make_shared<ShapedText>();
+		shapedText->shaping = shapeText(text, fontID);
+		m_shapingCache.insert(key, shapedText);
+		return shapedText;
+	}
+
 	ShapingResult shapeText(const WzString& text, iV_fonts fontID)
 	{
 		/* Fribidi assumes that the text is encoded in UTF-32, so we have to
@@ -992,6 +1094,9 @@ struct TextShaper
 		run.glyphInfos = hb_buffer_get_glyph_infos(run.buffer, &run.glyphCount);
 		run.glyphPositions = hb_buffer_get_glyph_positions(run.buffer, &run.glyphCount);
 	}
+
+private:
+	lru11::Cache<TextShapingCacheKey, std::shared_ptr<ShapedText>> m_shapingCache;
 };
 
 /***************************************************************************/
@@ -1220,6 +1325,7 @@ void iV_TextInit(unsigned int horizScalePercentage, unsigned int vertScalePercen
 
 void iV_TextShutdown()
 {
+	getShaper().clearCache();
 	glyphCache->clear();
 	delete glyphCache;
 	glyphCache = nullptr;
@@ -287,12 +287,14 @@ struct TmpSocketInfo
 		char name[64] = {'\0'};
 		uint8_t playerType = 0;
 		EcKey identity;
+		uint32_t compressionDictionaryId = 0;  ///< 0 if the client doesn't support a compression dictionary
 
 		void reset()
 		{
 			name[0] = '\0';
 			playerType = 0;
 			identity.clear();
+			compressionDictionaryId = 0;
 		}
 	};
 	ReceivedJoinInfo receivedJoinInfo;
@@ -1609,6 +1611,51 @@ void NETdiscoverUPnPDevices()
 
 // ////////////////////////////////////////////////////////////////////////
 // setup stuff
+/// Builds the preset dictionary for the compressed connections, from the framing of the messages sent most often: every player
+/// sharing a game queue with a GAME_GAME_TIME message in it, each game tick. zlib favours the end of the dictionary, so the most
+/// common bytes go last. Joining peers compare its checksum, and only switch to it if both have the same dictionary.
+static std::vector<uint8_t> NETbuildCompressionDictionary()
+{
+	auto appendUint32 = [](std::vector<uint8_t> &data, uint32_t v) {
+		bool moreBytes = true;
+		for (unsigned n = 0; moreBytes; ++n)
+		{
+			uint8_t b;
+			moreBytes = encode_uint32_t(b, v, n);
+			data.push_back(b);
+		}
+	};
+	auto appendUint16 = [](std::vector<uint8_t> &data, uint16_t v) {
+		data.push_back(uint8_t(v >> 8));
+		data.push_back(uint8_t(v));
+	};
+
+	std::vector<uint8_t> dictionary;
+	for (uint32_t tick = 1; tick <= 4; ++tick)
+	{
+		for (uint8_t player = 0; player < MAX_PLAYERS; ++player)
+		{
+			// See sendPlayerGameTime().
+			NetMessage gameTime(GAME_GAME_TIME);
+			appendUint32(gameTime.data, 2);  // latencyTicks
+			appendUint32(gameTime.data, tick * GAME_TICKS_PER_UPDATE);  // checkTime
+			appendUint16(gameTime.data, 0);  // checkCrc
+			appendUint16(gameTime.data, 0);  // wantedLatency
+
+			// See NETflushGameQueues().
+			NetMessage share(NET_SHARE_GAME_QUEUE);
+			share.data.push_back(player);
+			appendUint32(share.data, 1);
+			share.data.push_back(gameTime.type);
+			appendUint32(share.data, static_cast<uint32_t>(gameTime.data.size()));
+			share.data.insert(share.data.end(), gameTime.data.begin(), gameTime.data.end());
+
+			share.rawDataAppendToVector(dictionary);
+		}
+	}
+	return dictionary;
+}
+
 int NETinit(bool bFirstCall)
 {
 	debug(LOG_NET, "NETinit");
@@ -1617,6 +1664,7 @@ int NETinit(bool bFirstCall)
 	NET_InitPlayers(true, true);
 
 	SOCKETinit();
+	socketSetCompressionDictionary(NETbuildCompressionDictionary());
 
 	if (bFirstCall)
 	{
@@ -1813,6 +1861,24 @@ void NETsendProcessDelayedActions()
 	NETplayerClientsDisconnect(pendingDisconnectPlayers);
 }
 
+/// Chat and file transfers may wait while a connection is busy, everything else is sent straight away.
+/// Messages of the same class keep their order, but a NET_TEXTMSG or NET_FILE_PAYLOAD may now arrive after lobby and game
+/// messages which were sent later, and chat and file payloads may overtake each other. So a chat message sent just before
+/// NET_KICK or NET_FIREUP can arrive after it, and the last chunks of a map download can arrive after lobby messages the host
+/// sent once the download was queued. They can never arrive earlier than game messages sent before them.
+static SocketTrafficClass NETtrafficClass(uint8_t type)
+{
+	switch (type)
+	{
+	case NET_TEXTMSG:
+		return SOCKET_TRAFFIC_CHAT;
+	case NET_FILE_PAYLOAD:
+		return SOCKET_TRAFFIC_BULK;
+	default:
+		return SOCKET_TRAFFIC_GAME;
+	}
+}
+
 // ////////////////////////////////////////////////////////////////////////
 // Send a message to a player, option to guarantee message
 bool NETsend(NETQUEUE queue, NetMessage const *message)
@@ -1845,6 +1911,11 @@ bool NETsend(NETQUEUE queue, NetMessage const *message)
 		ASSERT_OR_RETURN(false, false, "Wrong queue type.");
 	}
 
+	// Serialised once, and shared by every recipient of a broadcast. writeAll() copies or compresses the data before returning.
+	static std::vector<uint8_t> rawData;  // Static, to save allocations.
+	rawData.clear();
+	const SocketTrafficClass trafficClass = NETtrafficClass(message->type);
+
 	if (NetPlay.isHost)
 	{
 		int firstPlayer = player == NET_ALL_PLAYERS ? 0                         : player;
@@ -1854,16 +1925,13 @@ bool NETsend(NETQUEUE queue, NetMessage const *message)
 			// We are the host, send directly to player.
 			if (sockets[player] != nullptr && player != queue.exclude)
 			{
-				uint8_t *rawData = message->rawDataDup();
-				if (!rawData)
+				if (rawData.empty())
 				{
-					debug(LOG_FATAL, "Failed to allocate raw data (message type: %" PRIu8 ", player: %d)", message->type, player);
-					abort();
+					message->rawDataAppendToVector(rawData);
 				}
-				ssize_t rawLen   = message->rawLen();
+				ssize_t rawLen   = rawData.size();
 				size_t compressedRawLen;
-				result = writeAll(sockets[player], rawData, rawLen, &compressedRawLen);
-				delete[] rawData;  // Done with the data.
+				result = writeAll(sockets[player], rawData.data(), rawLen, &compressedRawLen, trafficClass);
 
 				if (result == rawLen)
 				{
@@ -1874,7 +1942,7 @@ bool NETsend(NETQUEUE queue, NetMessage const *message)
 				else if (result == SOCKET_ERROR)
 				{
 					// Write error, most likely client disconnect.
-					debug(LOG_ERROR, "Failed to send message (type: %" PRIu8 ", rawLen: %zu, compressedRawLen: %zu) to %" PRIu8 ": %s", message->type, message->rawLen(), compressedRawLen, player, strSockError(getSockErr()));
+					debug(LOG_ERROR, "Failed to send message (type: %" PRIu8 ", rawLen: %zu, compressedRawLen: %zu) to %" PRIu8 ": %s", message->type, rawData.size(), compressedRawLen, player, strSockError(getSockErr()));
 					if (!isTmpQueue)
 					{
 						netSendPendingDisconnectPlayerIndexes.insert(player);
@@ -1889,11 +1957,10 @@ bool NETsend(NETQUEUE queue, NetMessage const *message)
 		// We are a client, send directly to player, who happens to be the host.
 		if (bsocket)
 		{
-			uint8_t *rawData = message->rawDataDup();
-			ssize_t rawLen   = message->rawLen();
+			message->rawDataAppendToVector(rawData);
+			ssize_t rawLen   = rawData.size();
 			size_t compressedRawLen;
-			result = writeAll(bsocket, rawData, rawLen, &compressedRawLen);
-			delete[] rawData;  // Done with the data.
+			result = writeAll(bsocket, rawData.data(), rawLen, &compressedRawLen, trafficClass);
 
 			if (result == rawLen)
 			{
@@ -4150,6 +4217,7 @@ static void NETallowJoining()
 					EcKey::Key pkey;
 					EcKey identity;
 					EcKey::Sig challengeResponse;
+					uint32_t compressionDictionaryId = 0;
 
 					NETbeginDecode(NETnetTmpQueue(i), NET_JOIN);
 					NETstring(name, sizeof(name));
@@ -4158,6 +4226,7 @@ static void NETallowJoining()
 					NETuint8_t(&playerType);
 					NETbytes(&pkey);
 					NETbytes(&challengeResponse);
+					NETuint32_t(&compressionDictionaryId);  // Not sent by older clients, which leaves it 0.
 					NETend();
 
 					// verify signature that player is joining with, reject him if he can not do that
@@ -4182,6 +4251,7 @@ static void NETallowJoining()
 					sstrcpy(tmp_connectState[i].receivedJoinInfo.name, name);
 					tmp_connectState[i].receivedJoinInfo.playerType = playerType;
 					tmp_connectState[i].receivedJoinInfo.identity = identity;
+					tmp_connectState[i].receivedJoinInfo.compressionDictionaryId = compressionDictionaryId;
 
 					auto& joinRequestInfo = tmp_connectState[i].receivedJoinInfo;
 
@@ -4392,10 +4462,22 @@ static void NETallowJoining()
 			// Copy player's IP address.
 			sstrcpy(NetPlay.players[index].IPtextAddress, getSocketTextAddress(connected_bsocket[index]));
 
+			// Both ends switch to the compression dictionary after NET_ACCEPTED, if they have the same one.
+			uint32_t compressionDictionaryId = socketCompressionDictionaryId();
+			if (joinRequestInfo.compressionDictionaryId != compressionDictionaryId)
+			{
+				compressionDictionaryId = 0;
+			}
+
 			NETbeginEncode(NETnetQueue(index), NET_ACCEPTED);
 			NETuint8_t(&index);
 			NETuint32_t(&NetPlay.hostPlayer);
+			NETuint32_t(&compressionDictionaryId);
 			NETend();
+			if (compressionDictionaryId != 0 && connected_bsocket[index] != nullptr)
+			{
+				socketUseCompressionDictionary(connected_bsocket[index]);
+			}
 
 			// First send info about players to newcomer.
 			NETSendAllPlayerInfoTo(index);
@@ -4993,6 +5075,7 @@ bool NETjoinGame(const char *host, uint32_t port, const char *playername, const
 		{
 			// :)
 			uint8_t index;
+			uint32_t compressionDictionaryId = 0;
 
 			NetPlay.hostPlayer = MAX_CONNECTED_PLAYERS + 1; // invalid host index
 
@@ -5000,9 +5083,16 @@ bool NETjoinGame(const char *host, uint32_t port, const char *playername, const
 			// Retrieve the player ID the game host arranged for us
 			NETuint8_t(&index);
 			NETuint32_t(&NetPlay.hostPlayer); // and the host player idx
+			NETuint32_t(&compressionDictionaryId);  // Not sent by older hosts, which leaves it 0.
 			NETend();
 			NETpop(queue);
 
+			if (compressionDictionaryId != 0 && compressionDictionaryId == socketCompressionDictionaryId() && bsocket != nullptr)
+			{
+				// The host switched to the dictionary after NET_ACCEPTED, so switch too.
+				socketUseCompressionDictionary(bsocket);
+			}
+
 			if (NetPlay.hostPlayer >= MAX_CONNECTED_PLAYERS)
 			{
 				debug(LOG_ERROR, "Bad host player number (%" PRIu32 ") received from host!", NetPlay.hostPlayer);
@@ -5059,6 +5149,7 @@ bool NETjoinGame(const char *host, uint32_t port, const char *playername, const
 
 			EcKey::Sig challengeResponse = playerIdentity.sign(challenge.data(), challenge.size());
 			EcKey::Key identity = playerIdentity.toBytes(EcKey::Public);
+			uint32_t compressionDictionaryId = socketCompressionDictionaryId();
 
 			NETbeginEncode(NETnetQueue(NET_HOST_ONLY), NET_JOIN);
 			NETstring(playername, 64);
@@ -5067,6 +5158,7 @@ bool NETjoinGame(const char *host, uint32_t port, const char *playername, const
 			NETuint8_t(&playerType);
 			NETbytes(&identity);
 			NETbytes(&challengeResponse);
+			NETuint32_t(&compressionDictionaryId);  // Ignored by older hosts.
 			NETend();
 			NETflush();
 		}
@@ -30,6 +30,11 @@
 
 // See comments in netqueue.h.
 
+// Number of message slots a NetQueue starts with, must be a power of 2
+#define NETQUEUE_INITIAL_RING_SIZE	16
+// Don't keep message storage bigger than this around for reuse
+#define NETQUEUE_MAX_POOLED_MESSAGE_SIZE	4096
+
 
 // Byte n is the final byte, iff it is less than 256-a[n].
 
@@ -179,11 +184,35 @@ size_t NetMessage::rawLen() const
 NetQueue::NetQueue()
 	: canGetMessagesForNet(true)
 	, canGetMessages(true)
+	, oldestPos(0)
+	, dataPos(0)
+	, messagePos(0)
+	, endPos(0)
 	, pendingGameTimeUpdateMessages(0)
 	, bCurrentMessageWasDecrypted(false)
+{}
+
+NetMessage &NetQueue::internal_pushMessage(uint8_t type)
 {
-	dataPos = messages.end();
-	messagePos = messages.end();
+	if (endPos - oldestPos == messages.size())
+	{
+		// Full, double the ring. Only the pointers move, the messages themselves stay where they are.
+		Ring newMessages(std::max<size_t>(messages.size() * 2, NETQUEUE_INITIAL_RING_SIZE));
+		for (size_t seq = oldestPos; seq != endPos; ++seq)
+		{
+			newMessages[seq & (newMessages.size() - 1)] = std::move(messages[seq & (messages.size() - 1)]);
+		}
+		messages = std::move(newMessages);
+	}
+
+	std::unique_ptr<NetMessage> &slot = messages[endPos & (messages.size() - 1)];
+	if (!slot)
+	{
+		slot.reset(new NetMessage(type));
+	}
+	slot->type = type;
+	++endPos;
+	return *slot;
 }
 
 void NetQueue::writeRawData(const uint8_t *netData, size_t netLen)
@@ -214,8 +243,8 @@ void NetQueue::writeRawData(const uint8_t *netData, size_t netLen)
 			break;  // Don't have a whole message ready yet.
 		}
 
-		messages.push_front(NetMessage(type));
-		messages.front().data.assign(buffer.begin() + used + headerLen, buffer.begin() + used + headerLen + len);
+		NetMessage &message = internal_pushMessage(type);
+		message.data.assign(buffer.begin() + used + headerLen, buffer.begin() + used + headerLen + len);
 		if (type == GAME_GAME_TIME)
 		{
 			++pendingGameTimeUpdateMessages;
@@ -239,22 +268,18 @@ void NetQueue::setWillNeverGetMessagesForNet()
 
 unsigned NetQueue::numMessagesForNet() const
 {
-	unsigned count = 0;
-	if (canGetMessagesForNet)
+	if (!canGetMessagesForNet)
 	{
-		for (List::iterator i = dataPos; i != messages.begin(); --i)
-		{
-			++count;
-		}
+		return 0;
 	}
 
-	return count;
+	return static_cast<unsigned>(endPos - dataPos);
 }
 
 const NetMessage &NetQueue::getMessageForNet() const
 {
 	ASSERT(canGetMessagesForNet, "Wrong NetQueue type for getMessageForNet.");
-	ASSERT(dataPos != messages.begin(), "No message to get!");
+	ASSERT(dataPos != endPos, "No message to get!");
 
 	// Return the message.
 	return internal_getMessageForNet();
@@ -263,9 +288,9 @@ const NetMessage &NetQueue::getMessageForNet() const
 void NetQueue::popMessageForNet()
 {
 	ASSERT(canGetMessagesForNet, "Wrong NetQueue type for popMessageForNet.");
-	ASSERT(dataPos != messages.begin(), "No message to pop!");
+	ASSERT(dataPos != endPos, "No message to pop!");
 
-	if (messagePos != messages.begin() && internal_getMessageForNet().type == GAME_GAME_TIME)
+	if (messagePos != endPos && internal_getMessageForNet().type == GAME_GAME_TIME)
 	{
 		if (pendingGameTimeUpdateMessages > 0)
 		{
@@ -274,7 +299,7 @@ void NetQueue::popMessageForNet()
 	}
 
 	// Pop the message.
-	--dataPos;
+	++dataPos;
 
 	// Recycle old data.
 	popOldMessages();
@@ -286,7 +311,8 @@ void NetQueue::pushMessage(const NetMessage &message)
 	{
 		++pendingGameTimeUpdateMessages;
 	}
-	messages.push_front(message);
+	NetMessage &newMessage = internal_pushMessage(message.type);
+	newMessage.data.assign(message.data.begin(), message.data.end());  // Reuses the old storage of the slot, if big enough.
 }
 
 void NetQueue::setWillNeverGetMessages()
@@ -297,13 +323,13 @@ void NetQueue::setWillNeverGetMessages()
 bool NetQueue::haveMessage() const
 {
 	ASSERT(canGetMessages, "Wrong NetQueue type for haveMessage.");
-	return messagePos != messages.begin();
+	return messagePos != endPos;
 }
 
 const NetMessage &NetQueue::getMessage() const
 {
 	ASSERT(canGetMessages, "Wrong NetQueue type for getMessage.");
-	ASSERT(messagePos != messages.begin(), "No message to get!");
+	ASSERT(messagePos != endPos, "No message to get!");
 
 	// Return the message.
 	return internal_getConstMessage();
@@ -317,7 +343,7 @@ bool NetQueue::currentMessageWasDecrypted() const
 bool NetQueue::replaceCurrentWithDecrypted(NetMessage &&decryptedMessage)
 {
 	ASSERT_OR_RETURN(false, canGetMessages, "Wrong NetQueue type for getMessage.");
-	ASSERT_OR_RETURN(false, messagePos != messages.begin(), "No message to get!");
+	ASSERT_OR_RETURN(false, messagePos != endPos, "No message to get!");
 
 	NetMessage& currentMessage = internal_getMessage();
 	ASSERT_OR_RETURN(false, currentMessage.type == NET_SECURED_NET_MESSAGE, "Current message is not a secured message!");
@@ -330,9 +356,9 @@ bool NetQueue::replaceCurrentWithDecrypted(NetMessage &&decryptedMessage)
 void NetQueue::popMessage()
 {
 	ASSERT(canGetMessages, "Wrong NetQueue type for popMessage.");
-	ASSERT(messagePos != messages.begin(), "No message to pop!");
+	ASSERT(messagePos != endPos, "No message to pop!");
 
-	if (messagePos != messages.begin() && internal_getConstMessage().type == GAME_GAME_TIME)
+	if (messagePos != endPos && internal_getConstMessage().type == GAME_GAME_TIME)
 	{
 		if (pendingGameTimeUpdateMessages > 0)
 		{
@@ -341,7 +367,7 @@ void NetQueue::popMessage()
 	}
 
 	// Pop the message.
-	--messagePos;
+	++messagePos;
 	bCurrentMessageWasDecrypted = false;
 
 	// Recycle old data.
@@ -352,27 +378,25 @@ void NetQueue::popOldMessages()
 {
 	if (!canGetMessagesForNet)
 	{
-		dataPos = messages.begin();
+		dataPos = endPos;
 	}
 	if (!canGetMessages)
 	{
-		messagePos = messages.begin();
-	}
-
-	List::iterator i = messages.end();
-	while (i != dataPos && i != messagePos)
-	{
-		--i;
+		messagePos = endPos;
 	}
 
-	if (i == dataPos)
-	{
-		dataPos = messages.end();  // Old iterator will become invalid.
-	}
-	if (i == messagePos)
+	// Keep the storage of the old messages, to be reused by new messages, unless it is unusually big.
+	size_t newOldestPos = std::min(dataPos, messagePos);
+	for (; oldestPos != newOldestPos; ++oldestPos)
 	{
-		messagePos = messages.end();  // Old iterator will become invalid.
+		std::vector<uint8_t> &data = internal_getMessage(oldestPos).data;
+		if (data.capacity() > NETQUEUE_MAX_POOLED_MESSAGE_SIZE)
+		{
+			std::vector<uint8_t>().swap(data);
+		}
+		else
+		{
+			data.clear();
+		}
 	}
-
-	messages.erase(i, messages.end());
 }
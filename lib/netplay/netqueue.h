@@ -29,6 +29,7 @@
 #include <list>
 #include <deque>
 #include <unordered_map>
+#include <memory>
 
 // At game level:
 // There should be a NetQueue representing each client.
@@ -167,34 +168,36 @@ private:
 	bool canGetMessagesForNet;                                         ///< True if we will send the messages over the network, false if we don't.
 	bool canGetMessages;                                               ///< True if we will get the messages, false if we don't use them ourselves.
 
+	NetMessage &internal_pushMessage(uint8_t type);                    ///< Adds an empty message, reusing the storage of an old one if possible.
+
+	inline NetMessage &internal_getMessage(size_t seq) const
+	{
+		return *messages[seq & (messages.size() - 1)];
+	};
+
 	inline const NetMessage &internal_getMessageForNet() const
 	{
-		// Return the message.
-		List::iterator i = dataPos;
-		--i;
-		return *i;
+		return internal_getMessage(dataPos);
 	};
 
 	inline const NetMessage &internal_getConstMessage() const
 	{
-		// Return the message.
-		List::iterator i = messagePos;
-		--i;
-		return *i;
+		return internal_getMessage(messagePos);
 	};
 
 	inline NetMessage &internal_getMessage()
 	{
-		// Return the message.
-		List::iterator i = messagePos;
-		--i;
-		return *i;
+		return internal_getMessage(messagePos);
 	};
 
-	using List = std::list<NetMessage>;
-	List::iterator                dataPos;                             ///< Last message which was sent over the network.
-	List::iterator                messagePos;                          ///< Last message which was popped.
-	List                          messages;                            ///< List of messages. Messages are added to the front and read from the back.
+	// Messages are numbered in the order they were added. Message number seq lives in messages[seq % messages.size()].
+	// The messages are held by pointer, so references returned by getMessage() stay valid when the ring grows.
+	using Ring = std::vector<std::unique_ptr<NetMessage>>;
+	size_t                        oldestPos;                           ///< Oldest message which is still needed.
+	size_t                        dataPos;                             ///< Next message to send over the network.
+	size_t                        messagePos;                          ///< Next message to return from getMessage().
+	size_t                        endPos;                              ///< Number of the next message to be added.
+	Ring                          messages;                            ///< Ring of messages, size is a power of 2. Slots outside [oldestPos, endPos) keep their storage for reuse.
 	std::vector<uint8_t>          incompleteReceivedMessageData;       ///< Data from network which has not yet formed an entire message.
 	size_t                        pendingGameTimeUpdateMessages;       ///< Pending GAME_GAME_TIME messages added to this queue
 	bool						  bCurrentMessageWasDecrypted;
@@ -30,6 +30,15 @@
 #include <vector>
 #include <algorithm>
 #include <map>
+#include <set>
+#include <deque>
+
+#if defined(WZ_OS_LINUX)
+#  include <sys/epoll.h>
+// Wait on sockets with epoll instead of select(), which doesn't scale to many sockets and can't handle descriptors >= FD_SETSIZE.
+// If an epoll instance can't be created or used, the select() path is used instead.
+#  define WZ_NETSOCKET_EPOLL
+#endif
 
 #if !defined(ZLIB_CONST)
 #  define ZLIB_CONST
@@ -77,11 +86,34 @@ struct Socket
 	bool zInflateNeedInput;
 	std::vector<uint8_t> zDeflateOutBuf;
 	std::vector<uint8_t> zInflateInBuf;
+
+	struct HeldBackWrite
+	{
+		std::vector<uint8_t> data;
+		int queuedTime;
+	};
+	/// How long messages of a traffic class were held back, logged when the Socket is closed.
+	struct TrafficStats
+	{
+		uint64_t messages = 0;
+		uint64_t totalDelay = 0;  ///< In milliseconds.
+		uint32_t maxDelay = 0;    ///< In milliseconds.
+	};
+	std::deque<HeldBackWrite> heldBackWrites[SOCKET_TRAFFIC_CLASSES];  ///< Messages waiting for socketFlush to let them into the compressed stream. Unused for SOCKET_TRAFFIC_GAME.
+	size_t heldBackCredit[SOCKET_TRAFFIC_CLASSES] = {};                  ///< Bytes each class may still add to the stream, carried over between flushes.
+	TrafficStats trafficStats[SOCKET_TRAFFIC_CLASSES];
 };
 
 struct SocketSet
 {
+	SocketSet() {}
+	SocketSet(std::vector<Socket *> fds_) : fds(std::move(fds_)) {}  ///< Temporary set, always uses select().
+
 	std::vector<Socket *> fds;
+#if defined(WZ_NETSOCKET_EPOLL)
+	int epollFd = -1;  ///< Watches fds for reading, or -1 to use select().
+	mutable std::vector<epoll_event> events;
+#endif
 };
 
 
@@ -92,6 +124,21 @@ static bool socketThreadQuit;
 typedef std::map<Socket *, std::vector<uint8_t>> SocketThreadWriteMap;
 static SocketThreadWriteMap socketThreadWrites;
 
+// While game traffic is waiting, chat and bulk data are only let into a connection while fewer than this many bytes wait to be sent.
+#define SOCKET_HELD_BACK_BACKLOG_LIMIT	16384
+// Share of the free backlog for each traffic class which is held back.
+static const unsigned socketTrafficWeights[SOCKET_TRAFFIC_CLASSES] = {0, 3, 1};
+static const char *const socketTrafficClassNames[SOCKET_TRAFFIC_CLASSES] = {"game", "chat", "bulk"};
+
+// Messages are small and flushed every frame, so higher levels cost CPU on every connection for little gain.
+#define SOCKET_DEFLATE_LEVEL	3
+static std::vector<uint8_t> socketCompressionDictionary;  // Only used by the main thread, like the zlib streams.
+static uint32_t socketCompressionDictionaryChecksum = 0;
+#if defined(WZ_NETSOCKET_EPOLL)
+static int socketThreadEpollFd = -1;                 ///< Watches the sockets with pending writes, or -1 to use select().
+static std::set<Socket *> socketThreadEpollSockets;  ///< Sockets currently registered with socketThreadEpollFd.
+#endif
+
 
 static void socketCloseNow(Socket *sock);
 
@@ -392,11 +439,62 @@ static bool connectionIsOpen(Socket *sock)
 	return true;
 }
 
+#if defined(WZ_NETSOCKET_EPOLL)
+/// Removes a socket from socketThreadEpollFd, if registered. Must hold socketThreadMutex.
+static void socketThreadEpollRemove(Socket *sock)
+{
+	if (socketThreadEpollSockets.erase(sock) != 0)
+	{
+		epoll_event ev = {};  // Ignored, but must be non-null on kernels before 2.6.9.
+		epoll_ctl(socketThreadEpollFd, EPOLL_CTL_DEL, sock->fd[SOCK_CONNECTION], &ev);
+	}
+}
+
+/// Registers the sockets with pending writes with socketThreadEpollFd, and unregisters the rest. Must hold socketThreadMutex.
+static bool socketThreadEpollSync()
+{
+	for (std::set<Socket *>::iterator i = socketThreadEpollSockets.begin(); i != socketThreadEpollSockets.end();)
+	{
+		Socket *sock = *i;
+		++i;
+		if (socketThreadWrites.find(sock) == socketThreadWrites.end())
+		{
+			socketThreadEpollRemove(sock);
+		}
+	}
+	for (SocketThreadWriteMap::const_iterator i = socketThreadWrites.begin(); i != socketThreadWrites.end(); ++i)
+	{
+		if (socketThreadEpollSockets.find(i->first) != socketThreadEpollSockets.end())
+		{
+			continue;
+		}
+		epoll_event ev = {};
+		ev.events = EPOLLOUT;
+		ev.data.ptr = i->first;
+		if (epoll_ctl(socketThreadEpollFd, EPOLL_CTL_ADD, i->first->fd[SOCK_CONNECTION], &ev) == SOCKET_ERROR)
+		{
+			debug(LOG_ERROR, "epoll_ctl failed, falling back to select: %s", strSockError(getSockErr()));
+			return false;
+		}
+		socketThreadEpollSockets.insert(i->first);
+	}
+	return true;
+}
+#endif
+
 static int socketThreadFunction(void *)
 {
+#if defined(WZ_NETSOCKET_EPOLL)
+	std::vector<epoll_event> epollEvents;
+	std::vector<Socket *> epollReady;  // Sorted.
+#endif
 	wzMutexLock(socketThreadMutex);
 	while (!socketThreadQuit)
 	{
+		bool useEpoll = false;
+#if defined(WZ_NETSOCKET_EPOLL)
+		useEpoll = socketThreadEpollFd >= 0;
+#endif
 #if   defined(WZ_OS_UNIX)
 		SOCKET maxfd = INT_MIN;
 #elif defined(WZ_OS_WIN)
@@ -409,10 +507,13 @@ static int socketThreadFunction(void *)
 		{
 			if (!i->second.empty())
 			{
-				SOCKET fd = i->first->fd[SOCK_CONNECTION];
-				maxfd = std::max(maxfd, fd);
-				ASSERT(!FD_ISSET(fd, &fds), "Duplicate file descriptor!");  // Shouldn't be possible, but blocking in send, after select says it won't block, shouldn't be possible either.
-				FD_SET(fd, &fds);
+				if (!useEpoll)
+				{
+					SOCKET fd = i->first->fd[SOCK_CONNECTION];
+					maxfd = std::max(maxfd, fd);
+					ASSERT(!FD_ISSET(fd, &fds), "Duplicate file descriptor!");  // Shouldn't be possible, but blocking in send, after select says it won't block, shouldn't be possible either.
+					FD_SET(fd, &fds);
+				}
 				++descriptorsToWaitOn;
 				++i;
 			}
@@ -429,13 +530,43 @@ static int socketThreadFunction(void *)
 		}
 		struct timeval tv = {0, 50 * 1000};
 
+#if defined(WZ_NETSOCKET_EPOLL)
+		if (useEpoll && descriptorsToWaitOn > 0 && !socketThreadEpollSync())
+		{
+			close(socketThreadEpollFd);
+			socketThreadEpollFd = -1;
+			socketThreadEpollSockets.clear();
+			continue;  // Start over using select.
+		}
+#endif
+
 		// Check if we can write to any sockets.
 		int ret = -1;
 		if (descriptorsToWaitOn > 0)
 		{
-			wzMutexUnlock(socketThreadMutex);
-			ret = select(maxfd + 1, nullptr, &fds, nullptr, &tv);
-			wzMutexLock(socketThreadMutex);
+#if defined(WZ_NETSOCKET_EPOLL)
+			if (useEpoll)
+			{
+				epollEvents.resize(socketThreadEpollSockets.size());
+				wzMutexUnlock(socketThreadMutex);
+				ret = epoll_wait(socketThreadEpollFd, epollEvents.data(), static_cast<int>(epollEvents.size()), static_cast<int>(tv.tv_usec / 1000));
+				wzMutexLock(socketThreadMutex);
+
+				// Only compare the pointers, the sockets may have been closed after unlocking the mutex.
+				epollReady.clear();
+				for (int n = 0; n < ret; ++n)
+				{
+					epollReady.push_back(static_cast<Socket *>(epollEvents[n].data.ptr));
+				}
+				std::sort(epollReady.begin(), epollReady.end());
+			}
+			else
+#endif
+			{
+				wzMutexUnlock(socketThreadMutex);
+				ret = select(maxfd + 1, nullptr, &fds, nullptr, &tv);
+				wzMutexLock(socketThreadMutex);
+			}
 		}
 
 		// We can write to some sockets. (Ignore errors from select, we may have deleted the socket after unlocking the mutex, and before calling select.)
@@ -450,7 +581,11 @@ static int socketThreadFunction(void *)
 				std::vector<uint8_t> &writeQueue = w->second;
 				ASSERT(!writeQueue.empty(), "writeQueue[sock] must not be empty.");
 
+#if defined(WZ_NETSOCKET_EPOLL)
+				if (useEpoll ? !std::binary_search(epollReady.begin(), epollReady.end(), sock) : !FD_ISSET(sock->fd[SOCK_CONNECTION], &fds))
+#else
 				if (!FD_ISSET(sock->fd[SOCK_CONNECTION], &fds))
+#endif
 				{
 					continue;  // This socket is not ready for writing, or we don't have anything to write.
 				}
@@ -574,7 +709,30 @@ ssize_t readNoInt(Socket *sock, void *buf, size_t max_size, size_t *rawByteCount
 
 		sock->zInflate.next_out = (Bytef *)buf;
 		sock->zInflate.avail_out = max_size;
-		int ret = inflate(&sock->zInflate, Z_NO_FLUSH);
+		int ret;
+		for (;;)
+		{
+			ret = inflate(&sock->zInflate, Z_NO_FLUSH);
+			if (ret == Z_NEED_DICT && !socketCompressionDictionary.empty())
+			{
+				// The other end primed its stream with the dictionary. Fails with Z_DATA_ERROR, if the checksum doesn't match ours.
+				ret = inflateSetDictionary(&sock->zInflate, socketCompressionDictionary.data(), socketCompressionDictionary.size());
+				if (ret == Z_OK)
+				{
+					continue;
+				}
+			}
+			else if (ret == Z_STREAM_END)
+			{
+				// The other end finished its stream, and any further data is a new one. See socketUseCompressionDictionary().
+				ret = inflateReset(&sock->zInflate);
+				if (ret == Z_OK && sock->zInflate.avail_in != 0 && sock->zInflate.avail_out != 0)
+				{
+					continue;
+				}
+			}
+			break;
+		}
 		ASSERT(ret != Z_STREAM_ERROR, "zlib inflate not working!");
 		char const *err = nullptr;
 		switch (ret)
@@ -626,7 +784,134 @@ bool socketReadDisconnected(Socket *sock)
  *
  * @return @c size when successful or @c SOCKET_ERROR if an error occurred.
  */
-ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCount)
+/// Compresses data into sock->zDeflateOutBuf, which socketFlush() hands to the socket thread.
+static void socketDeflate(Socket *sock, const void *buf, size_t size)
+{
+#if ZLIB_VERNUM < 0x1252
+	// zlib < 1.2.5.2 does not support `#define ZLIB_CONST`
+	// Unfortunately, some OSes (ex. OpenBSD) ship with zlib < 1.2.5.2
+	// Workaround: cast away the const of the input, and disable the resulting -Wcast-qual warning
+	#if defined(__clang__)
+	#  pragma clang diagnostic push
+	#  pragma clang diagnostic ignored "-Wcast-qual"
+	#elif defined(__GNUC__)
+	#  pragma GCC diagnostic push
+	#  pragma GCC diagnostic ignored "-Wcast-qual"
+	#endif
+
+	// cast away the const for earlier zlib versions
+	sock->zDeflate.next_in = (Bytef *)buf; // -Wcast-qual
+
+	#if defined(__clang__)
+	#  pragma clang diagnostic pop
+	#elif defined(__GNUC__)
+	#  pragma GCC diagnostic pop
+	#endif
+#else
+	// zlib >= 1.2.5.2 supports ZLIB_CONST
+	sock->zDeflate.next_in = (const Bytef *)buf;
+#endif
+
+	sock->zDeflate.avail_in = size;
+	sock->zDeflateInSize += sock->zDeflate.avail_in;
+	do
+	{
+		size_t alreadyHave = sock->zDeflateOutBuf.size();
+		sock->zDeflateOutBuf.resize(alreadyHave + size + 20);  // A bit more than size should be enough to always do everything in one go.
+		sock->zDeflate.next_out = (Bytef *)&sock->zDeflateOutBuf[alreadyHave];
+		sock->zDeflate.avail_out = sock->zDeflateOutBuf.size() - alreadyHave;
+
+		int ret = deflate(&sock->zDeflate, Z_NO_FLUSH);
+		ASSERT(ret != Z_STREAM_ERROR, "zlib compression failed!");
+
+		// Remove unused part of buffer.
+		sock->zDeflateOutBuf.resize(sock->zDeflateOutBuf.size() - sock->zDeflate.avail_out);
+	}
+	while (sock->zDeflate.avail_out == 0);
+
+	ASSERT(sock->zDeflate.avail_in == 0, "zlib didn't compress everything!");
+}
+
+/// Deflates the first held back message of a traffic class, and records how long it waited.
+static void socketReleaseHeldBackWrite(Socket *sock, unsigned trafficClass, int now)
+{
+	std::deque<Socket::HeldBackWrite> &queue = sock->heldBackWrites[trafficClass];
+	Socket::HeldBackWrite &write = queue.front();
+	socketDeflate(sock, write.data.data(), write.data.size());
+
+	Socket::TrafficStats &stats = sock->trafficStats[trafficClass];
+	uint32_t delay = static_cast<uint32_t>(std::max(now - write.queuedTime, 0));
+	++stats.messages;
+	stats.totalDelay += delay;
+	stats.maxDelay = std::max(stats.maxDelay, delay);
+	queue.pop_front();
+}
+
+/// Lets held back chat and bulk messages into the compressed stream. If game traffic was written since the last flush, only as
+/// far as the connection's backlog allows: each class then earns credit in proportion to its weight, and sends whole messages
+/// once it has enough. Otherwise, or if releaseAll is set, everything goes.
+static void socketReleaseHeldBackWrites(Socket *sock, bool releaseAll = false)
+{
+	unsigned totalWeight = 0;
+	for (unsigned c = 0; c < SOCKET_TRAFFIC_CLASSES; ++c)
+	{
+		if (!sock->heldBackWrites[c].empty())
+		{
+			totalWeight += socketTrafficWeights[c];
+		}
+	}
+	if (totalWeight == 0)
+	{
+		return;  // Nothing held back.
+	}
+
+	int now = wzGetTicks();
+	if (releaseAll || sock->zDeflateInSize == 0)
+	{
+		// No game traffic waiting, so don't hold anything back.
+		for (unsigned c = 0; c < SOCKET_TRAFFIC_CLASSES; ++c)
+		{
+			while (!sock->heldBackWrites[c].empty())
+			{
+				socketReleaseHeldBackWrite(sock, c, now);
+			}
+			sock->heldBackCredit[c] = 0;
+		}
+		return;
+	}
+
+	wzMutexLock(socketThreadMutex);
+	SocketThreadWriteMap::const_iterator w = socketThreadWrites.find(sock);
+	size_t backlog = w != socketThreadWrites.end() ? w->second.size() : 0;
+	wzMutexUnlock(socketThreadMutex);
+	backlog += sock->zDeflateOutBuf.size();
+	if (backlog >= SOCKET_HELD_BACK_BACKLOG_LIMIT)
+	{
+		return;  // Connection is backed up, let the game traffic through first.
+	}
+	size_t budget = SOCKET_HELD_BACK_BACKLOG_LIMIT - backlog;
+
+	for (unsigned c = 0; c < SOCKET_TRAFFIC_CLASSES; ++c)
+	{
+		std::deque<Socket::HeldBackWrite> &queue = sock->heldBackWrites[c];
+		if (queue.empty())
+		{
+			continue;
+		}
+		sock->heldBackCredit[c] += budget * socketTrafficWeights[c] / totalWeight;
+		while (!queue.empty() && queue.front().data.size() <= sock->heldBackCredit[c])
+		{
+			sock->heldBackCredit[c] -= queue.front().data.size();
+			socketReleaseHeldBackWrite(sock, c, now);
+		}
+		if (queue.empty())
+		{
+			sock->heldBackCredit[c] = 0;  // Don't save up credit while idle.
+		}
+	}
+}
+
+ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCount, SocketTrafficClass trafficClass)
 {
 	size_t ignored;
 	size_t &rawBytes = rawByteCount != nullptr ? *rawByteCount : ignored;
@@ -658,51 +943,15 @@ ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCoun
 			wzMutexUnlock(socketThreadMutex);
 			rawBytes = size;
 		}
+		else if (trafficClass != SOCKET_TRAFFIC_GAME)
+		{
+			// Held back until socketFlush finds room for it on the connection.
+			const uint8_t *data = static_cast<const uint8_t *>(buf);
+			sock->heldBackWrites[trafficClass].push_back({std::vector<uint8_t>(data, data + size), wzGetTicks()});
+		}
 		else
 		{
-		#if ZLIB_VERNUM < 0x1252
-			// zlib < 1.2.5.2 does not support `#define ZLIB_CONST`
-			// Unfortunately, some OSes (ex. OpenBSD) ship with zlib < 1.2.5.2
-			// Workaround: cast away the const of the input, and disable the resulting -Wcast-qual warning
-			#if defined(__clang__)
-			#  pragma clang diagnostic push
-			#  pragma clang diagnostic ignored "-Wcast-qual"
-			#elif defined(__GNUC__)
-			#  pragma GCC diagnostic push
-			#  pragma GCC diagnostic ignored "-Wcast-qual"
-			#endif
-
-			// cast away the const for earlier zlib versions
-			sock->zDeflate.next_in = (Bytef *)buf; // -Wcast-qual
-
-			#if defined(__clang__)
-			#  pragma clang diagnostic pop
-			#elif defined(__GNUC__)
-			#  pragma GCC diagnostic pop
-			#endif
-		#else
-			// zlib >= 1.2.5.2 supports ZLIB_CONST
-			sock->zDeflate.next_in = (const Bytef *)buf;
-		#endif
-
-			sock->zDeflate.avail_in = size;
-			sock->zDeflateInSize += sock->zDeflate.avail_in;
-			do
-			{
-				size_t alreadyHave = sock->zDeflateOutBuf.size();
-				sock->zDeflateOutBuf.resize(alreadyHave + size + 20);  // A bit more than size should be enough to always do everything in one go.
-				sock->zDeflate.next_out = (Bytef *)&sock->zDeflateOutBuf[alreadyHave];
-				sock->zDeflate.avail_out = sock->zDeflateOutBuf.size() - alreadyHave;
-
-				int ret = deflate(&sock->zDeflate, Z_NO_FLUSH);
-				ASSERT(ret != Z_STREAM_ERROR, "zlib compression failed!");
-
-				// Remove unused part of buffer.
-				sock->zDeflateOutBuf.resize(sock->zDeflateOutBuf.size() - sock->zDeflate.avail_out);
-			}
-			while (sock->zDeflate.avail_out == 0);
-
-			ASSERT(sock->zDeflate.avail_in == 0, "zlib didn't compress everything!");
+			socketDeflate(sock, buf, size);
 		}
 	}
 
@@ -722,6 +971,8 @@ void socketFlush(Socket *sock, uint8_t player, size_t *rawByteCount)
 
 	ASSERT(!sock->writeError, "Socket write error?? (Player: %" PRIu8 "", player);
 
+	socketReleaseHeldBackWrites(sock);
+
 	// Flush data out of zlib compression state.
 	do
 	{
@@ -765,6 +1016,53 @@ void socketFlush(Socket *sock, uint8_t player, size_t *rawByteCount)
 	sock->zDeflateOutBuf.clear();
 }
 
+void socketSetCompressionDictionary(std::vector<uint8_t> dictionary)
+{
+	socketCompressionDictionary = std::move(dictionary);
+	socketCompressionDictionaryChecksum = 0;
+	if (!socketCompressionDictionary.empty())
+	{
+		// The same checksum zlib puts in the stream header.
+		socketCompressionDictionaryChecksum = adler32(adler32(0, Z_NULL, 0), socketCompressionDictionary.data(), socketCompressionDictionary.size());
+	}
+}
+
+uint32_t socketCompressionDictionaryId()
+{
+	return socketCompressionDictionaryChecksum;
+}
+
+void socketUseCompressionDictionary(Socket *sock)
+{
+	ASSERT_OR_RETURN(, sock->isCompressed, "Socket isn't compressed.");
+	ASSERT_OR_RETURN(, !socketCompressionDictionary.empty(), "No compression dictionary set.");
+
+	// Finish the stream so far. The other end's inflate reaches its end, and starts over with the new one.
+	int ret;
+	do
+	{
+		sock->zDeflate.next_in = (Bytef *)nullptr;
+		sock->zDeflate.avail_in = 0;
+		size_t alreadyHave = sock->zDeflateOutBuf.size();
+		sock->zDeflateOutBuf.resize(alreadyHave + 1000);
+		sock->zDeflate.next_out = (Bytef *)&sock->zDeflateOutBuf[alreadyHave];
+		sock->zDeflate.avail_out = sock->zDeflateOutBuf.size() - alreadyHave;
+
+		ret = deflate(&sock->zDeflate, Z_FINISH);
+		ASSERT(ret != Z_STREAM_ERROR, "zlib compression failed!");
+
+		// Remove unused part of buffer.
+		sock->zDeflateOutBuf.resize(sock->zDeflateOutBuf.size() - sock->zDeflate.avail_out);
+	}
+	while (ret == Z_OK);
+	ASSERT(ret == Z_STREAM_END, "zlib didn't finish the stream!");
+
+	ret = deflateReset(&sock->zDeflate);
+	ASSERT(ret == Z_OK, "deflateReset failed!");
+	ret = deflateSetDictionary(&sock->zDeflate, socketCompressionDictionary.data(), socketCompressionDictionary.size());
+	ASSERT(ret == Z_OK, "deflateSetDictionary failed!");
+}
+
 void socketBeginCompression(Socket *sock)
 {
 	if (sock->isCompressed)
@@ -778,7 +1076,7 @@ void socketBeginCompression(Socket *sock)
 	sock->zDeflate.zalloc = Z_NULL;
 	sock->zDeflate.zfree = Z_NULL;
 	sock->zDeflate.opaque = Z_NULL;
-	int ret = deflateInit(&sock->zDeflate, 6);
+	int ret = deflateInit(&sock->zDeflate, SOCKET_DEFLATE_LEVEL);
 	ASSERT(ret == Z_OK, "deflateInit failed! Sockets won't work.");
 
 	sock->zInflate.zalloc = Z_NULL;
@@ -806,11 +1104,26 @@ Socket::~Socket()
 
 SocketSet *allocSocketSet()
 {
-	return new SocketSet;
+	SocketSet *set = new SocketSet;
+#if defined(WZ_NETSOCKET_EPOLL)
+	set->epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (set->epollFd == SOCKET_ERROR)
+	{
+		debug(LOG_NET, "epoll_create1 failed, using select: %s", strSockError(getSockErr()));
+		set->epollFd = -1;
+	}
+#endif
+	return set;
 }
 
 void deleteSocketSet(SocketSet *set)
 {
+#if defined(WZ_NETSOCKET_EPOLL)
+	if (set->epollFd >= 0)
+	{
+		close(set->epollFd);
+	}
+#endif
 	delete set;
 }
 
@@ -833,6 +1146,22 @@ void SocketSet_AddSocket(SocketSet *set, Socket *socket)
 
 	set->fds.push_back(socket);
 	debug(LOG_NET, "Socket added: set->fds[%lu] = %p", (unsigned long)i, static_cast<void *>(socket));
+
+#if defined(WZ_NETSOCKET_EPOLL)
+	if (set->epollFd >= 0)
+	{
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.ptr = socket;
+		if (epoll_ctl(set->epollFd, EPOLL_CTL_ADD, socket->fd[SOCK_CONNECTION], &ev) == SOCKET_ERROR)
+		{
+			// Can't watch every socket in the set, so stop using epoll for it.
+			debug(LOG_ERROR, "epoll_ctl failed, falling back to select: %s", strSockError(getSockErr()));
+			close(set->epollFd);
+			set->epollFd = -1;
+		}
+	}
+#endif
 }
 
 /**
@@ -845,6 +1174,14 @@ void SocketSet_DelSocket(SocketSet *set, Socket *socket)
 	{
 		debug(LOG_NET, "Socket %p erased (set->fds[%lu])", static_cast<void *>(socket), (unsigned long)i);
 		set->fds.erase(set->fds.begin() + i);
+
+#if defined(WZ_NETSOCKET_EPOLL)
+		if (set->epollFd >= 0)
+		{
+			epoll_event ev = {};  // Ignored, but must be non-null on kernels before 2.6.9.
+			epoll_ctl(set->epollFd, EPOLL_CTL_DEL, socket->fd[SOCK_CONNECTION], &ev);  // Fails harmlessly if the socket was already closed.
+		}
+#endif
 	}
 }
 
@@ -941,6 +1278,38 @@ static void socketBlockSIGPIPE(const SOCKET fd, bool block_sigpipe)
 #endif
 }
 
+#if defined(WZ_NETSOCKET_EPOLL)
+static int checkSocketsEpoll(const SocketSet *set, unsigned int timeout)
+{
+	set->events.resize(set->fds.size());
+
+	int ret;
+	do
+	{
+		ret = epoll_wait(set->epollFd, set->events.data(), static_cast<int>(set->events.size()), static_cast<int>(timeout));
+	}
+	while (ret == SOCKET_ERROR && getSockErr() == EINTR);
+
+	if (ret == SOCKET_ERROR)
+	{
+		debug(LOG_ERROR, "epoll_wait failed: %s", strSockError(getSockErr()));
+		return SOCKET_ERROR;
+	}
+
+	for (size_t i = 0; i < set->fds.size(); ++i)
+	{
+		set->fds[i]->ready = false;
+	}
+	for (int n = 0; n < ret; ++n)
+	{
+		// Errors and hangups count as ready, like with select, so the next read notices them.
+		static_cast<Socket *>(set->events[n].data.ptr)->ready = true;
+	}
+
+	return ret;
+}
+#endif
+
 int checkSockets(const SocketSet *set, unsigned int timeout)
 {
 	if (set->fds.empty())
@@ -981,6 +1350,13 @@ int checkSockets(const SocketSet *set, unsigned int timeout)
 		return ret;
 	}
 
+#if defined(WZ_NETSOCKET_EPOLL)
+	if (set->epollFd >= 0)
+	{
+		return checkSocketsEpoll(set, timeout);
+	}
+#endif
+
 	int ret;
 	fd_set fds;
 	do
@@ -1097,6 +1473,9 @@ ssize_t readAll(Socket *sock, void *buf, size_t size, unsigned int timeout)
 
 static void socketCloseNow(Socket *sock)
 {
+#if defined(WZ_NETSOCKET_EPOLL)
+	socketThreadEpollRemove(sock);  // Before closing, the descriptor number may be reused.
+#endif
 	for (unsigned i = 0; i < ARRAY_SIZE(sock->fd); ++i)
 	{
 		if (sock->fd[i] != INVALID_SOCKET)
@@ -1123,6 +1502,33 @@ static void socketCloseNow(Socket *sock)
 
 void socketClose(Socket *sock)
 {
+	bool heldBack = false;
+	for (unsigned c = 0; c < SOCKET_TRAFFIC_CLASSES; ++c)
+	{
+		heldBack = heldBack || !sock->heldBackWrites[c].empty();
+	}
+	if (heldBack && sock->isCompressed && !sock->writeError && sock->fd[SOCK_CONNECTION] != INVALID_SOCKET)
+	{
+		// Written before closing, so send it with a last flush, as if it had never been held back.
+		socketReleaseHeldBackWrites(sock, true);
+		socketFlush(sock, std::numeric_limits<uint8_t>::max());
+	}
+
+	for (unsigned c = 0; c < SOCKET_TRAFFIC_CLASSES; ++c)
+	{
+		const Socket::TrafficStats &stats = sock->trafficStats[c];
+		if (stats.messages > 0)
+		{
+			debug(LOG_NET, "Socket %s: held back %" PRIu64 " %s messages, average delay %" PRIu64 " ms, max %" PRIu32 " ms", sock->textAddress, stats.messages, socketTrafficClassNames[c], stats.totalDelay / stats.messages, stats.maxDelay);
+		}
+		if (!sock->heldBackWrites[c].empty())
+		{
+			// The connection is broken, so these can't be sent anymore.
+			debug(LOG_NET, "Socket %s: discarding %zu held back %s messages", sock->textAddress, sock->heldBackWrites[c].size(), socketTrafficClassNames[c]);
+			sock->heldBackWrites[c].clear();
+		}
+	}
+
 	wzMutexLock(socketThreadMutex);
 	//Instead of socketThreadWrites.erase(sock);, try sending the data before actually deleting.
 	if (socketThreadWrites.find(sock) != socketThreadWrites.end())
@@ -1693,6 +2099,14 @@ void SOCKETinit()
 		socketThreadQuit = false;
 		socketThreadMutex = wzMutexCreate();
 		socketThreadSemaphore = wzSemaphoreCreate(0);
+#if defined(WZ_NETSOCKET_EPOLL)
+		socketThreadEpollFd = epoll_create1(EPOLL_CLOEXEC);
+		if (socketThreadEpollFd == SOCKET_ERROR)
+		{
+			debug(LOG_NET, "epoll_create1 failed, using select: %s", strSockError(getSockErr()));
+			socketThreadEpollFd = -1;
+		}
+#endif
 		socketThread = wzThreadCreate(socketThreadFunction, nullptr);
 		wzThreadStart(socketThread);
 	}
@@ -1708,6 +2122,14 @@ void SOCKETshutdown()
 		wzMutexUnlock(socketThreadMutex);
 		wzSemaphorePost(socketThreadSemaphore);  // Wake up the thread, so it can quit.
 		wzThreadJoin(socketThread);
+#if defined(WZ_NETSOCKET_EPOLL)
+		if (socketThreadEpollFd >= 0)
+		{
+			close(socketThreadEpollFd);
+			socketThreadEpollFd = -1;
+		}
+		socketThreadEpollSockets.clear();
+#endif
 		wzMutexDestroy(socketThreadMutex);
 		wzSemaphoreDestroy(socketThreadSemaphore);
 		socketThread = nullptr;
@@ -80,6 +80,17 @@ typedef struct addrinfo SocketAddress;
 static const int SOCKET_ERROR = -1;
 #endif
 
+/// Traffic classes of data written to compressed Sockets. Game traffic goes out immediately. The other classes are only held back
+/// by socketFlush while game traffic is waiting to go out, and then share what is left of the connection by weight.
+enum SocketTrafficClass
+{
+	SOCKET_TRAFFIC_GAME,                                                ///< Game queues, pings, lobby state. Never held back.
+	SOCKET_TRAFFIC_CHAT,                                                ///< Text messages.
+	SOCKET_TRAFFIC_BULK,                                                ///< File transfers.
+	SOCKET_TRAFFIC_CLASSES
+};
+
+
 
 // Init/shutdown.
 void SOCKETinit();
@@ -98,7 +109,7 @@ WZ_DECL_NONNULL(1) void deleteSocketAddress(SocketAddress *addr);       ///< Des
 Socket *socketOpen(const SocketAddress *addr, unsigned timeout);        ///< Opens a Socket, using the first address in addr.
 Socket *socketListen(unsigned int port);                                ///< Creates a listen-only Socket, which listens for incoming connections.
 WZ_DECL_NONNULL(1) Socket *socketAccept(Socket *sock);                  ///< Accepts an incoming Socket connection from a listening Socket.
-WZ_DECL_NONNULL(1) void socketClose(Socket *sock);                      ///< Destroys the Socket.
+WZ_DECL_NONNULL(1) void socketClose(Socket *sock);                      ///< Destroys the Socket. Held back chat and bulk messages are flushed out first.
 Socket *socketOpenAny(const SocketAddress *addr, unsigned timeout);     ///< Opens a Socket, using the first address that works in addr.
 WZ_DECL_NONNULL(1) bool socketHasIPv4(const Socket *sock);
 WZ_DECL_NONNULL(1) bool socketHasIPv6(const Socket *sock);
@@ -114,9 +125,12 @@ ssize_t readNoInt(Socket *sock, void *buf, size_t max_size, size_t *rawByteCount
 WZ_DECL_NONNULL(1, 2)
 ssize_t readAll(Socket *sock, void *buf, size_t size, unsigned timeout);///< Reads exactly size bytes from the Socket, or blocks until the timeout expires.
 WZ_DECL_NONNULL(1, 2)
-ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCount = nullptr);  ///< Nonblocking write of size bytes to the Socket. All bytes will be written asynchronously, by a separate thread. Raw count of bytes (after compression) returned in rawByteCount, which will often be 0 until the socket is flushed.
+ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCount = nullptr, SocketTrafficClass trafficClass = SOCKET_TRAFFIC_GAME);  ///< Nonblocking write of size bytes to the Socket. All bytes will be written asynchronously, by a separate thread. Raw count of bytes (after compression) returned in rawByteCount, which will often be 0 until the socket is flushed. On compressed sockets, each call must write a whole message, since messages of different traffic classes may be reordered.
 
 // Sockets, compressed.
+void socketSetCompressionDictionary(std::vector<uint8_t> dictionary);  ///< Sets the preset dictionary, which socketUseCompressionDictionary switches to. Compressed data received is primed with it whenever the other end asks for it.
+uint32_t socketCompressionDictionaryId();                                ///< Checksum of the preset dictionary, for both ends to compare before using it, or 0 if there is none.
+WZ_DECL_NONNULL(1) void socketUseCompressionDictionary(Socket *sock);  ///< Ends the compressed stream sent so far, and continues with a new one primed with the preset dictionary. Only once the other end agreed to use the same dictionary.
 WZ_DECL_NONNULL(1) void socketBeginCompression(Socket *sock); ///< Makes future data sent compressed, and future data received expected to be compressed.
 WZ_DECL_NONNULL(1) bool socketReadDisconnected(Socket *sock);  ///< If readNoInt returned 0, returns true if this is the result of a disconnect, or false if the input compressed data just hasn't produced any output bytes.
 WZ_DECL_NONNULL(1) void socketFlush(Socket *sock, uint8_t player, size_t *rawByteCount = nullptr); ///< Actually sends the data written with writeAll. Only useful on compressed sockets. Note that flushing too often makes compression less effective. Raw count of bytes (after compression) returned in rawByteCount.
@@ -29,6 +29,7 @@
 #include "lib/ivis_opengl/textdraw.h"
 #include <vector>
 #include <functional>
+#include <memory>
 #include <string>
 #include <set>
 #include <nonstd/optional.hpp>
@@ -51,6 +52,7 @@ class StateButton;
 class ListWidget;
 class ScrollBarWidget;
 struct WIDGET_KEYSTATE;
+struct WidgetRenderCache;
 
 /* The display function prototype */
 typedef void (*WIDGET_DISPLAY)(WIDGET *psWidget, UDWORD xOffset, UDWORD yOffset);
@@ -246,7 +248,9 @@ public:
 
 	void show(bool doShow = true)
 	{
-		style = (style & ~WIDG_HIDDEN) | (!doShow * WIDG_HIDDEN);
+		UDWORD newStyle = (style & ~WIDG_HIDDEN) | (!doShow * WIDG_HIDDEN);
+		dirty = dirty || newStyle != style;
+		style = newStyle;
 	}
 	void hide()
 	{
@@ -422,11 +426,24 @@ public:
 		WidgetGraphicsContext context;
 		displayRecursive(context);
 	}
+	/** Draw this widget and its children into an offscreen copy, and only draw them again when one of them is dirty,
+	 *  the widget moved, or refreshInterval milliseconds passed (0 for never). Widgets whose looks change without setting
+	 *  dirty (animations, values polled while displaying) must either set dirty themselves or rely on refreshInterval.
+	 *  Children must lie within this widget's rectangle.
+	 *  Backends without offscreen targets just keep drawing directly.
+	 */
+	void setCacheRendering(bool enabled, uint32_t refreshInterval = 0);
 	static void processMouseDragEvent(const W_CONTEXT &sContext, WIDGET_KEY wkey, WIDGET_KEYSTATE* pState, bool alsoTriggerReleased);
 
 private:
+	void displaySubtree(WidgetGraphicsContext const &context);
+	bool displayRecursiveCached(WidgetGraphicsContext const &context);
+	bool subtreeDirty() const;
+	void clearSubtreeDirty();
+
 	std::weak_ptr<WIDGET> parentWidget;
 	std::vector<std::shared_ptr<WIDGET>> childWidgets;
+	std::unique_ptr<WidgetRenderCache> renderCache;
 
 	WzRect                  dim;
 	bool					isTransparentToClicks = false;
@@ -30,6 +30,7 @@
 #include "lib/ivis_opengl/screen.h"
 #include "lib/netplay/netplay.h"
 #include "lib/gamelib/gtime.h"
+#include "lib/ivis_opengl/pieclip.h"
 
 #include "widget.h"
 
@@ -48,9 +49,20 @@
 #include "tip.h"
 
 #include <algorithm>
+#include <cmath>
 #include <unordered_set>
 #include <deque>
 
+/// Offscreen copy of a widget subtree, see WIDGET::setCacheRendering()
+struct WidgetRenderCache
+{
+	std::unique_ptr<gfx_api::render_target> target;
+	WzRect screenRect;              ///< Where the copy was drawn from, in screen coordinates
+	uint32_t refreshInterval = 0;
+	uint32_t lastRendered = 0;      ///< realTime of the last time the copy was drawn
+	bool valid = false;
+};
+
 static	bool	bWidgetsInitialized = false;
 static	bool	bWidgetsActive = true;
 
@@ -604,6 +616,7 @@ void WIDGET::attach(const std::shared_ptr<WIDGET> &widget, ChildZPos zPos /*= Ch
 		childWidgets.insert(childWidgets.begin(), widget);
 		break;
 	}
+	dirty = true;
 }
 
 void WIDGET::detach(const std::shared_ptr<WIDGET> &widget)
@@ -618,6 +631,7 @@ void WIDGET::detach(const std::shared_ptr<WIDGET> &widget)
 	{
 		childWidgets.erase(it);
 	}
+	dirty = true;
 
 	widgetLost(widget.get());
 }
@@ -1492,7 +1506,109 @@ void W_SCREEN::setReturn(const std::shared_ptr<WIDGET> &psWidget)
 	retWidgets.push_back(trigger);
 }
 
+void WIDGET::setCacheRendering(bool enabled, uint32_t refreshInterval)
+{
+	if (!enabled)
+	{
+		renderCache.reset();
+		return;
+	}
+	if (renderCache == nullptr)
+	{
+		renderCache = std::unique_ptr<WidgetRenderCache>(new WidgetRenderCache());
+	}
+	renderCache->refreshInterval = refreshInterval;
+	renderCache->valid = false;
+}
+
+bool WIDGET::subtreeDirty() const
+{
+	if (dirty)
+	{
+		return true;
+	}
+	for (auto const &child : childWidgets)
+	{
+		if (child->subtreeDirty())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void WIDGET::clearSubtreeDirty()
+{
+	dirty = false;
+	for (auto const &child : childWidgets)
+	{
+		child->clearSubtreeDirty();
+	}
+}
+
+/// Draws the subtree from its offscreen copy, drawing the copy again first if needed.
+/// Returns false if there's no copy to use, in which case the subtree should be drawn directly.
+bool WIDGET::displayRecursiveCached(WidgetGraphicsContext const &context)
+{
+	if (!context.clipContains(geometry()) || width() <= 0 || height() <= 0)
+	{
+		return false;
+	}
+	auto &gfx = gfx_api::context::get();
+
+	// Widgets are laid out in screen coordinates, render targets are in drawable pixels
+	const auto drawable = gfx.getDrawableDimensions();
+	const float scaleX = static_cast<float>(drawable.first) / pie_GetVideoBufferWidth();
+	const float scaleY = static_cast<float>(drawable.second) / pie_GetVideoBufferHeight();
+	const WzRect screenRect(context.getXOffset() + x(), context.getYOffset() + y(), width(), height());
+	const int32_t targetX = static_cast<int32_t>(std::floor(screenRect.left() * scaleX));
+	const int32_t targetY = static_cast<int32_t>(std::floor(screenRect.top() * scaleY));
+	const size_t targetWidth = static_cast<size_t>(std::ceil(screenRect.right() * scaleX) - targetX);
+	const size_t targetHeight = static_cast<size_t>(std::ceil(screenRect.bottom() * scaleY) - targetY);
+
+	WidgetRenderCache &cache = *renderCache;
+	if (cache.target == nullptr || cache.target->width() != targetWidth || cache.target->height() != targetHeight)
+	{
+		cache.target.reset(gfx.create_render_target(targetWidth, targetHeight, "<widget cache>"));
+		cache.valid = false;
+		if (cache.target == nullptr)
+		{
+			renderCache.reset();  // Not supported, or out of memory. Don't try again.
+			return false;
+		}
+	}
+
+	bool refresh = !cache.valid || !(cache.screenRect == screenRect) || subtreeDirty();
+	refresh = refresh || (cache.refreshInterval != 0 && realTime - cache.lastRendered >= cache.refreshInterval);
+	if (refresh)
+	{
+		if (!gfx.beginRenderTarget(cache.target.get(), targetX, targetY))
+		{
+			return false;
+		}
+		// Clear first, so whatever sets dirty while being displayed (e.g. animations) is drawn again next frame
+		clearSubtreeDirty();
+		displaySubtree(context);
+		gfx.endRenderTarget();
+		cache.screenRect = screenRect;
+		cache.lastRendered = realTime;
+		cache.valid = true;
+	}
+
+	iV_DrawRenderTarget(*cache.target, targetX / scaleX, targetY / scaleY, targetWidth / scaleX, targetHeight / scaleY);
+	return true;
+}
+
 void WIDGET::displayRecursive(WidgetGraphicsContext const &context)
+{
+	if (renderCache != nullptr && !debugBoundingBoxesOnly && displayRecursiveCached(context))
+	{
+		return;
+	}
+	displaySubtree(context);
+}
+
+void WIDGET::displaySubtree(WidgetGraphicsContext const &context)
 {
 	bool widgetIsClipped = !context.clipContains(geometry());
 
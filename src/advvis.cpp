@@ -28,6 +28,8 @@
 #include "advvis.h"
 #include "profiling.h"
 #include "map.h"
+#include "terrain.h"
+#include "wrappers.h"
 
 // ------------------------------------------------------------------------------------
 #define FADE_IN_TIME	(GAME_TICKS_PER_SEC/10)
@@ -62,6 +64,8 @@ void	avUpdateTiles()
 	MAPTILE *psTile;
 
 	PlayerMask playerAllianceBits = (selectedPlayer < MAX_PLAYER_SLOTS) ? alliancebits[selectedPlayer] : 0;
+	// Tiles whose level changed, for the lightmap
+	int changedX1 = mapWidth, changedY1 = mapHeight, changedX2 = 0, changedY2 = 0;
 
 	/* Go through the tiles */
 	for (; i < len; i++)
@@ -76,16 +80,27 @@ void	avUpdateTiles()
 			{
 				maxLevel /= 2;
 			}
+			if (psTile->level == maxLevel)
+			{
+				continue;
+			}
 			if (psTile->level > maxLevel)
 			{
 				psTile->level = MAX(psTile->level - increment, maxLevel);
 			}
-			else if (psTile->level < maxLevel)
+			else
 			{
 				psTile->level = MIN(psTile->level + increment, maxLevel);
 			}
+
+			const int x = i % mapWidth, y = i / mapWidth;
+			changedX1 = MIN(changedX1, x);
+			changedY1 = MIN(changedY1, y);
+			changedX2 = MAX(changedX2, x + 1);
+			changedY2 = MAX(changedY2, y + 1);
 		}
 	}
+	markLightmapDirty(changedX1, changedY1, changedX2, changedY2);
 }
 
 // ------------------------------------------------------------------------------------
@@ -119,6 +134,11 @@ void	setRevealStatus(bool val)
 // ------------------------------------------------------------------------------------
 void	preProcessVisibility()
 {
+	if (skipDisplayOnlyWork())
+	{
+		return;
+	}
+
 	for (int i = 0; i < mapWidth; i++)
 	{
 		for (int j = 0; j < mapHeight; j++)
@@ -24,6 +24,7 @@
 */
 
 #include "lib/framework/frame.h"
+#include "lib/ivis_opengl/piedraw.h"
 #include "lib/ivis_opengl/piematrix.h"
 #include "lib/ivis_opengl/piepalette.h"
 
@@ -36,6 +37,7 @@
 #include "profiling.h"
 #include "lib/gamelib/gtime.h"
 #include <cmath>
+#include <vector>
 
 #ifndef GLM_ENABLE_EXPERIMENTAL
 	#define GLM_ENABLE_EXPERIMENTAL
@@ -48,6 +50,7 @@
 // -----------------------------------------------------------------------------
 /* Roughly one per tile */
 #define	MAX_ATMOS_PARTICLES		(MAP_MAXWIDTH * MAP_MAXHEIGHT)
+#define	ATMOS_PARTICLES_RESERVE	4096
 #define	SNOW_SPEED_DRIFT		(40 - rand() % 80)
 #define SNOW_SPEED_FALL			(0 - (rand() % 40 + 80))
 #define	RAIN_SPEED_DRIFT		(rand() % 50)
@@ -59,189 +62,203 @@ enum AP_TYPE
 	AP_SNOW
 };
 
-enum AP_STATUS
+/** The active particles, packed at the front of parallel arrays.
+ *  Dead particles are swapped out with the last one, so update and render loops never see inactive slots,
+ *  and the per-component arrays keep the movement loops simple enough for the compiler to vectorise.
+ */
+struct ATMOS_PARTICLES
 {
-	APS_INACTIVE,
-	APS_ACTIVE
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> velX, velY, velZ;
+	std::vector<UBYTE> type;
+
+	size_t size() const
+	{
+		return type.size();
+	}
+
+	void reserve(size_t count)
+	{
+		posX.reserve(count); posY.reserve(count); posZ.reserve(count);
+		velX.reserve(count); velY.reserve(count); velZ.reserve(count);
+		type.reserve(count);
+	}
+
+	void clear()
+	{
+		posX.clear(); posY.clear(); posZ.clear();
+		velX.clear(); velY.clear(); velZ.clear();
+		type.clear();
+	}
+
+	void release()
+	{
+		clear();
+		posX.shrink_to_fit(); posY.shrink_to_fit(); posZ.shrink_to_fit();
+		velX.shrink_to_fit(); velY.shrink_to_fit(); velZ.shrink_to_fit();
+		type.shrink_to_fit();
+	}
+
+	void add(const Vector3f &pos, const Vector3f &vel, UBYTE particleType)
+	{
+		posX.push_back(pos.x); posY.push_back(pos.y); posZ.push_back(pos.z);
+		velX.push_back(vel.x); velY.push_back(vel.y); velZ.push_back(vel.z);
+		type.push_back(particleType);
+	}
+
+	/// Removes particle i, by moving the last particle into its place.
+	void remove(size_t i)
+	{
+		const size_t last = size() - 1;
+		posX[i] = posX[last]; posY[i] = posY[last]; posZ[i] = posZ[last];
+		velX[i] = velX[last]; velY[i] = velY[last]; velZ[i] = velZ[last];
+		type[i] = type[last];
+		posX.pop_back(); posY.pop_back(); posZ.pop_back();
+		velX.pop_back(); velY.pop_back(); velZ.pop_back();
+		type.pop_back();
+	}
 };
 
-static ATPART	*asAtmosParts = nullptr;
-static UDWORD	freeParticle;
+static ATMOS_PARTICLES	atmosParts;
 static WT_CLASS	weather = WT_NONE;
 
 /* Setup all the particles */
 void atmosInitSystem()
 {
-	if (!asAtmosParts && weather != WT_NONE)
+	if (weather != WT_NONE)
 	{
-		// calloc sets all to APS_INACTIVE initially
-		asAtmosParts = (ATPART *)calloc(MAX_ATMOS_PARTICLES, sizeof(*asAtmosParts));
+		// Only live particles are stored, so this is typically far less than MAX_ATMOS_PARTICLES
+		atmosParts.reserve(ATMOS_PARTICLES_RESERVE);
 	}
-	/* Start at the beginning */
-	freeParticle = 0;
 }
 
-/*	Makes a particle wrap around - if it goes off the grid, then it returns
-	on the other side - provided it's still on world... Which it should be */
-static void testParticleWrap(ATPART *psPart)
+/* Size (in percent) of each particle type */
+static UDWORD particleSize(UBYTE type)
 {
-	/* Gone off left side */
-	if (psPart->position.x < playerPos.p.x - world_coord(visibleTiles.x) / 2)
-	{
-		psPart->position.x += world_coord(visibleTiles.x);
-	}
+	return (type == AP_SNOW) ? 80 : 50;
+}
 
-	/* Gone off right side */
-	else if (psPart->position.x > (playerPos.p.x + world_coord(visibleTiles.x) / 2))
+static iIMDBaseShape *particleImd(UBYTE type)
+{
+	return getImdFromIndex((type == AP_SNOW) ? MI_SNOW : MI_RAIN);
+}
+
+/*	Makes particles wrap around - if they go off the grid, then they return
+	on the other side - provided they're still on world... Which they should be */
+static void wrapParticles(std::vector<float> &coord, float centre, float extent)
+{
+	const float minCoord = centre - extent / 2;
+	const float maxCoord = centre + extent / 2;
+	float *c = coord.data();
+	const size_t count = coord.size();
+	for (size_t i = 0; i < count; ++i)
 	{
-		psPart->position.x -= world_coord(visibleTiles.x);
+		/* Gone off one side, or the other */
+		c[i] += (c[i] < minCoord) ? extent : (c[i] > maxCoord) ? -extent : 0.f;
 	}
+}
 
-	/* Gone off top */
-	if (psPart->position.z < playerPos.p.z - world_coord(visibleTiles.y) / 2)
+/* Moves all the particles, and kills off any which hit the ground or leave the world */
+static void processParticles()
+{
+	/* Only move if the game isn't paused */
+	if (gamePaused())
 	{
-		psPart->position.z += world_coord(visibleTiles.y);
+		return;
 	}
 
-	/* Gone off bottom */
-	else if (psPart->position.z > (playerPos.p.z + world_coord(visibleTiles.y) / 2))
+	const size_t count = atmosParts.size();
+	float *posX = atmosParts.posX.data(), *posY = atmosParts.posY.data(), *posZ = atmosParts.posZ.data();
+	const float *velX = atmosParts.velX.data(), *velY = atmosParts.velY.data(), *velZ = atmosParts.velZ.data();
+
+	/* Move the particles - frame rate controlled */
+	const float timeFraction = graphicsTimeAdjustedIncrement(1.f);
+	for (size_t i = 0; i < count; ++i)
 	{
-		psPart->position.z -= world_coord(visibleTiles.y);
+		posX[i] += velX[i] * timeFraction;
+		posY[i] += velY[i] * timeFraction;
+		posZ[i] += velZ[i] * timeFraction;
 	}
-}
 
-/* Moves one of the particles */
-static void processParticle(ATPART *psPart)
-{
-	SDWORD	groundHeight;
-	Vector3i pos;
-	UDWORD	x, y;
-	MAPTILE	*psTile;
+	/* Wrap them around if they've gone off grid... */
+	wrapParticles(atmosParts.posX, playerPos.p.x, world_coord(visibleTiles.x));
+	wrapParticles(atmosParts.posZ, playerPos.p.z, world_coord(visibleTiles.y));
 
-	/* Only move if the game isn't paused */
-	if (!gamePaused())
+	const float maxX = (mapWidth - 1) * TILE_UNITS;
+	const float maxZ = (mapHeight - 1) * TILE_UNITS;
+	for (size_t i = 0; i < atmosParts.size();)
 	{
-		/* Move the particle - frame rate controlled */
-		psPart->position.x += graphicsTimeAdjustedIncrement(psPart->velocity.x);
-		psPart->position.y += graphicsTimeAdjustedIncrement(psPart->velocity.y);
-		psPart->position.z += graphicsTimeAdjustedIncrement(psPart->velocity.z);
-
-		/* Wrap it around if it's gone off grid... */
-		testParticleWrap(psPart);
+		const float x = atmosParts.posX[i], y = atmosParts.posY[i], z = atmosParts.posZ[i];
 
 		/* If it's gone off the WORLD... */
-		if (psPart->position.x < 0 || psPart->position.z < 0 ||
-		    psPart->position.x > ((mapWidth - 1)*TILE_UNITS) ||
-		    psPart->position.z > ((mapHeight - 1)*TILE_UNITS))
+		if (x < 0 || z < 0 || x > maxX || z > maxZ)
 		{
 			/* The kill it */
-			psPart->status = APS_INACTIVE;
-			return;
+			atmosParts.remove(i);
+			continue;
 		}
 
 		/* What height is the ground under it? Only do if low enough...*/
-		if (psPart->position.y < TILE_MAX_HEIGHT)
+		if (y < TILE_MAX_HEIGHT)
 		{
 			/* Get ground height */
-			groundHeight = map_Height(static_cast<int>(psPart->position.x), static_cast<int>(psPart->position.z));
+			SDWORD groundHeight = map_Height(static_cast<int>(x), static_cast<int>(z));
 
 			/* Are we below ground? */
-			if ((int)psPart->position.y < groundHeight
-			    || psPart->position.y < 0.f)
+			if ((int)y < groundHeight || y < 0.f)
 			{
-				/* Kill it and return */
-				psPart->status = APS_INACTIVE;
-				if (psPart->type == AP_RAIN)
+				if (atmosParts.type[i] == AP_RAIN)
 				{
-					x = map_coord(static_cast<int32_t>(psPart->position.x));
-					y = map_coord(static_cast<int32_t>(psPart->position.z));
-					psTile = mapTile(x, y);
+					MAPTILE *psTile = mapTile(map_coord(static_cast<int32_t>(x)), map_coord(static_cast<int32_t>(z)));
 					if (terrainType(psTile) == TER_WATER && TEST_TILE_VISIBLE_TO_SELECTEDPLAYER(psTile)) // display-only check for adding effect
 					{
-						pos.x = static_cast<int>(psPart->position.x);
-						pos.z = static_cast<int>(psPart->position.z);
+						Vector3i pos;
+						pos.x = static_cast<int>(x);
+						pos.z = static_cast<int>(z);
 						pos.y = groundHeight;
 						effectSetSize(60);
 						addEffect(&pos, EFFECT_EXPLOSION, EXPLOSION_TYPE_SPECIFIED, true, getDisplayImdFromIndex(MI_SPLASH), 0);
 					}
 				}
-				return;
+				/* Kill it */
+				atmosParts.remove(i);
+				continue;
 			}
 		}
-		if (psPart->type == AP_SNOW)
+
+		if (atmosParts.type[i] == AP_SNOW)
 		{
 			if (rand() % 30 == 1)
 			{
-				psPart->velocity.z = (float)SNOW_SPEED_DRIFT;
+				atmosParts.velZ[i] = (float)SNOW_SPEED_DRIFT;
 			}
 			if (rand() % 30 == 1)
 			{
-				psPart->velocity.x = (float)SNOW_SPEED_DRIFT;
+				atmosParts.velX[i] = (float)SNOW_SPEED_DRIFT;
 			}
 		}
+		++i;
 	}
 }
 
 /* Adds a particle to the system if it can */
 static void atmosAddParticle(const Vector3f &pos, AP_TYPE type)
 {
-	UDWORD	activeCount;
-	UDWORD	i;
-
-	for (i = freeParticle, activeCount = 0; asAtmosParts[i].status == APS_ACTIVE && activeCount < MAX_ATMOS_PARTICLES; i++)
-	{
-		activeCount++;
-		/* Check for wrap around */
-		if (i >= (MAX_ATMOS_PARTICLES - 1))
-		{
-			/* Go back to the first one */
-			i = 0;
-		}
-	}
-
-	/* Check the list isn't just full of essential effects */
-	if (activeCount >= MAX_ATMOS_PARTICLES - 1)
+	/* Check the list isn't full */
+	if (atmosParts.size() >= MAX_ATMOS_PARTICLES - 1)
 	{
 		/* All of the particles active!?!? */
 		return;
 	}
-	else
-	{
-		freeParticle = i;
-	}
-
-	/* Record it's type */
-	asAtmosParts[freeParticle].type = (UBYTE)type;
-
-	/* Make it active */
-	asAtmosParts[freeParticle].status = APS_ACTIVE;
-
-	/* Setup the imd */
-	switch (type)
-	{
-	case AP_SNOW:
-		asAtmosParts[freeParticle].imd = getImdFromIndex(MI_SNOW);
-		asAtmosParts[freeParticle].size = 80;
-		break;
-	case AP_RAIN:
-		asAtmosParts[freeParticle].imd = getImdFromIndex(MI_RAIN);
-		asAtmosParts[freeParticle].size = 50;
-		break;
-	default:
-		break;
-	}
-
-	/* Setup position */
-	asAtmosParts[freeParticle].position = pos;
 
 	/* Setup its velocity */
 	if (type == AP_RAIN)
 	{
-		asAtmosParts[freeParticle].velocity = Vector3f(RAIN_SPEED_DRIFT, RAIN_SPEED_FALL, RAIN_SPEED_DRIFT);
+		atmosParts.add(pos, Vector3f(RAIN_SPEED_DRIFT, RAIN_SPEED_FALL, RAIN_SPEED_DRIFT), type);
 	}
 	else
 	{
-		asAtmosParts[freeParticle].velocity = Vector3f(SNOW_SPEED_DRIFT, SNOW_SPEED_FALL, SNOW_SPEED_DRIFT);
+		atmosParts.add(pos, Vector3f(SNOW_SPEED_DRIFT, SNOW_SPEED_FALL, SNOW_SPEED_DRIFT), type);
 	}
 }
 
@@ -256,14 +273,7 @@ void atmosUpdateSystem()
 	// we don't want to do any of this while paused.
 	if (!gamePaused() && weather != WT_NONE)
 	{
-		for (i = 0; i < MAX_ATMOS_PARTICLES; i++)
-		{
-			/* See if it's active */
-			if (asAtmosParts[i].status == APS_ACTIVE)
-			{
-				processParticle(&asAtmosParts[i]);
-			}
-		}
+		processParticles();
 
 		// The original code added a fixed number of particles per tick. To take into account game speed
 		// we have to accumulate a fractional number of particles to add them at a slower or faster rate.
@@ -327,34 +337,44 @@ static inline void renderParticleInternal(ATPART *psPart, const glm::mat4 &viewM
 void atmosDrawParticles(const glm::mat4 &viewMatrix, const glm::mat4 &perspectiveViewMatrix)
 {
 	WZ_PROFILE_SCOPE(atmosDrawParticles);
-	UDWORD	i;
 
-	if (weather == WT_NONE)
+	if (weather == WT_NONE || atmosParts.size() == 0)
 	{
 		return;
 	}
 
 	const glm::mat4 rotateMatrix = glm::rotate(UNDEG(-playerPos.r.y), glm::vec3(0.f, 1.f, 0.f)) *
 		glm::rotate(UNDEG(-playerPos.r.x), glm::vec3(0.f, 1.f, 0.f));
-	glm::mat4 rotateScaleMatrix = rotateMatrix;
-	UDWORD last_particle_size = 0;
 
-	/* Traverse the list */
-	for (i = 0; i < MAX_ATMOS_PARTICLES; i++)
+	// Gather the visible particles of each type, then queue each type as a single batch of instances.
+	static std::vector<PIE_SHAPE_INSTANCE> instances[2];
+	for (UBYTE type = AP_RAIN; type <= AP_SNOW; ++type)
 	{
-		/* Don't bother unless it's active */
-		if (asAtmosParts[i].status == APS_ACTIVE)
+		instances[type].clear();
+	}
+	const glm::mat4 rotateScaleMatrices[2] = {
+		rotateMatrix * glm::scale(glm::vec3(particleSize(AP_RAIN) / 100.f)),
+		rotateMatrix * glm::scale(glm::vec3(particleSize(AP_SNOW) / 100.f))
+	};
+
+	const size_t count = atmosParts.size();
+	for (size_t i = 0; i < count; ++i)
+	{
+		/* Is it visible on the screen? */
+		if (clipXYZ(static_cast<int>(atmosParts.posX[i]), static_cast<int>(atmosParts.posZ[i]), static_cast<int>(atmosParts.posY[i]), perspectiveViewMatrix))
 		{
-			/* Is it visible on the screen? */
-			if (clipXYZ(static_cast<int>(asAtmosParts[i].position.x), static_cast<int>(asAtmosParts[i].position.z), static_cast<int>(asAtmosParts[i].position.y), perspectiveViewMatrix))
-			{
-				if (last_particle_size != asAtmosParts[i].size)
-				{
-					rotateScaleMatrix = rotateMatrix * glm::scale(glm::vec3(asAtmosParts[i].size / 100.f));
-					last_particle_size = asAtmosParts[i].size;
-				}
-				renderParticleInternal(&asAtmosParts[i], viewMatrix, rotateScaleMatrix);
-			}
+			const UBYTE type = atmosParts.type[i];
+			/* Make it face camera, and scale it... */
+			instances[type].push_back({glm::translate(glm::vec3(atmosParts.posX[i], atmosParts.posY[i], -atmosParts.posZ[i])) * rotateScaleMatrices[type], WZCOL_WHITE, 0, 0});
+		}
+	}
+
+	/* Draw them... */
+	for (UBYTE type = AP_RAIN; type <= AP_SNOW; ++type)
+	{
+		if (!instances[type].empty())
+		{
+			pie_Draw3DShapeInstances(particleImd(type)->displayModel(), 0, 0, instances[type].data(), instances[type].size(), viewMatrix);
 		}
 	}
 }
@@ -374,10 +394,9 @@ void atmosSetWeatherType(WT_CLASS type)
 		weather = type;
 		atmosInitSystem();
 	}
-	if (type == WT_NONE && asAtmosParts)
+	if (type == WT_NONE)
 	{
-		free(asAtmosParts);
-		asAtmosParts = nullptr;
+		atmosParts.release();
 	}
 }
 
@@ -0,0 +1,176 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2024  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file benchmark.cpp
+ *
+ * Renders a fixed camera path over the loaded game, and reports how long each frame took.
+ */
+
+#include "lib/framework/frame.h"
+#include "lib/framework/file.h"
+#include "lib/framework/wzapp.h"
+#include "lib/gamelib/gtime.h"
+#include "lib/ivis_opengl/gfx_api.h"
+
+#include "benchmark.h"
+#include "display.h"
+#include "display3d.h"
+#include "map.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Frames rendered before measuring, so texture loading and first-use caches settle
+#define BENCHMARK_WARMUP_FRAMES	30
+
+struct BenchmarkFrame
+{
+	double cpuMs;
+	optional<gfx_api::frame_stats> stats;
+};
+
+static size_t benchmarkFrames = 0;          ///< Measured frames wanted, 0 if not benchmarking
+static size_t benchmarkFrameNum = 0;        ///< Frames rendered so far, including warm-up
+static bool benchmarkFinished = false;
+static std::chrono::steady_clock::time_point benchmarkFrameStart;
+static std::vector<BenchmarkFrame> benchmarkResults;
+
+void benchmarkSetFrames(size_t frames)
+{
+	benchmarkFrames = frames;
+}
+
+bool benchmarkEnabled()
+{
+	return benchmarkFrames > 0;
+}
+
+static void benchmarkStart()
+{
+	gameTimeStop();  // Render the same scene every run, without the game moving under the camera.
+	gfx_api::context::get().setSwapInterval(gfx_api::context::swap_interval_mode::immediate);
+	gfx_api::context::get().setHeadlessDrawing(true);
+	setViewDistance(STARTDISTANCE);
+	playerPos.r.x = DEG(360 + INITIAL_STARTING_PITCH);
+	benchmarkResults.reserve(benchmarkFrames);
+	debug(LOG_INFO, "Benchmarking %zu frames", benchmarkFrames);
+}
+
+/// Orbits the centre of the visible map once over the whole run, looking along the path.
+static void benchmarkSetCamera()
+{
+	const size_t totalFrames = BENCHMARK_WARMUP_FRAMES + benchmarkFrames;
+	const float angle = 2.f * (float)M_PI * benchmarkFrameNum / totalFrames;
+	const float centreX = (scrollMinX + scrollMaxX) / 2.f;
+	const float centreY = (scrollMinY + scrollMaxY) / 2.f;
+	const float radius = std::min(scrollMaxX - scrollMinX, scrollMaxY - scrollMinY) / 4.f;
+
+	setViewPos((UDWORD)(centreX + radius * std::cos(angle)), (UDWORD)(centreY + radius * std::sin(angle)), false);
+	playerPos.r.y = DEG(360) - (int)(angle * (DEG(360) / (2.f * (float)M_PI)));
+}
+
+static void benchmarkReport()
+{
+	std::vector<double> times;
+	times.reserve(benchmarkResults.size());
+	double total = 0;
+	gfx_api::frame_stats statsTotal;
+	size_t statsFrames = 0;
+	for (const BenchmarkFrame &frame : benchmarkResults)
+	{
+		times.push_back(frame.cpuMs);
+		total += frame.cpuMs;
+		if (frame.stats.has_value())
+		{
+			statsTotal.drawCalls += frame.stats->drawCalls;
+			statsTotal.pipelineBinds += frame.stats->pipelineBinds;
+			statsTotal.bufferUploads += frame.stats->bufferUploads;
+			statsTotal.bufferUploadBytes += frame.stats->bufferUploadBytes;
+			statsTotal.textureUploads += frame.stats->textureUploads;
+			statsTotal.textureUploadBytes += frame.stats->textureUploadBytes;
+			++statsFrames;
+		}
+	}
+	std::sort(times.begin(), times.end());
+	auto percentile = [&times](double p) { return times[std::min(times.size() - 1, (size_t)(p * times.size()))]; };
+
+	fprintf(stdout, "--------------------------------------------------------------------------------------\n");
+	fprintf(stdout, " * Benchmark: %zu frames\n", times.size());
+	fprintf(stdout, " * Frame CPU time (ms): mean %.3f | median %.3f | p95 %.3f | p99 %.3f | max %.3f\n", total / times.size(), percentile(0.5), percentile(0.95), percentile(0.99), times.back());
+	if (statsFrames > 0)
+	{
+		fprintf(stdout, " * Per frame: %.1f draw calls | %.1f pipeline binds | %.1f buffer uploads (%.1f KiB) | %.1f texture uploads (%.1f KiB)\n",
+		        (double)statsTotal.drawCalls / statsFrames, (double)statsTotal.pipelineBinds / statsFrames,
+		        (double)statsTotal.bufferUploads / statsFrames, statsTotal.bufferUploadBytes / 1024.0 / statsFrames,
+		        (double)statsTotal.textureUploads / statsFrames, statsTotal.textureUploadBytes / 1024.0 / statsFrames);
+	}
+	fprintf(stdout, "--------------------------------------------------------------------------------------\n");
+	fflush(stdout);
+
+	std::string csv = "frame,cpu_ms,draw_calls,pipeline_binds,buffer_uploads,buffer_upload_bytes,texture_uploads,texture_upload_bytes\n";
+	for (size_t i = 0; i < benchmarkResults.size(); ++i)
+	{
+		const BenchmarkFrame &frame = benchmarkResults[i];
+		const gfx_api::frame_stats stats = frame.stats.value_or(gfx_api::frame_stats());
+		csv += astringf("%zu,%.4f,%zu,%zu,%zu,%zu,%zu,%zu\n", i, frame.cpuMs, stats.drawCalls, stats.pipelineBinds, stats.bufferUploads, stats.bufferUploadBytes, stats.textureUploads, stats.textureUploadBytes);
+	}
+	if (!saveFile("logs/benchmark.csv", csv.c_str(), csv.size()))
+	{
+		debug(LOG_ERROR, "Failed to write logs/benchmark.csv");
+	}
+}
+
+void benchmarkFrameBegin()
+{
+	if (!benchmarkEnabled() || benchmarkFinished)
+	{
+		return;
+	}
+	if (benchmarkFrameNum == 0)
+	{
+		benchmarkStart();
+	}
+	benchmarkSetCamera();
+	benchmarkFrameStart = std::chrono::steady_clock::now();
+}
+
+void benchmarkFrameEnd()
+{
+	if (!benchmarkEnabled() || benchmarkFinished)
+	{
+		return;
+	}
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - benchmarkFrameStart;
+	if (benchmarkFrameNum++ < BENCHMARK_WARMUP_FRAMES)
+	{
+		return;
+	}
+	benchmarkResults.push_back({elapsed.count(), gfx_api::context::get().getLastFrameStats()});
+	if (benchmarkResults.size() >= benchmarkFrames)
+	{
+		benchmarkFinished = true;
+		benchmarkReport();
+		benchmarkResults.clear();
+		wzQuit(0);
+	}
+}
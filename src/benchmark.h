@@ -0,0 +1,37 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2024  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef __INCLUDED_SRC_BENCHMARK_H__
+#define __INCLUDED_SRC_BENCHMARK_H__
+
+#include <cstddef>
+
+/** Render benchmark (--benchmark). Once a game has been loaded, the game time is frozen and the
+ *  camera flies a fixed orbit around the map for the requested number of frames. Per-frame CPU
+ *  time, and the backend's draw statistics (if it counts them, like the null backend used in
+ *  headless mode), are then printed to stdout and written to logs/benchmark.csv, and the game quits.
+ */
+void benchmarkSetFrames(size_t frames);
+bool benchmarkEnabled();
+
+/// Call right before / after rendering a frame in the game loop.
+void benchmarkFrameBegin();
+void benchmarkFrameEnd();
+
+#endif // __INCLUDED_SRC_BENCHMARK_H__
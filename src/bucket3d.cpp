@@ -37,7 +37,7 @@
 #include "profiling.h"
 #include "droid.h"
 
-#include <algorithm>
+#include "lib/ivis_opengl/3rdparty/ska_sort.hpp"
 
 #define CLIP_LEFT	((SDWORD)0)
 #define CLIP_RIGHT	((SDWORD)pie_GetVideoBufferWidth())
@@ -47,20 +47,50 @@
 // someone needs to take a good look at the radius calculation
 #define SCALE_DEPTH (FP12_MULTIPLIER*7)
 
-struct BUCKET_TAG
+/*
+ * Render order is encoded in a single 64-bit key, so the list can be radix sorted.
+ * From the most significant bit down:
+ *   [63..62] pass    - BUCKET_PASS_BATCHED first, then BUCKET_PASS_DEPTH
+ *   [61..56] type    - RENDER_TYPE (batched pass only)
+ *   [55..32] texture - texture page of the model (batched pass only)
+ *   [31..0]  depth   - front to back in the batched pass, back to front in the depth pass
+ */
+enum BUCKET_PASS
 {
-	bool operator <(BUCKET_TAG const &b) const
-	{
-		return actualZ > b.actualZ;    // Sort in reverse z order.
-	}
+	BUCKET_PASS_BATCHED,	///< Objects whose draw order does not matter, grouped by state
+	BUCKET_PASS_DEPTH,	///< Blended objects, which must be drawn back to front
+};
+
+#define BUCKET_KEY_PASS_SHIFT		62
+#define BUCKET_KEY_TYPE_SHIFT		56
+#define BUCKET_KEY_TYPE_MASK		0x3F
+#define BUCKET_KEY_TEXTURE_SHIFT	32
+#define BUCKET_KEY_TEXTURE_MASK		0xFFFFFF
+// Texture slot used by effects which don't have a model texture to group by
+#define BUCKET_KEY_TEXTURE_EFFECT	42
 
+struct BUCKET_TAG
+{
 	RENDER_TYPE     objectType; //type of object held
 	void           *pObject;    //pointer to the object
-	int32_t         actualZ;
+	uint64_t        sortKey;    //render order, see above
 };
 
 static std::vector<BUCKET_TAG> bucketArray;
 
+static uint64_t bucketBatchedKey(RENDER_TYPE objectType, size_t texpage, int32_t z)
+{
+	return ((uint64_t)BUCKET_PASS_BATCHED << BUCKET_KEY_PASS_SHIFT)
+	       | ((uint64_t)(objectType & BUCKET_KEY_TYPE_MASK) << BUCKET_KEY_TYPE_SHIFT)
+	       | ((uint64_t)(texpage & BUCKET_KEY_TEXTURE_MASK) << BUCKET_KEY_TEXTURE_SHIFT)
+	       | (uint32_t)z;
+}
+
+static uint64_t bucketDepthKey(int32_t z)
+{
+	return ((uint64_t)BUCKET_PASS_DEPTH << BUCKET_KEY_PASS_SHIFT) | (UINT32_MAX - (uint32_t)z);
+}
+
 static SDWORD bucketCalculateZ(RENDER_TYPE objectType, void *pObject, const glm::mat4 &perspectiveViewMatrix)
 {
 	SDWORD				z = 0, radius;
@@ -327,6 +357,10 @@ void bucketAddTypeToList(RENDER_TYPE objectType, void *pObject, const glm::mat4
 		return;
 	}
 
+	//put the object data into the tag
+	newTag.objectType = objectType;
+	newTag.pObject = pObject;
+
 	switch (objectType)
 	{
 	case RENDER_EFFECT:
@@ -337,48 +371,46 @@ void bucketAddTypeToList(RENDER_TYPE objectType, void *pObject, const glm::mat4
 		case EFFECT_SMOKE:
 		case EFFECT_FIREWORK:
 			// Use calculated Z
+			newTag.sortKey = bucketDepthKey(z);
 			break;
 
 		case EFFECT_WAYPOINT:
 			pie = ((EFFECT *)pObject)->imd;
-			z = INT32_MAX - pie->getTextures().texpage;
+			newTag.sortKey = bucketBatchedKey(objectType, pie->getTextures().texpage, z);
 			break;
 
 		default:
-			z = INT32_MAX - 42;
+			newTag.sortKey = bucketBatchedKey(objectType, BUCKET_KEY_TEXTURE_EFFECT, z);
 			break;
 		}
 		break;
 	case RENDER_DROID:
 		pie = BODY_IMD(((DROID *)pObject), 0)->displayModel();
-		z = INT32_MAX - pie->getTextures().texpage;
+		newTag.sortKey = bucketBatchedKey(objectType, pie->getTextures().texpage, z);
 		break;
 	case RENDER_STRUCTURE:
 		pie = ((STRUCTURE *)pObject)->sDisplay.imd->displayModel();
-		z = INT32_MAX - pie->getTextures().texpage;
+		newTag.sortKey = bucketBatchedKey(objectType, pie->getTextures().texpage, z);
 		break;
 	case RENDER_FEATURE:
 		pie = ((FEATURE *)pObject)->sDisplay.imd->displayModel();
-		z = INT32_MAX - pie->getTextures().texpage;
+		newTag.sortKey = bucketBatchedKey(objectType, pie->getTextures().texpage, z);
 		break;
 	case RENDER_DELIVPOINT:
 		pie = pAssemblyPointIMDs[((FLAG_POSITION *)pObject)->
 		                         factoryType][((FLAG_POSITION *)pObject)->factoryInc]->displayModel();
-		z = INT32_MAX - pie->getTextures().texpage;
+		newTag.sortKey = bucketBatchedKey(objectType, pie->getTextures().texpage, z);
 		break;
 	case RENDER_PARTICLE:
-		z = 0;
+		// Always drawn after everything else
+		newTag.sortKey = bucketDepthKey(0);
 		break;
 	default:
 		// Use calculated Z
+		newTag.sortKey = bucketDepthKey(z);
 		break;
 	}
 
-	//put the object data into the tag
-	newTag.objectType = objectType;
-	newTag.pObject = pObject;
-	newTag.actualZ = z;
-
 	//add tag to bucketArray
 	bucketArray.push_back(newTag);
 }
@@ -387,7 +419,10 @@ void bucketAddTypeToList(RENDER_TYPE objectType, void *pObject, const glm::mat4
 void bucketRenderCurrentList(const glm::mat4 &viewMatrix, const glm::mat4 &perspectiveViewMatrix)
 {
 	WZ_PROFILE_SCOPE(bucketRenderCurrentList);
-	std::sort(bucketArray.begin(), bucketArray.end());
+	ska_sort(bucketArray.begin(), bucketArray.end(), [](const BUCKET_TAG & tag)
+	{
+		return tag.sortKey;
+	});
 
 	for (auto thisTag = bucketArray.cbegin(); thisTag != bucketArray.cend(); ++thisTag)
 	{
@@ -420,6 +455,9 @@ void bucketRenderCurrentList(const glm::mat4 &viewMatrix, const glm::mat4 &persp
 		}
 	}
 
+	// Opaque and additive effects were grouped by renderEffect(), queue them now
+	drawEffectBatches(viewMatrix);
+
 	//reset the bucket array as we go
 	bucketArray.resize(0);
 }
@@ -32,6 +32,7 @@
 #include "lib/ivis_opengl/png_util.h"
 
 #include "levels.h"
+#include "benchmark.h"
 #include "clparse.h"
 #include "display3d.h"
 #include "frontend.h"
@@ -47,6 +48,7 @@
 #include "gamehistorylogger.h"
 #include "stdinreader.h"
 #include "seqdisp.h"
+#include "profiling.h"
 
 #include <cwchar>
 
@@ -363,9 +365,13 @@ typedef enum
 	CLI_ALLOW_VULKAN_IMPLICIT_LAYERS,
 	CLI_HOST_CHAT_CONFIG,
 	CLI_HOST_ASYNC_JOIN_APPROVAL,
+	CLI_BENCHMARK,
 #if defined(__EMSCRIPTEN__)
 	CLI_VIDEOURL,
 #endif
+#if defined(WZ_PROFILING_TRACE)
+	CLI_PROFILE_TRACE,
+#endif
 } CLI_OPTIONS;
 
 // Separate table that avoids *any* translated strings, to avoid any risk of gettext / libintl function calls
@@ -455,9 +461,13 @@ static const struct poptOption *getOptionsTable()
 		{ "allow-vulkan-implicit-layers", POPT_ARG_NONE, CLI_ALLOW_VULKAN_IMPLICIT_LAYERS, N_("Allow Vulkan implicit layers (that may be default-disabled due to potential crashes or bugs)"), nullptr },
 		{ "host-chat-config", POPT_ARG_STRING, CLI_HOST_CHAT_CONFIG, N_("Set the default hosting chat configuration / permissions"), "[allow,quickchat]" },
 		{ "async-join-approve", POPT_ARG_NONE, CLI_HOST_ASYNC_JOIN_APPROVAL, N_("Enable async join approval (for connecting clients)"), nullptr },
+		{ "benchmark", POPT_ARG_STRING, CLI_BENCHMARK, N_("Render a fixed camera path over the loaded game (--loadskirmish, --loadcampaign), report frame times and quit"), N_("number of frames") },
 #if defined(__EMSCRIPTEN__)
 		{ "videourl", POPT_ARG_STRING, CLI_VIDEOURL,   N_("Base URL for on-demand video downloads"), N_("Base video URL") },
 #endif
+#if defined(WZ_PROFILING_TRACE)
+		{ "profile-trace", POPT_ARG_STRING, CLI_PROFILE_TRACE, N_("Record profiling scopes, and write them to a Chrome trace file at exit"), N_("file") },
+#endif
 
 		// Terminating entry
 		{ nullptr, 0, 0,              nullptr,                                    nullptr },
@@ -1314,6 +1324,24 @@ bool ParseCommandLine(int argc, const char * const *argv)
 			NETsetAsyncJoinApprovalRequired(true);
 			break;
 
+		case CLI_BENCHMARK:
+		{
+			token = poptGetOptArg(poptCon);
+			if (token == nullptr)
+			{
+				qFatal("Bad benchmark frame count");
+			}
+			int token_intval = atoi(token);
+			if (token_intval <= 0)
+			{
+				qFatal("Invalid benchmark frame count");
+			}
+			benchmarkSetFrames(static_cast<size_t>(token_intval));
+			// need to cause wrappers.cpp to update calculated effective headless mode
+			setHeadlessGameMode(wz_cli_headless);
+			break;
+		}
+
 #if defined(__EMSCRIPTEN__)
 		case CLI_VIDEOURL:
 			token = poptGetOptArg(poptCon);
@@ -1326,6 +1354,17 @@ bool ParseCommandLine(int argc, const char * const *argv)
 			break;
 #endif
 
+#if defined(WZ_PROFILING_TRACE)
+		case CLI_PROFILE_TRACE:
+			token = poptGetOptArg(poptCon);
+			if (token == nullptr)
+			{
+				qFatal("Missing profile-trace filename?");
+			}
+			profiling::startTrace(token);
+			break;
+#endif
+
 		} // switch (option)
 	} // while
 
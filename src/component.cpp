@@ -874,7 +874,7 @@ void displayComponentButtonObject(DROID *psDroid, const Vector3i *Rotation, cons
 
 /* Assumes matrix context is already set */
 // multiple turrets display removed the pointless mountRotation
-void displayComponentObject(DROID *psDroid, const glm::mat4 &viewMatrix, const glm::mat4 &perspectiveViewMatrix)
+void displayComponentObject(DROID *psDroid, const glm::mat4 &viewMatrix, const glm::mat4 &perspectiveViewMatrix, bool culled)
 {
 	Vector3i position, rotation;
 	Spacetime st = interpolateObjectSpacetime(psDroid, graphicsTime);
@@ -903,13 +903,14 @@ void displayComponentObject(DROID *psDroid, const glm::mat4 &viewMatrix, const g
 		glm::rotate(UNDEG(rotation.x), glm::vec3(1.f, 0.f, 0.f)) *
 		glm::rotate(UNDEG(rotation.z), glm::vec3(0.f, 0.f, 1.f));
 
-	if (psDroid->timeLastHit - graphicsTime < ELEC_DAMAGE_DURATION && psDroid->lastHitWeapon == WSC_ELECTRONIC)
+	const bool shimmy = psDroid->timeLastHit - graphicsTime < ELEC_DAMAGE_DURATION && psDroid->lastHitWeapon == WSC_ELECTRONIC;
+	if (shimmy)
 	{
 		modelMatrix *= objectShimmy((BASE_OBJECT *) psDroid);
 	}
 
-	// now check if the projected circle is within the screen boundaries
-	if(!clipDroidOnScreen(psDroid, perspectiveViewMatrix * modelMatrix))
+	// now check if the projected circle is within the screen boundaries (the frustum culling doesn't know about the shimmy)
+	if ((!culled || shimmy) && !clipDroidOnScreen(psDroid, perspectiveViewMatrix * modelMatrix))
 	{
 		return;
 	}
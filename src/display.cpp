@@ -1116,7 +1116,7 @@ bool CheckScrollLimits()
 /* Do the 3D display */
 void displayWorld()
 {
-	if (headlessGameMode())
+	if (skipDisplayOnlyWork())
 	{
 		return;
 	}
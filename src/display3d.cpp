@@ -40,6 +40,7 @@
 #include "lib/ivis_opengl/screen.h"
 #include "lib/ivis_opengl/imd.h"
 #include "lib/ivis_opengl/pieclip.h"
+#include "lib/ivis_opengl/culling.h"
 
 #include "lib/gamelib/gtime.h"
 #include "lib/sound/audio.h"
@@ -1401,6 +1402,7 @@ static void drawTiles(iView *player, LightingData& lightData, LightMap& lightmap
 				tileScreenInfo[idx][jdx].y = screen.y;
 			}
 		}
+		markLightmapDirty(playerXTile - visibleTiles.x / 2, playerZTile - visibleTiles.y / 2, playerXTile + visibleTiles.x / 2 + 1, playerZTile + visibleTiles.y / 2 + 1);
 	}
 
 	// Determine whether each tile in the drawable range is actually visible on-screen
@@ -1448,7 +1450,7 @@ static void drawTiles(iView *player, LightingData& lightData, LightMap& lightmap
 	}
 
 	// prepare terrain for drawing
-	perFrameTerrainUpdates(lightmap);
+	perFrameTerrainUpdates(lightmap, perspectiveViewMatrix);
 
 	// and prepare for rendering the models
 	wzPerfBegin(PERF_MODEL_INIT, "Draw 3D scene - model init");
@@ -1988,12 +1990,54 @@ void	renderProjectile(PROJECTILE *psCurr, const glm::mat4 &viewMatrix, const glm
 	}
 }
 
+// Objects gathered by the display functions below, with their bounding spheres, so they can be frustum culled in one batch
+static std::vector<BASE_OBJECT *> cullObjects;
+static BoundingSpheres cullSpheres;
+static std::vector<uint8_t> cullVisible;
+
+static void addCullCandidate(BASE_OBJECT *psObj, float radius)
+{
+	cullObjects.push_back(psObj);
+	cullSpheres.push_back(glm::vec3(psObj->pos.x, psObj->pos.z, -psObj->pos.y), radius);
+}
+
+/// Culls the gathered candidates against the view frustum, leaving only the visible ones (still in order) in cullObjects
+static void cullCandidates(const glm::mat4 &perspectiveViewMatrix)
+{
+	WZ_PROFILE_SCOPE(cullCandidates);
+	cullBoundingSpheres(extractFrustumPlanes(perspectiveViewMatrix), cullSpheres, cullVisible);
+	size_t numVisible = 0;
+	for (size_t i = 0; i < cullObjects.size(); ++i)
+	{
+		if (cullVisible[i])
+		{
+			cullObjects[numVisible++] = cullObjects[i];
+		}
+	}
+	cullObjects.resize(numVisible);
+	cullSpheres.clear();
+}
+
+static int imdCullRadius(iIMDBaseShape *psImd, int minimum)
+{
+	return (psImd != nullptr) ? std::max(psImd->sradius, minimum) : minimum;
+}
+
+static void addStructureCullCandidate(STRUCTURE *psStructure)
+{
+	// +2 tiles to make room for shadows on the terrain, as clipStructureOnScreen() does
+	const StructureBounds b = getStructureBounds(psStructure);
+	const int footprintRadius = static_cast<int>(TILE_UNITS * 0.71f * (std::max(b.size.x, b.size.y) + 2));
+	addCullCandidate(psStructure, imdCullRadius(psStructure->sDisplay.imd, footprintRadius));
+}
+
 /// Draw the buildings
 static void displayStaticObjects(const glm::mat4 &viewMatrix, const glm::mat4 &perspectiveViewMatrix)
 {
 	WZ_PROFILE_SCOPE(displayStaticObjects);
 	// to solve the flickering edges of baseplates
 //	pie_SetDepthOffset(-1.0f);
+	cullObjects.clear();
 
 	/* Go through all the players */
 	for (unsigned aPlayer = 0; aPlayer < MAX_PLAYERS; ++aPlayer)
@@ -2002,18 +2046,12 @@ static void displayStaticObjects(const glm::mat4 &viewMatrix, const glm::mat4 &p
 		for (BASE_OBJECT* obj : apsStructLists[aPlayer])
 		{
 			/* Worth rendering the structure? */
-			if (obj->type != OBJ_STRUCTURE || (obj->died != 0 && obj->died < graphicsTime))
-			{
-				continue;
-			}
-			STRUCTURE *psStructure = castStructure(obj);
-
-			if (!clipStructureOnScreen(psStructure))
+			if (obj->type != OBJ_STRUCTURE || (obj->died != 0 && obj->died < graphicsTime)
+			    || !quickClipXYToMaximumTilesFromCurrentPosition(obj->pos.x, obj->pos.y))
 			{
 				continue;
 			}
-
-			renderStructure(psStructure, viewMatrix, perspectiveViewMatrix);
+			addStructureCullCandidate(castStructure(obj));
 		}
 	}
 
@@ -2023,18 +2061,18 @@ static void displayStaticObjects(const glm::mat4 &viewMatrix, const glm::mat4 &p
 	for (BASE_OBJECT* obj : psDestroyedObj)
 	{
 		/* Worth rendering the structure? */
-		if (obj->type != OBJ_STRUCTURE || (obj->died != 0 && obj->died < graphicsTime))
-		{
-			continue;
-		}
-		STRUCTURE* psStructure = castStructure(obj);
-
-		if (!clipStructureOnScreen(psStructure))
+		if (obj->type != OBJ_STRUCTURE || (obj->died != 0 && obj->died < graphicsTime)
+		    || !quickClipXYToMaximumTilesFromCurrentPosition(obj->pos.x, obj->pos.y))
 		{
 			continue;
 		}
+		addStructureCullCandidate(castStructure(obj));
+	}
 
-		renderStructure(psStructure, viewMatrix, perspectiveViewMatrix);
+	cullCandidates(perspectiveViewMatrix);
+	for (BASE_OBJECT *obj : cullObjects)
+	{
+		renderStructure(castStructure(obj), viewMatrix, perspectiveViewMatrix);
 	}
 
 //	pie_SetDepthOffset(0.0f);
@@ -2276,15 +2314,16 @@ static void displayFeatures(const glm::mat4 &viewMatrix, const glm::mat4 &perspe
 	WZ_PROFILE_SCOPE(displayFeatures);
 	// player can only be 0 for the features.
 
+	cullObjects.clear();
+
 	/* Go through all the features */
 	for (BASE_OBJECT* obj : apsFeatureLists[0])
 	{
 		if (obj->type == OBJ_FEATURE
 			&& (obj->died == 0 || obj->died > graphicsTime)
-			&& clipXY(obj->pos.x, obj->pos.y))
+			&& quickClipXYToMaximumTilesFromCurrentPosition(obj->pos.x, obj->pos.y))
 		{
-			FEATURE* psFeature = castFeature(obj);
-			renderFeature(psFeature, viewMatrix, perspectiveViewMatrix);
+			addCullCandidate(obj, imdCullRadius(obj->sDisplay.imd, TILE_UNITS / 2));
 		}
 	}
 
@@ -2295,12 +2334,17 @@ static void displayFeatures(const glm::mat4 &viewMatrix, const glm::mat4 &perspe
 	{
 		if (obj->type == OBJ_FEATURE
 			&& (obj->died == 0 || obj->died > graphicsTime)
-			&& clipXY(obj->pos.x, obj->pos.y))
+			&& quickClipXYToMaximumTilesFromCurrentPosition(obj->pos.x, obj->pos.y))
 		{
-			FEATURE* psFeature = castFeature(obj);
-			renderFeature(psFeature, viewMatrix, perspectiveViewMatrix);
+			addCullCandidate(obj, imdCullRadius(obj->sDisplay.imd, TILE_UNITS / 2));
 		}
 	}
+
+	cullCandidates(perspectiveViewMatrix);
+	for (BASE_OBJECT *obj : cullObjects)
+	{
+		renderFeature(castFeature(obj), viewMatrix, perspectiveViewMatrix);
+	}
 }
 
 /// Draw the Proximity messages for the *SELECTED PLAYER ONLY*
@@ -2338,10 +2382,21 @@ static void displayProximityMsgs(const glm::mat4& viewMatrix, const glm::mat4 &p
 	}
 }
 
+static void addDroidCullCandidate(DROID *psDroid)
+{
+	// NOTE: This only takes into account body, like clipDroidOnScreen(). The margin covers the
+	// interpolated position, bobbing transporters and shadows when the droid is right at the edge.
+	const BODY_STATS *psBStats = psDroid->getBodyStats();
+	iIMDBaseShape *psImd = (psBStats != nullptr) ? psBStats->pIMD : nullptr;
+	addCullCandidate(psDroid, imdCullRadius(psImd, 22) + TILE_UNITS / 2);
+}
+
 /// Draw the droids
 static void displayDynamicObjects(const glm::mat4 &viewMatrix, const glm::mat4 &perspectiveViewMatrix)
 {
 	WZ_PROFILE_SCOPE(displayDynamicObjects);
+	cullObjects.clear();
+
 	/* Need to go through all the droid lists */
 	for (unsigned player = 0; player < MAX_PLAYERS; ++player)
 	{
@@ -2356,7 +2411,7 @@ static void displayDynamicObjects(const glm::mat4 &viewMatrix, const glm::mat4 &
 			/* No point in adding it if you can't see it? */
 			if (psDroid->visibleForLocalDisplay())
 			{
-				displayComponentObject(psDroid, viewMatrix, perspectiveViewMatrix);
+				addDroidCullCandidate(psDroid);
 			}
 		}
 	}
@@ -2374,9 +2429,15 @@ static void displayDynamicObjects(const glm::mat4 &viewMatrix, const glm::mat4 &
 		/* No point in adding it if you can't see it? */
 		if (psDroid->visibleForLocalDisplay())
 		{
-			displayComponentObject(psDroid, viewMatrix, perspectiveViewMatrix);
+			addDroidCullCandidate(psDroid);
 		}
 	}
+
+	cullCandidates(perspectiveViewMatrix);
+	for (BASE_OBJECT *obj : cullObjects)
+	{
+		displayComponentObject(castDroid(obj), viewMatrix, perspectiveViewMatrix, true);
+	}
 }
 
 /// Sets the player's position and view angle - defaults player rotations as well
@@ -2490,7 +2551,7 @@ void	renderFeature(FEATURE *psFeature, const glm::mat4 &viewMatrix, const glm::m
 	    || psFeature->psStats->subType == FEAT_OIL_DRUM)
 	{
 		/* these cast a shadow */
-		pieFlags = pie_SHADOW;
+		pieFlags = pie_STATIC_SHADOW;
 	}
 
 	iIMDBaseShape *imd = psFeature->sDisplay.imd;
@@ -2948,8 +3009,8 @@ void renderStructure(STRUCTURE *psStructure, const glm::mat4 &viewMatrix, const
 	}
 	else
 	{
-		// structures can be rotated, so use a dynamic shadow for them
-		pieFlag = pie_SHADOW | ecmFlag;
+		// silhouettes are cached per light direction, so rotated structures can share them too
+		pieFlag = pie_STATIC_SHADOW | ecmFlag;
 		pieFlagData = 0;
 	}
 
@@ -3077,8 +3138,8 @@ static bool renderWallSection(STRUCTURE *psStructure, const glm::mat4 &viewMatri
 		}
 		else
 		{
-			// Use a dynamic shadow
-			pieFlag = pie_SHADOW;
+			// Use a static shadow, the structure doesn't move
+			pieFlag = pie_STATIC_SHADOW;
 			pieFlagData = 0;
 		}
 		iIMDBaseShape *imd = psStructure->sDisplay.imd;
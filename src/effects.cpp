@@ -48,6 +48,7 @@
 #include "lib/framework/fixedpoint.h"
 #include "lib/framework/geometry.h"
 #include "lib/ivis_opengl/piepalette.h"
+#include "lib/ivis_opengl/piedraw.h"
 #include "lib/ivis_opengl/piestate.h"
 #include "lib/ivis_opengl/piematrix.h"
 #include "lib/ivis_opengl/piemode.h"
@@ -71,11 +72,15 @@
 #include "multiplay.h"
 #include "component.h"
 #include "profiling.h"
+#include "wrappers.h"
 
 #ifndef GLM_ENABLE_EXPERIMENTAL
 	#define GLM_ENABLE_EXPERIMENTAL
 #endif
 #include <glm/gtx/transform.hpp>
+#include <functional>
+#include <unordered_map>
+#include <vector>
 
 #define	GRAVITON_GRAVITY	((float)-800)
 #define	EFFECT_X_FLIP		0x1
@@ -201,6 +206,41 @@ static void renderFirework(const EFFECT *psEffect, const glm::mat4 &viewMatrix);
 static glm::mat4 positionEffect(const EFFECT *psEffect);
 /* There is no render destruction effect! */
 
+// ----------------------------------------------------------------------------------------
+// ---- Opaque and additive effect draws are grouped by shape, team and flags, and queued as
+// ---- instances once the bucket list has been rendered, by drawEffectBatches()
+struct EFFECT_BATCH_KEY
+{
+	iIMDShape *shape;
+	int team;
+	int pieFlag;
+
+	bool operator ==(EFFECT_BATCH_KEY const &b) const
+	{
+		return shape == b.shape && team == b.team && pieFlag == b.pieFlag;
+	}
+};
+
+struct EFFECT_BATCH_KEY_HASH
+{
+	size_t operator()(EFFECT_BATCH_KEY const &key) const
+	{
+		return std::hash<const void *>()(key.shape) ^ (std::hash<int>()(key.pieFlag) << 1) ^ (std::hash<int>()(key.team) << 2);
+	}
+};
+
+struct EFFECT_BATCH
+{
+	EFFECT_BATCH_KEY key;
+	std::vector<PIE_SHAPE_INSTANCE> instances;
+};
+
+/* Batches are kept between frames, so their instance lists keep their capacity */
+static std::vector<EFFECT_BATCH> effectBatches;
+static std::unordered_map<EFFECT_BATCH_KEY, size_t, EFFECT_BATCH_KEY_HASH> effectBatchIndices;
+
+static void queueEffectShape(iIMDShape *shape, int frame, int team, PIELIGHT colour, int pieFlag, int pieFlagData, const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix);
+
 // ----------------------------------------------------------------------------------------
 // ---- The set up functions - every type has one
 static void effectSetupSmoke(EFFECT& effect);
@@ -221,6 +261,8 @@ static UDWORD effectGetNumFrames(EFFECT *psEffect);
 void shutdownEffectsSystem()
 {
 	gActiveEffects.clear();
+	effectBatches.clear();
+	effectBatchIndices.clear();
 }
 
 /*!
@@ -256,7 +298,7 @@ void effectSetSize(UDWORD size)
 void addMultiEffect(const Vector3i *basePos, Vector3i *scatter, EFFECT_GROUP group,
                     EFFECT_TYPE type, bool specified, iIMDShape *imd, unsigned int number, bool lit, unsigned int size, unsigned effectTime)
 {
-	if (number == 0)
+	if (number == 0 || skipDisplayOnlyWork())
 	{
 		return;
 	}
@@ -357,8 +399,9 @@ static void renderDroidDeathAnimationEffect(const EFFECT *psEffect, const glm::m
 
 void addEffect(const Vector3i *pos, EFFECT_GROUP group, EFFECT_TYPE type, bool specified, iIMDShape *imd, int lit, unsigned effectTime, Vector3i *rot /*= nullptr*/, Vector3f *velocity /*= nullptr*/)
 {
-	if (gamePaused())
+	if (gamePaused() || skipDisplayOnlyWork())
 	{
+		// Effects are never processed or drawn when headless, so don't let them pile up
 		return;
 	}
 	EFFECT effect;
@@ -1435,10 +1478,47 @@ void renderEffect(const EFFECT *psEffect, const glm::mat4 &viewMatrix)
 	abort();
 }
 
+/* Queues an effect shape, to be drawn along with all others using the same shape, team and flags.
+ * Alpha blended shapes depend on the back to front order of the bucket list, so they are drawn straight away. */
+static void queueEffectShape(iIMDShape *shape, int frame, int team, PIELIGHT colour, int pieFlag, int pieFlagData, const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix)
+{
+	ASSERT_OR_RETURN(, shape != nullptr, "No shape");
+	ASSERT(frame >= 0, "Negative frame %d", frame);
+
+	if (pieFlag & (pie_TRANSLUCENT | pie_PREMULTIPLIED))
+	{
+		pie_Draw3DShape(shape, frame, team, colour, pieFlag, pieFlagData, modelMatrix, viewMatrix);
+		return;
+	}
+
+	const EFFECT_BATCH_KEY key = {shape, team, pieFlag};
+	auto it = effectBatchIndices.find(key);
+	if (it == effectBatchIndices.end())
+	{
+		it = effectBatchIndices.emplace(key, effectBatches.size()).first;
+		effectBatches.push_back(EFFECT_BATCH{key, {}});
+	}
+	effectBatches[it->second].instances.push_back(PIE_SHAPE_INSTANCE{modelMatrix, colour, frame, pieFlagData});
+}
+
+/* Draws all opaque and additive effects queued by renderEffect() since the last call, one batch of instances per shape, team and flags */
+void drawEffectBatches(const glm::mat4 &viewMatrix)
+{
+	WZ_PROFILE_SCOPE(drawEffectBatches);
+	for (EFFECT_BATCH &batch : effectBatches)
+	{
+		if (!batch.instances.empty())
+		{
+			pie_Draw3DShapeInstances(batch.key.shape, batch.key.team, batch.key.pieFlag, batch.instances.data(), batch.instances.size(), viewMatrix);
+			batch.instances.clear();
+		}
+	}
+}
+
 /** drawing func for wapypoints */
 static void renderWaypointEffect(const EFFECT *psEffect, const glm::mat4 &viewMatrix)
 {
-	pie_Draw3DShape(psEffect->imd, 0, 0, WZCOL_WHITE, 0, 0, positionEffect(psEffect), viewMatrix);
+	queueEffectShape(psEffect->imd, 0, 0, WZCOL_WHITE, 0, 0, positionEffect(psEffect), viewMatrix);
 }
 
 static void renderFirework(const EFFECT *psEffect, const glm::mat4 &viewMatrix)
@@ -1453,7 +1533,7 @@ static void renderFirework(const EFFECT *psEffect, const glm::mat4 &viewMatrix)
 	modelMatrix *= glm::rotate(UNDEG(-playerPos.r.y), glm::vec3(0.f, 1.f, 0.f)) * glm::rotate(UNDEG(-playerPos.r.x), glm::vec3(1.f, 0.f, 0.f))
 	               * glm::scale(glm::vec3(psEffect->size / 100.f));
 
-	pie_Draw3DShape(psEffect->imd, psEffect->frameNumber, 0, WZCOL_WHITE, pie_ADDITIVE | pie_NODEPTHWRITE, EFFECT_EXPLOSION_ADDITIVE, modelMatrix, viewMatrix);
+	queueEffectShape(psEffect->imd, psEffect->frameNumber, 0, WZCOL_WHITE, pie_ADDITIVE | pie_NODEPTHWRITE, EFFECT_EXPLOSION_ADDITIVE, modelMatrix, viewMatrix);
 }
 
 /** drawing func for blood. */
@@ -1463,7 +1543,7 @@ static void renderBloodEffect(const EFFECT *psEffect, const glm::mat4 &viewMatri
 	modelMatrix *= glm::rotate(UNDEG(-playerPos.r.y), glm::vec3(0.f, 1.f, 0.f)) * glm::rotate(UNDEG(-playerPos.r.x), glm::vec3(1.f, 0.f, 0.f))
 	               * glm::scale(glm::vec3(psEffect->size / 100.f));
 
-	pie_Draw3DShape(getDisplayImdFromIndex(MI_BLOOD), psEffect->frameNumber, 0, WZCOL_WHITE, pie_TRANSLUCENT | pie_NODEPTHWRITE, EFFECT_BLOOD_TRANSPARENCY, modelMatrix, viewMatrix);
+	queueEffectShape(getDisplayImdFromIndex(MI_BLOOD), psEffect->frameNumber, 0, WZCOL_WHITE, pie_TRANSLUCENT | pie_NODEPTHWRITE, EFFECT_BLOOD_TRANSPARENCY, modelMatrix, viewMatrix);
 }
 
 static void renderDestructionEffect(const EFFECT *psEffect, const glm::mat4 &viewMatrix)
@@ -1495,7 +1575,7 @@ static void renderDestructionEffect(const EFFECT *psEffect, const glm::mat4 &vie
 			glm::rotate(UNDEG(SKY_SHIMMY), glm::vec3(0.f, 1.f, 0.f)) *
 			glm::rotate(UNDEG(SKY_SHIMMY), glm::vec3(0.f, 0.f, 1.f));
 	}
-	pie_Draw3DShape(psEffect->imd, 0, 0, WZCOL_WHITE, pie_RAISE, percent, modelMatrix, viewMatrix);
+	queueEffectShape(psEffect->imd, 0, 0, WZCOL_WHITE, pie_RAISE, percent, modelMatrix, viewMatrix);
 }
 
 static bool rejectLandLight(LAND_LIGHT_SPEC type)
@@ -1586,19 +1666,19 @@ static void renderExplosionEffect(const EFFECT *psEffect, const glm::mat4 &viewM
 
 	if (premultiplied)
 	{
-		pie_Draw3DShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_PREMULTIPLIED, 0, modelMatrix, viewMatrix);
+		queueEffectShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_PREMULTIPLIED, 0, modelMatrix, viewMatrix);
 	}
 	else if (psEffect->type == EXPLOSION_TYPE_PLASMA)
 	{
-		pie_Draw3DShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_ADDITIVE | pie_NODEPTHWRITE, EFFECT_PLASMA_ADDITIVE, modelMatrix, viewMatrix);
+		queueEffectShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_ADDITIVE | pie_NODEPTHWRITE, EFFECT_PLASMA_ADDITIVE, modelMatrix, viewMatrix);
 	}
 	else if (psEffect->type == EXPLOSION_TYPE_KICKUP)
 	{
-		pie_Draw3DShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_TRANSLUCENT | pie_NODEPTHWRITE, 128, modelMatrix, viewMatrix);
+		queueEffectShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_TRANSLUCENT | pie_NODEPTHWRITE, 128, modelMatrix, viewMatrix);
 	}
 	else
 	{
-		pie_Draw3DShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_ADDITIVE | pie_NODEPTHWRITE, EFFECT_EXPLOSION_ADDITIVE, modelMatrix, viewMatrix);
+		queueEffectShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_ADDITIVE | pie_NODEPTHWRITE, EFFECT_EXPLOSION_ADDITIVE, modelMatrix, viewMatrix);
 	}
 }
 
@@ -1617,7 +1697,7 @@ static void renderGravitonEffect(const EFFECT *psEffect, const glm::mat4 &viewMa
 		modelMatrix *= glm::scale(glm::vec3(psEffect->size / 100.f));
 	}
 
-	pie_Draw3DShape(psEffect->imd, psEffect->frameNumber, psEffect->player, WZCOL_WHITE, pie_SHADOW, 0, modelMatrix, viewMatrix);
+	queueEffectShape(psEffect->imd, psEffect->frameNumber, psEffect->player, WZCOL_WHITE, pie_SHADOW, 0, modelMatrix, viewMatrix);
 }
 
 /** Renders the standard construction effect */
@@ -1664,7 +1744,7 @@ static void renderConstructionEffect(const EFFECT *psEffect, const glm::mat4 &vi
 	size = MIN(2.f * translucency / 100.f, .90f);
 	modelMatrix *= glm::scale(glm::vec3(size));
 
-	pie_Draw3DShape(psEffect->imd, psEffect->frameNumber, 0, WZCOL_WHITE, pie_TRANSLUCENT | pie_NODEPTHWRITE, translucency, modelMatrix, viewMatrix);
+	queueEffectShape(psEffect->imd, psEffect->frameNumber, 0, WZCOL_WHITE, pie_TRANSLUCENT | pie_NODEPTHWRITE, translucency, modelMatrix, viewMatrix);
 }
 
 /** Renders the standard smoke effect - it is now scaled in real-time as well */
@@ -1717,17 +1797,17 @@ static void renderSmokeEffect(const EFFECT *psEffect, const glm::mat4 &viewMatri
 	/* Make imds be transparent on 3dfx */
 	if (psEffect->type == SMOKE_TYPE_STEAM)
 	{
-		pie_Draw3DShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_TRANSLUCENT | pie_NODEPTHWRITE, EFFECT_STEAM_TRANSPARENCY / 2, modelMatrix, viewMatrix);
+		queueEffectShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_TRANSLUCENT | pie_NODEPTHWRITE, EFFECT_STEAM_TRANSPARENCY / 2, modelMatrix, viewMatrix);
 	}
 	else
 	{
 		if (psEffect->type == SMOKE_TYPE_TRAIL)
 		{
-			pie_Draw3DShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_TRANSLUCENT | pie_NODEPTHWRITE, (2 * transparency) / 3, modelMatrix, viewMatrix);
+			queueEffectShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_TRANSLUCENT | pie_NODEPTHWRITE, (2 * transparency) / 3, modelMatrix, viewMatrix);
 		}
 		else
 		{
-			pie_Draw3DShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_TRANSLUCENT | pie_NODEPTHWRITE, transparency / 2, modelMatrix, viewMatrix);
+			queueEffectShape(psEffect->imd, psEffect->frameNumber, 0, brightness, pie_TRANSLUCENT | pie_NODEPTHWRITE, transparency / 2, modelMatrix, viewMatrix);
 		}
 	}
 }
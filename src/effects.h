@@ -158,6 +158,7 @@ void    addEffect(const Vector3i *pos, EFFECT_GROUP group, EFFECT_TYPE type, boo
 void    addMultiEffect(const Vector3i *basePos, Vector3i *scatter, EFFECT_GROUP group, EFFECT_TYPE type, bool specified, iIMDShape *imd, unsigned int number, bool lit, unsigned int size, unsigned effectTime);
 
 void	renderEffect(const EFFECT *psEffect, const glm::mat4 &viewMatrix);
+void	drawEffectBatches(const glm::mat4 &viewMatrix);
 void	effectResetUpdates();
 
 void	initPerimeterSmoke(iIMDShape *pImd, Vector3i base);
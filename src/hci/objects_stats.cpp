@@ -26,6 +26,9 @@
 #include "../geometry.h"
 #include "groups.h"
 
+// The buttons show progress and counts read from the game while they are displayed, so their cached copies are redrawn this often (ms)
+#define BUTTON_CACHE_REFRESH_INTERVAL 100
+
 void BaseObjectsController::clearSelection()
 {
 	::clearSelection();
@@ -330,10 +333,12 @@ void ObjectsForm::addNewButton()
 	buttonHolder->attach(statButton);
 	statButton->setGeometry(0, 0, OBJ_BUTWIDTH, OBJ_BUTHEIGHT);
 	statButton->style |= WFORM_SECONDARY;
+	statButton->setCacheRendering(true, BUTTON_CACHE_REFRESH_INTERVAL);
 
 	auto objectButton = makeObjectButton(buttonIndex);
 	buttonHolder->attach(objectButton);
 	objectButton->setGeometry(0, OBJ_STARTY, OBJ_BUTWIDTH, OBJ_BUTHEIGHT);
+	objectButton->setCacheRendering(true, BUTTON_CACHE_REFRESH_INTERVAL);
 }
 
 void ObjectsForm::removeLastButton()
@@ -460,6 +465,7 @@ void StatsForm::addNewButton()
 	auto button = makeOptionButton(buttonIndex);
 	optionList->addWidgetToLayout(button);
 	button->style |= WFORM_SECONDARY;
+	button->setCacheRendering(true, BUTTON_CACHE_REFRESH_INTERVAL);
 }
 
 void StatsForm::removeLastButton()
@@ -82,6 +82,8 @@
 #include "notifications.h"
 #include "projectile.h"
 #include "order.h"
+#include "parallel.h"
+#include "profiling.h"
 #include "radar.h"
 #include "research.h"
 #include "lib/framework/cursors.h"
@@ -1351,6 +1353,8 @@ void systemShutdown()
 	notificationsShutDown();
 	widgShutDown();
 	fpathShutdown();
+	parallelShutdown();
+	profiling::stopTrace();	// all the worker threads are done by now
 	mapShutdown();
 	modelShutdown();
 	debug(LOG_MAIN, "shutting down everything else");
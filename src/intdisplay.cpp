@@ -359,6 +359,11 @@ void IntFancyButton::initDisplay()
 			model.rotation.y = std::max(model.rotation.y, DEFAULT_BUTTON_ROTATION);
 		}
 	}
+
+	if (isHighlighted() || model.rotation.y != DEFAULT_BUTTON_ROTATION)
+	{
+		dirty = true;  // Still turning, draw again next frame
+	}
 }
 
 void IntFancyButton::displayIfHighlight(int xOffset, int yOffset)
@@ -41,6 +41,7 @@
 #include "display3d.h"
 #include "terrain.h"
 #include "warzoneconfig.h"
+#include "wrappers.h"
 
 // These magic values determine the fog
 #define FOG_ALTITUDE_COEFFICIENT 1.3f
@@ -89,6 +90,11 @@ void initLighting(UDWORD x1, UDWORD y1, UDWORD x2, UDWORD y2)
 		return;
 	}
 
+	if (skipDisplayOnlyWork())
+	{
+		return; // tile illumination is for display only
+	}
+
 	for (unsigned j = y1; j < y2; j++)
 	{
 		for (unsigned i = x1; i < x2; i++)
@@ -279,6 +285,7 @@ void rendering1999::LightingManager::ComputeFrameData(const LightingData& data,
 		endY = MAX(endY, 0);
 		endY = MIN(endY, mapHeight - 1);
 		startY = MIN(startY, endY);
+		markLightmapDirty(startX, startY, endX + 1, endY + 1);
 
 		for (int i = startX; i <= endX; i++)
 		{
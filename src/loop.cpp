@@ -87,6 +87,7 @@
 #include "clparse.h"
 #include "gamehistorylogger.h"
 #include "profiling.h"
+#include "benchmark.h"
 
 #include "warzoneconfig.h"
 
@@ -304,7 +305,7 @@ static GAMECODE renderLoop()
 			pie_LoadBackDrop(SCREEN_RANDOMBDROP);
 		}
 	}
-	if (!loop_GetVideoStatus() && !quitting && !headlessGameMode() && !skipDrawing)
+	if (!loop_GetVideoStatus() && !quitting && !skipDisplayOnlyWork() && !skipDrawing)
 	{
 		if (!gameUpdatePaused())
 		{
@@ -695,8 +696,10 @@ GAMECODE gameLoop()
 	}
 
 	unsigned before = wzGetTicks();
+	benchmarkFrameBegin();
 	GAMECODE renderReturn = renderLoop();
 	pie_ScreenFrameRenderEnd(); // must happen here for proper renderBudget calculation
+	benchmarkFrameEnd();
 	unsigned after = wzGetTicks();
 
 #if defined(__EMSCRIPTEN__)
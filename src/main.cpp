@@ -1942,6 +1942,8 @@ int realmain(int argc, char *argv[])
 
 	PHYSFS_mkdir("logs");		// netplay, mingw crash reports & WZ logs
 
+	PHYSFS_mkdir("cache/models");	// processed .pie models, so they don't have to be parsed again on the next start
+
 	make_dir(MultiCustomMapsPath, "maps", nullptr); // needed to prevent crashes when getting map
 
 	PHYSFS_mkdir(version_getVersionedModsFolderPath("autoload").c_str());	// mods that are automatically loaded
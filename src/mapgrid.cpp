@@ -192,6 +192,33 @@ GridList const &gridStartIterateArea(int32_t x, int32_t y, uint32_t x2, uint32_t
 	return gridStartIterateFilteredArea(x, y, x2, y2, ConditionTrue());
 }
 
+GridEntryList const &gridStartIterateAreaEntries(int32_t x, int32_t y, int32_t x2, int32_t y2)
+{
+	gridPointTree->queryWithPositions(x, y, x2, y2);
+
+	static GridEntryList gridEntryList;
+	gridEntryList.resize(gridPointTree->lastQueryResults.size());
+	for (unsigned n = 0; n < gridEntryList.size(); ++n)
+	{
+		gridEntryList[n].psObj = (BASE_OBJECT *)gridPointTree->lastQueryResults[n];
+		gridEntryList[n].gridX = gridPointTree->lastQueryPositions[n].first;
+		gridEntryList[n].gridY = gridPointTree->lastQueryPositions[n].second;
+	}
+	return gridEntryList;
+}
+
+bool gridEntryInRadius(GridEntry const &entry, int32_t x, int32_t y, uint32_t radius)
+{
+	// Same tests as gridStartIterateFiltered: the grid position must be in the query square, and the current position must be within radius.
+	int32_t minX = x - radius, maxX = x + radius;
+	int32_t minY = y - radius, maxY = y + radius;
+	if (entry.gridX < minX || entry.gridX > maxX || entry.gridY < minY || entry.gridY > maxY)
+	{
+		return false;
+	}
+	return isInRadius(entry.psObj->pos.x - x, entry.psObj->pos.y - y, radius);
+}
+
 struct ConditionDroidsByPlayer
 {
 	ConditionDroidsByPlayer(int32_t player_) : player(player_) {}
@@ -27,6 +27,14 @@
 typedef std::vector<BASE_OBJECT *> GridList;
 typedef GridList::const_iterator GridIterator;
 
+/// An object found by gridStartIterateAreaEntries(), along with the position it had when gridReset() was last called.
+struct GridEntry
+{
+	BASE_OBJECT *psObj;
+	int32_t gridX, gridY;
+};
+typedef std::vector<GridEntry> GridEntryList;
+
 // initialise the grid system
 bool gridInitialise();
 
@@ -43,6 +51,13 @@ GridList const &gridStartIterate(int32_t x, int32_t y, uint32_t radius);
 /// Find all objects within radius.
 GridList const &gridStartIterateArea(int32_t x, int32_t y, uint32_t x2, uint32_t y2);
 
+/// Find all objects within an area, along with their grid positions. Results are in the same relative order as gridStartIterate() returns them.
+/// Useful for answering many nearby radius queries with a single grid lookup, using gridEntryInRadius().
+GridEntryList const &gridStartIterateAreaEntries(int32_t x, int32_t y, int32_t x2, int32_t y2);
+
+/// Returns true if gridStartIterate(x, y, radius) would include the entry.
+bool gridEntryInRadius(GridEntry const &entry, int32_t x, int32_t y, uint32_t radius);
+
 /// Find all objects within radius where object->type == OBJ_DROID && object->player == player.
 GridList const &gridStartIterateDroidsByPlayer(int32_t x, int32_t y, uint32_t radius, int player);
 
@@ -0,0 +1,212 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2024  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file parallel.cpp
+ *
+ * Small worker pool for splitting per-frame loops into chunks.
+ */
+
+#include "lib/framework/frame.h"
+#include "lib/framework/wzapp.h"
+
+#include "parallel.h"
+#include "profiling.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Keep the pool small, the path finding thread and the renderer want cores too
+#define PARALLEL_MAX_WORKERS	3
+
+static std::vector<WZ_THREAD *> parallelWorkers;
+static WZ_MUTEX         *parallelMutex = nullptr;
+static WZ_SEMAPHORE     *parallelWakeSemaphore = nullptr;  ///< Posted once per worker wanted for the current job
+static WZ_SEMAPHORE     *parallelDoneSemaphore = nullptr;  ///< Posted when the last chunk finishes, if the caller is waiting
+static bool             parallelQuit = false;
+static bool             parallelStarted = false;
+
+// Current job, all protected by parallelMutex
+static const std::function<void (size_t, size_t)> *parallelJob = nullptr;
+static size_t           parallelCount = 0;
+static size_t           parallelChunkSize = 0;
+static size_t           parallelNextBegin = 0;
+static size_t           parallelChunksPending = 0;
+static bool             parallelCallerWaiting = false;
+
+/// Grabs the next chunk of the current job, if any. Must hold parallelMutex.
+static bool parallelTakeChunk(size_t &begin, size_t &end)
+{
+	if (parallelJob == nullptr || parallelNextBegin >= parallelCount)
+	{
+		return false;
+	}
+	begin = parallelNextBegin;
+	end = std::min(begin + parallelChunkSize, parallelCount);
+	parallelNextBegin = end;
+	return true;
+}
+
+/// Marks a chunk as done. Must hold parallelMutex.
+static void parallelFinishChunk()
+{
+	ASSERT(parallelChunksPending > 0, "Finished more chunks than were started");
+	if (--parallelChunksPending == 0 && parallelCallerWaiting)
+	{
+		parallelCallerWaiting = false;
+		wzSemaphorePost(parallelDoneSemaphore);
+	}
+}
+
+/** This runs in a separate thread */
+static int parallelThreadFunc(void *)
+{
+	wzMutexLock(parallelMutex);
+	while (!parallelQuit)
+	{
+		size_t begin, end;
+		if (!parallelTakeChunk(begin, end))
+		{
+			wzMutexUnlock(parallelMutex);
+			wzSemaphoreWait(parallelWakeSemaphore);  // Go to sleep until needed.
+			wzMutexLock(parallelMutex);
+			continue;
+		}
+
+		const std::function<void (size_t, size_t)> &job = *parallelJob;
+		wzMutexUnlock(parallelMutex);
+		job(begin, end);
+		wzMutexLock(parallelMutex);
+
+		parallelFinishChunk();
+	}
+	wzMutexUnlock(parallelMutex);
+	return 0;
+}
+
+static void parallelStart()
+{
+	parallelStarted = true;
+
+	unsigned numWorkers = std::min<unsigned>(std::thread::hardware_concurrency(), PARALLEL_MAX_WORKERS + 1);
+	if (numWorkers <= 1)
+	{
+		return;  // Single core, or unknown. Run everything inline.
+	}
+	--numWorkers;  // The calling thread works too.
+
+	parallelQuit = false;
+	parallelMutex = wzMutexCreate();
+	parallelWakeSemaphore = wzSemaphoreCreate(0);
+	parallelDoneSemaphore = wzSemaphoreCreate(0);
+	for (unsigned i = 0; i < numWorkers; ++i)
+	{
+		WZ_THREAD *thread = wzThreadCreate(parallelThreadFunc, nullptr, "wzParallel");
+		wzThreadStart(thread);
+		parallelWorkers.push_back(thread);
+	}
+	debug(LOG_WZ, "Started %u worker threads", numWorkers);
+}
+
+void parallelFor(size_t count, size_t minChunkSize, const std::function<void (size_t begin, size_t end)> &func)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (!parallelStarted)
+	{
+		parallelStart();
+	}
+
+	minChunkSize = std::max<size_t>(minChunkSize, 1);
+	const size_t numThreads = parallelWorkers.size() + 1;
+	if (numThreads == 1 || count < minChunkSize * 2)
+	{
+		func(0, count);
+		return;
+	}
+
+	WZ_PROFILE_SCOPE(parallelFor);
+	// A few chunks per thread, so an unlucky slow chunk doesn't hold everybody up
+	const size_t chunkSize = std::max(minChunkSize, (count + numThreads * 4 - 1) / (numThreads * 4));
+	const size_t numChunks = (count + chunkSize - 1) / chunkSize;
+
+	wzMutexLock(parallelMutex);
+	ASSERT(parallelJob == nullptr, "parallelFor is not reentrant");
+	parallelJob = &func;
+	parallelCount = count;
+	parallelChunkSize = chunkSize;
+	parallelNextBegin = 0;
+	parallelChunksPending = numChunks;
+	parallelCallerWaiting = false;
+	wzMutexUnlock(parallelMutex);
+
+	for (size_t i = 0; i < std::min(parallelWorkers.size(), numChunks - 1); ++i)
+	{
+		wzSemaphorePost(parallelWakeSemaphore);  // Wake up a worker.
+	}
+
+	wzMutexLock(parallelMutex);
+	size_t begin, end;
+	while (parallelTakeChunk(begin, end))
+	{
+		wzMutexUnlock(parallelMutex);
+		func(begin, end);
+		wzMutexLock(parallelMutex);
+		parallelFinishChunk();
+	}
+	if (parallelChunksPending > 0)
+	{
+		parallelCallerWaiting = true;
+		wzMutexUnlock(parallelMutex);
+		wzSemaphoreWait(parallelDoneSemaphore);  // Workers are still busy with the last chunks.
+		wzMutexLock(parallelMutex);
+	}
+	parallelJob = nullptr;
+	wzMutexUnlock(parallelMutex);
+}
+
+void parallelShutdown()
+{
+	if (!parallelWorkers.empty())
+	{
+		// Signal the worker threads to quit
+		wzMutexLock(parallelMutex);
+		parallelQuit = true;
+		wzMutexUnlock(parallelMutex);
+		for (size_t i = 0; i < parallelWorkers.size(); ++i)
+		{
+			wzSemaphorePost(parallelWakeSemaphore);  // Wake up thread.
+		}
+		for (WZ_THREAD *thread : parallelWorkers)
+		{
+			wzThreadJoin(thread);
+		}
+		parallelWorkers.clear();
+
+		wzMutexDestroy(parallelMutex);
+		parallelMutex = nullptr;
+		wzSemaphoreDestroy(parallelWakeSemaphore);
+		parallelWakeSemaphore = nullptr;
+		wzSemaphoreDestroy(parallelDoneSemaphore);
+		parallelDoneSemaphore = nullptr;
+	}
+	parallelStarted = false;
+}
@@ -0,0 +1,37 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2024  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef __INCLUDED_SRC_PARALLEL_H__
+#define __INCLUDED_SRC_PARALLEL_H__
+
+#include <cstddef>
+#include <functional>
+
+/** Calls func(begin, end) on disjoint chunks covering [0, count), spread over a small pool
+ *  of worker threads, and returns once every chunk is done. The calling thread also works
+ *  on chunks. Chunks are never smaller than minChunkSize, so small counts run inline.
+ *  func must not touch the renderer, game state shared with other chunks, or call back
+ *  into parallelFor.
+ */
+void parallelFor(size_t count, size_t minChunkSize, const std::function<void (size_t begin, size_t end)> &func);
+
+/// Stops the worker threads, if they were started.
+void parallelShutdown();
+
+#endif // __INCLUDED_SRC_PARALLEL_H__
@@ -50,6 +50,18 @@ static uint64_t expand(uint32_t x)
 	return r;
 }
 
+// Collects bit pattern 0a0b 0c0d 0e0f 0g0h to abcd efgh, the inverse of expand().
+static uint32_t compact(uint64_t r)
+{
+	r &= 0x5555555555555555ULL;
+	r = (r | r >> 1)  & 0x3333333333333333ULL;
+	r = (r | r >> 2)  & 0x0F0F0F0F0F0F0F0FULL;
+	r = (r | r >> 4)  & 0x00FF00FF00FF00FFULL;
+	r = (r | r >> 8)  & 0x0000FFFF0000FFFFULL;
+	r = (r | r >> 16) & 0x00000000FFFFFFFFULL;
+	return (uint32_t)r;
+}
+
 // Returns v with highest set bit and all higher bits set, and all following bits 0. Example: 0000 0110 1001 1100 -> 1111 1100 0000 0000.
 static uint32_t findSplit(uint32_t v)
 {
@@ -128,7 +140,7 @@ static unsigned current(std::vector<unsigned> &filterData, unsigned i)
 	return ret;
 }
 
-template<bool IsFiltered>
+template<bool IsFiltered, bool WithPositions>
 PointTree::ResultVector &PointTree::queryMaybeFilter(Filter &filter, int32_t minXo, int32_t minYo, int32_t maxXo, int32_t maxYo)
 {
 	uint64_t minX = expandX(minXo);
@@ -230,6 +242,10 @@ PointTree::ResultVector &PointTree::queryMaybeFilter(Filter &filter, int32_t min
 	{
 		lastFilteredQueryIndices.clear();
 	}
+	if (WithPositions)
+	{
+		lastQueryPositions.clear();
+	}
 	for (int r = 0; r != numRanges; ++r)
 	{
 		// Find range of points which may be close enough. Range is [i1 ... i2 - 1]. The pointers are ignored when searching.
@@ -247,6 +263,10 @@ PointTree::ResultVector &PointTree::queryMaybeFilter(Filter &filter, int32_t min
 				{
 					lastFilteredQueryIndices.push_back(i);
 				}
+				if (WithPositions)
+				{
+					lastQueryPositions.emplace_back((int32_t)(compact(points[i].first >> 1) - 0x80000000u), (int32_t)(compact(points[i].first) - 0x80000000u));
+				}
 #ifdef DUMP_IMAGE
 				if (doDump)
 				{
@@ -276,6 +296,12 @@ PointTree::ResultVector &PointTree::query(int32_t x, int32_t y, uint32_t x2, uin
 	return queryMaybeFilter<false>(unused, x, y, x2, y2);
 }
 
+PointTree::ResultVector &PointTree::queryWithPositions(int32_t x, int32_t y, int32_t x2, int32_t y2)
+{
+	Filter unused;
+	return queryMaybeFilter<false, true>(unused, x, y, x2, y2);
+}
+
 PointTree::ResultVector &PointTree::query(int32_t x, int32_t y, uint32_t radius)
 {
 	Filter unused;
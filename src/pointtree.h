@@ -65,15 +65,21 @@ public:
 	ResultVector &query(Filter &filter, int32_t x, int32_t y, uint32_t radius);
 	/// Returns all points which have not been filtered away within given rectangle. See function above on thread safety.
 	ResultVector &query(int32_t x, int32_t y, uint32_t x2, uint32_t y2);
+	/// Same as query(x, y, x2, y2), but also fills lastQueryPositions with the position each result was inserted at.
+	/// Results are in the same order as any other query would return them in.
+	ResultVector &queryWithPositions(int32_t x, int32_t y, int32_t x2, int32_t y2);
+
+	typedef std::vector<std::pair<int32_t, int32_t>> PositionVector;
 
 	ResultVector lastQueryResults;
 	IndexVector lastFilteredQueryIndices;
+	PositionVector lastQueryPositions;
 
 private:
 	typedef std::pair<uint64_t, void *> Point;
 	typedef std::vector<Point> Vector;
 
-	template<bool IsFiltered>
+	template<bool IsFiltered, bool WithPositions = false>
 	ResultVector &queryMaybeFilter(Filter &filter, int32_t minXo, int32_t maxXo, int32_t minYo, int32_t maxYo);
 
 	Vector points;
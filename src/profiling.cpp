@@ -39,9 +39,191 @@
 #include <ittnotify.h>
 #endif
 
+#ifdef WZ_PROFILING_TRACE
+#include "lib/framework/frame.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#endif
+
 namespace profiling
 {
 
+#ifdef WZ_PROFILING_TRACE
+
+// Most recent events kept per thread. Events are 32 bytes, so this is 4 MiB for each thread that records anything.
+#define TRACE_EVENTS_PER_THREAD	(1 << 17)
+
+namespace trace
+{
+
+struct Event
+{
+	const char *object;  ///< Only set for WZ_PROFILE_SCOPE2 and the two-part mark()
+	const char *name;
+	int64_t time;        ///< Nanoseconds since epoch
+	char phase;          ///< 'B'egin, 'E'nd or 'i'nstant, as in the trace event format
+};
+
+struct ThreadBuffer
+{
+	explicit ThreadBuffer(unsigned id) : id(id), events(new Event[TRACE_EVENTS_PER_THREAD]) { }
+
+	const unsigned id;
+	std::unique_ptr<Event[]> events;
+	std::atomic<uint64_t> written{0};  ///< Events ever written. Only the owning thread writes events.
+};
+
+static std::atomic<bool> enabled{false};
+static std::mutex mutex;  ///< Protects threads and filename
+static std::vector<std::unique_ptr<ThreadBuffer>> threads;  ///< Kept after their thread exits, so they still end up in the trace
+static std::string filename;
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+static thread_local ThreadBuffer *localBuffer = nullptr;
+
+static int64_t now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+static void record(const char *object, const char *name, char phase)
+{
+	if (localBuffer == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		threads.emplace_back(new ThreadBuffer(static_cast<unsigned>(threads.size()) + 1));
+		localBuffer = threads.back().get();
+	}
+	// Names are string literals from the WZ_PROFILE_SCOPE macros, so only the pointers need keeping
+	const uint64_t index = localBuffer->written.load(std::memory_order_relaxed);
+	localBuffer->events[index % TRACE_EVENTS_PER_THREAD] = Event{object, name, now(), phase};
+	localBuffer->written.store(index + 1, std::memory_order_release);
+}
+
+static void writeName(FILE *fp, const Event &event)
+{
+	const char *parts[2] = {event.object, event.name};
+	for (int i = 0; i < 2; ++i)
+	{
+		if (parts[i] == nullptr)
+		{
+			continue;
+		}
+		if (i == 1 && parts[0] != nullptr)
+		{
+			fputs("::", fp);
+		}
+		for (const char *c = parts[i]; *c != '\0'; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				fputc('\\', fp);
+			}
+			if (static_cast<unsigned char>(*c) >= 0x20)
+			{
+				fputc(*c, fp);
+			}
+		}
+	}
+}
+
+static void writeEvent(FILE *fp, bool &first, const Event &event, int64_t duration, unsigned tid)
+{
+	fputs(first ? "{\"name\":\"" : ",\n{\"name\":\"", fp);
+	first = false;
+	writeName(fp, event);
+	if (event.phase == 'i')
+	{
+		fprintf(fp, "\",\"cat\":\"warzone2100\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", event.time / 1000.0, tid);
+	}
+	else
+	{
+		fprintf(fp, "\",\"cat\":\"warzone2100\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}", event.time / 1000.0, duration / 1000.0, tid);
+	}
+}
+
+static bool dump()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (filename.empty())
+	{
+		return false;  // Never started
+	}
+	FILE *fp = fopen(filename.c_str(), "wb");
+	if (fp == nullptr)
+	{
+		debug(LOG_ERROR, "Could not open trace file %s", filename.c_str());
+		return false;
+	}
+
+	const int64_t dumpTime = now();
+	size_t numEvents = 0;
+	bool first = true;
+	std::vector<Event> events;
+	std::vector<size_t> openScopes;
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fp);
+	for (const auto &thread : threads)
+	{
+		const uint64_t end = thread->written.load(std::memory_order_acquire);
+		const uint64_t begin = end > TRACE_EVENTS_PER_THREAD ? end - TRACE_EVENTS_PER_THREAD : 0;
+		events.clear();
+		for (uint64_t i = begin; i < end; ++i)
+		{
+			events.push_back(thread->events[i % TRACE_EVENTS_PER_THREAD]);
+		}
+		// The thread kept recording while we copied, drop anything it may have overwritten (or been writing) meanwhile
+		const uint64_t after = thread->written.load(std::memory_order_acquire);
+		const uint64_t firstIntact = after + 1 > TRACE_EVENTS_PER_THREAD ? after + 1 - TRACE_EVENTS_PER_THREAD : 0;
+		if (firstIntact > begin)
+		{
+			events.erase(events.begin(), events.begin() + static_cast<size_t>(std::min<uint64_t>(firstIntact - begin, events.size())));
+		}
+
+		// Pair up the scopes into complete events, which halves the file size
+		openScopes.clear();
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			const Event &event = events[i];
+			if (event.phase == 'B')
+			{
+				openScopes.push_back(i);
+			}
+			else if (event.phase == 'E')
+			{
+				if (openScopes.empty())
+				{
+					continue;  // Began before the oldest event still in the ring
+				}
+				const Event &scopeBegin = events[openScopes.back()];
+				openScopes.pop_back();
+				writeEvent(fp, first, scopeBegin, event.time - scopeBegin.time, thread->id);
+				++numEvents;
+			}
+			else
+			{
+				writeEvent(fp, first, event, 0, thread->id);
+				++numEvents;
+			}
+		}
+		for (size_t i : openScopes)
+		{
+			writeEvent(fp, first, events[i], dumpTime - events[i].time, thread->id);  // Still running
+			++numEvents;
+		}
+	}
+	fputs("\n]}\n", fp);
+	const bool success = ferror(fp) == 0;
+	fclose(fp);
+	debug(LOG_INFO, "Wrote %zu trace events from %zu threads to %s", numEvents, threads.size(), filename.c_str());
+	return success;
+}
+
+}
+
+#endif // WZ_PROFILING_TRACE
+
 struct Domain::Internal
 {
 #ifdef WZ_PROFILING_NVTX
@@ -99,6 +281,13 @@ Scope::Scope(const Domain *domain, const char *name)
 {
 	if (m_domain && name)
 	{
+		#ifdef WZ_PROFILING_TRACE
+		if (trace::enabled.load(std::memory_order_relaxed))
+		{
+			trace::record(nullptr, name, 'B');
+			m_traced = true;
+		}
+		#endif
 		#ifdef WZ_PROFILING_NVTX
 		{
 			nvtxRangePushA(name);
@@ -119,6 +308,13 @@ Scope::Scope(const Domain *domain, const char *object, const char *name)
 {
 	if (m_domain && object && name)
 	{
+		#ifdef WZ_PROFILING_TRACE
+		if (trace::enabled.load(std::memory_order_relaxed))
+		{
+			trace::record(object, name, 'B');
+			m_traced = true;
+		}
+		#endif
 		static char tmpBuffer[255];
 		std::snprintf(tmpBuffer, sizeof(tmpBuffer), "%s::%s", object, name);
 		#ifdef WZ_PROFILING_NVTX
@@ -139,6 +335,12 @@ Scope::Scope(const Domain *domain, const char *object, const char *name)
 Scope::~Scope()
 {
 	if (m_domain) {
+#ifdef WZ_PROFILING_TRACE
+		if (m_traced)
+		{
+			trace::record(nullptr, nullptr, 'E');
+		}
+#endif
 #ifdef WZ_PROFILING_NVTX
 		nvtxRangePop();
 #endif
@@ -153,6 +355,12 @@ void mark(const Domain *domain, const char *mark)
 {
 	if (!domain || !mark)
 		return;
+	#ifdef WZ_PROFILING_TRACE
+	if (trace::enabled.load(std::memory_order_relaxed))
+	{
+		trace::record(nullptr, mark, 'i');
+	}
+	#endif
 	#ifdef WZ_PROFILING_NVTX
 	{
 		nvtxEventAttributes_t eventAttrib = {};
@@ -175,6 +383,12 @@ void mark(const Domain *domain, const char *object, const char *mark)
 {
 	if (!domain || !object || !mark)
 		return;
+	#ifdef WZ_PROFILING_TRACE
+	if (trace::enabled.load(std::memory_order_relaxed))
+	{
+		trace::record(object, mark, 'i');
+	}
+	#endif
 	static char tmpBuffer[255];
 	std::snprintf(tmpBuffer, sizeof(tmpBuffer), "%s::%s", object, mark);
 
@@ -198,6 +412,51 @@ void mark(const Domain *domain, const char *object, const char *mark)
 	#endif
 }
 
+#ifdef WZ_PROFILING_TRACE
+
+bool startTrace(const std::string &filename)
+{
+	ASSERT_OR_RETURN(false, !filename.empty(), "No trace file name given");
+	{
+		std::lock_guard<std::mutex> lock(trace::mutex);
+		trace::filename = filename;
+	}
+	trace::enabled.store(true);
+	debug(LOG_INFO, "Recording profiling trace, will be written to %s", filename.c_str());
+	return true;
+}
+
+bool dumpTrace()
+{
+	return trace::dump();
+}
+
+void stopTrace()
+{
+	if (trace::enabled.exchange(false))
+	{
+		trace::dump();
+	}
+}
+
+#else // !WZ_PROFILING_TRACE
+
+bool startTrace(const std::string &)
+{
+	return false;
+}
+
+bool dumpTrace()
+{
+	return false;
+}
+
+void stopTrace()
+{
+}
+
+#endif // WZ_PROFILING_TRACE
+
 }
 
 #endif // defined(WZ_PROFILING_INSTRUMENTATION)
@@ -21,6 +21,8 @@
 
 #include "lib/framework/wzglobal.h" // required for config.h
 
+#include <string>
+
 #if defined(WZ_PROFILING_INSTRUMENTATION)
 
 #include <cstdint>
@@ -64,6 +66,7 @@ public:
 
 private:
 	const Domain* m_domain = nullptr;
+	bool m_traced = false;
 };
 
 extern Domain wzRootDomain;
@@ -71,6 +74,16 @@ extern Domain wzRootDomain;
 void mark(const Domain *domain, const char *mark);
 void mark(const Domain *domain, const char *object, const char *mark);
 
+/// Built-in trace backend (WZ_PROFILING_TRACE).
+/// Scopes and marks are recorded into a ring buffer per thread, holding the most recent events,
+/// and written out as a Chrome / Perfetto JSON trace (chrome://tracing, ui.perfetto.dev).
+/// Returns false if the backend isn't compiled in.
+bool startTrace(const std::string &filename);
+/// Writes everything recorded so far to the file given to startTrace(). Safe to call from any thread.
+bool dumpTrace();
+/// Writes the trace one last time, and stops recording.
+void stopTrace();
+
 }
 
 #define WZ_PROFILE_SCOPE(name) profiling::Scope mark_##name(&profiling::wzRootDomain, #name);
@@ -81,4 +94,12 @@ void mark(const Domain *domain, const char *object, const char *mark);
 #define WZ_PROFILE_SCOPE(name)
 #define WZ_PROFILE_SCOPE2(object, name)
 
+namespace profiling {
+
+inline bool startTrace(const std::string &) { return false; }
+inline bool dumpTrace() { return false; }
+inline void stopTrace() { }
+
+}
+
 #endif // defined(WZ_PROFILING_INSTRUMENTATION)
@@ -62,6 +62,7 @@
 
 #include <algorithm>
 #include <functional>
+#include <unordered_map>
 #ifndef GLM_ENABLE_EXPERIMENTAL
 	#define GLM_ENABLE_EXPERIMENTAL
 #endif
@@ -116,6 +117,22 @@ static ProjectileIterator psProjectileNext;
 /// </summary>
 static PagedEntityContainer<PROJECTILE> globalProjectileStorage;
 
+/// Grid lookup for splash damage, shared by all impacts in the same map area during one proj_UpdateAll.
+struct SPLASH_GRID_CELL
+{
+	size_t firstEntry, numEntries;  ///< Range in splashGridEntries.
+};
+
+// Splash lookups are cached per map area of this size, in world units.
+#define SPLASH_CELL_SHIFT (TILE_SHIFT + 3)
+// Each cached lookup covers its area plus this margin, so impacts with a radius up to this can use it.
+#define SPLASH_CELL_MARGIN (TILE_UNITS * 2)
+
+static std::unordered_map<uint64_t, SPLASH_GRID_CELL> splashGridCells;  ///< Keyed by map area.
+static GridEntryList splashGridEntries;
+static GridEntryList splashDirectEntries;  ///< Lookups which weren't cached.
+static bool splashGridCacheValid = false;  ///< Only while proj_UpdateAll runs, the grid isn't rebuilt then.
+
 /***************************************************************************/
 
 // the last unit that did damage - used by script functions
@@ -235,6 +252,9 @@ proj_FreeAllProjectiles()
 {
 	psProjectileList.clear();
 	psProjectileNext = psProjectileList.end();
+	splashGridCells.clear();
+	splashGridEntries.clear();
+	splashGridCacheValid = false;
 
 	globalProjectileStorage.clear();
 }
@@ -1006,14 +1026,56 @@ static PROJECTILE* proj_InFlightFunc(PROJECTILE *psProj)
 
 /***************************************************************************/
 
+/// Looks up the objects which gridStartIterate(x, y, radius) would return, as a range of entries, which may include more
+/// objects than that. Impacts in the same map area share one lookup, as long as the grid isn't rebuilt in between.
+static GridEntryList const &proj_splashGridEntries(int32_t x, int32_t y, uint32_t radius, size_t &firstEntry, size_t &numEntries)
+{
+	if (!splashGridCacheValid || radius > SPLASH_CELL_MARGIN)
+	{
+		splashDirectEntries = gridStartIterateAreaEntries(x - radius, y - radius, x + radius, y + radius);
+		firstEntry = 0;
+		numEntries = splashDirectEntries.size();
+		return splashDirectEntries;
+	}
+
+	int32_t cellX = x >> SPLASH_CELL_SHIFT;
+	int32_t cellY = y >> SPLASH_CELL_SHIFT;
+	uint64_t key = (uint64_t)(uint32_t)cellY << 32 | (uint32_t)cellX;
+	auto cell = splashGridCells.find(key);
+	if (cell != splashGridCells.end())
+	{
+		firstEntry = cell->second.firstEntry;
+		numEntries = cell->second.numEntries;
+		return splashGridEntries;
+	}
+
+	int32_t minX = (cellX << SPLASH_CELL_SHIFT) - SPLASH_CELL_MARGIN;
+	int32_t minY = (cellY << SPLASH_CELL_SHIFT) - SPLASH_CELL_MARGIN;
+	int32_t maxX = ((cellX + 1) << SPLASH_CELL_SHIFT) + SPLASH_CELL_MARGIN;
+	int32_t maxY = ((cellY + 1) << SPLASH_CELL_SHIFT) + SPLASH_CELL_MARGIN;
+	GridEntryList const &entries = gridStartIterateAreaEntries(minX, minY, maxX, maxY);
+	firstEntry = splashGridEntries.size();
+	numEntries = entries.size();
+	splashGridEntries.insert(splashGridEntries.end(), entries.begin(), entries.end());
+	splashGridCells.emplace(key, SPLASH_GRID_CELL{firstEntry, numEntries});
+	return splashGridEntries;
+}
+
 static void proj_radiusSweep(PROJECTILE *psObj, WEAPON_STATS *psStats, Vector3i &targetPos, bool empRadius)
 {
-	static GridList gridList;  // static to avoid allocations.
-	gridList = gridStartIterate(targetPos.x, targetPos.y, (empRadius) ? psStats->upgrade[psObj->player].empRadius : psStats->upgrade[psObj->player].radius);
+	uint32_t radius = (empRadius) ? psStats->upgrade[psObj->player].empRadius : psStats->upgrade[psObj->player].radius;
+	size_t firstEntry, numEntries;
+	GridEntryList const &entries = proj_splashGridEntries(targetPos.x, targetPos.y, radius, firstEntry, numEntries);
 
-	for (GridIterator gi = gridList.begin(); gi != gridList.end(); ++gi)
+	for (size_t n = firstEntry; n != firstEntry + numEntries; ++n)
 	{
-		BASE_OBJECT *psCurr = *gi;
+		GridEntry const &entry = entries[n];
+		if (!gridEntryInRadius(entry, targetPos.x, targetPos.y, radius))
+		{
+			continue;  // Would not have been found by gridStartIterate(targetPos.x, targetPos.y, radius).
+		}
+
+		BASE_OBJECT *psCurr = entry.psObj;
 		if (psCurr->died)
 		{
 			ASSERT(psCurr->type < OBJ_NUM_TYPES, "Bad pointer! type=%u", psCurr->type);
@@ -1056,7 +1118,7 @@ static void proj_radiusSweep(PROJECTILE *psObj, WEAPON_STATS *psStats, Vector3i
 		{
 			continue;  // Target in air, and can't shoot at air, or target on ground, and can't shoot at ground.
 		}
-		if (useSphere && !Vector3i_InSphere(psCurr->pos, targetPos, (empRadius) ? psStats->upgrade[psObj->player].empRadius : psStats->upgrade[psObj->player].radius))
+		if (useSphere && !Vector3i_InSphere(psCurr->pos, targetPos, radius))
 		{
 			continue;  // Target out of range.
 		}
@@ -1443,6 +1505,11 @@ void proj_UpdateAll()
 	spawnedProjectiles.reserve(psProjectileList.size());
 	spawnedProjectiles.clear();
 
+	// The grid isn't rebuilt until the next tick, so splash damage can share grid lookups until the end of the update.
+	splashGridCells.clear();
+	splashGridEntries.clear();
+	splashGridCacheValid = true;
+
 	// Update all projectiles.
 	// Penetrating projectiles may spawn additional projectiles,
 	// which will be returned from `PROJECTILE::update()`.
@@ -1456,6 +1523,8 @@ void proj_UpdateAll()
 		}
 	}
 
+	splashGridCacheValid = false;
+
 	// Remove and free dead projectiles.
 	psProjectileList.erase(std::remove_if(psProjectileList.begin(), psProjectileList.end(), [](PROJECTILE* p)
 	{
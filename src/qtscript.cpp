@@ -64,6 +64,7 @@
 #include "gamehistorylogger.h"
 #include "campaigninfo.h"
 #include "hci/quickchat.h"
+#include "terrain.h"
 
 #include <set>
 #include <memory>
@@ -1771,6 +1772,7 @@ void clearMarks()
 			psTile->tileInfoBits &= ~BITS_MARKED;
 		}
 	}
+	markLightmapAllDirty();
 }
 
 void scripting_engine::markAllLabels(bool only_active)
@@ -1875,6 +1877,7 @@ void scripting_engine::showLabel(const std::string &key, bool clear_old, bool ju
 			}
 		}
 	}
+	markLightmapAllDirty();
 }
 
 // The bool return value is true when an object callback needs to be called.
@@ -2816,6 +2819,7 @@ wzapi::no_return_value scripting_engine::hackMarkTiles_ByLabel(WZAPI_PARAMS(cons
 			}
 		}
 	}
+	markLightmapAllDirty();
 
 	return {};
 }
@@ -54,15 +54,19 @@
 #include "texture.h"
 #include "warzoneconfig.h"
 #include "order.h"
+#include "wrappers.h"
 #ifndef GLM_ENABLE_EXPERIMENTAL
 	#define GLM_ENABLE_EXPERIMENTAL
 #endif
 #include <glm/gtx/transform.hpp>
+#include <algorithm>
+#include <vector>
 
 #define HIT_NOTIFICATION	(GAME_TICKS_PER_SEC * 2)
 #define RADAR_FRAME_SKIP	10
 
 static void applyMinimapOverlay();
+static void clearMinimapOverlay();
 
 bool bEnemyAllyRadarColor = false;     			/**< Enemy/ally radar color. */
 RADAR_DRAW_MODE	radarDrawMode = RADAR_MODE_DEFAULT;	/**< Current mini-map mode. */
@@ -73,6 +77,11 @@ static PIELIGHT		colRadarAlly, colRadarMe, colRadarEnemy;
 static PIELIGHT		tileColours[MAX_TILES];
 static iV_Image		radarBitmap;
 static UDWORD		*radarOverlayBuffer = nullptr;
+static std::vector<PIELIGHT>	radarTerrainColours;	///< The terrain layer of radarBitmap, without any objects on it
+static std::vector<uint64_t>	radarTileKeys;		///< What each terrain pixel was last drawn from, so unchanged tiles can be skipped
+static std::vector<size_t>	radarOverlayPixels;	///< Pixels of radarOverlayBuffer set on the last refresh
+static RADAR_DRAW_MODE	radarKeysDrawMode = NUM_RADAR_MODES;
+static bool		radarKeysRevealed = false;
 static Vector3i		playerpos = {0, 0, 0};
 
 class RadarWidget : public WIDGET {
@@ -154,6 +163,8 @@ static UDWORD lastBlink = 0;
 static const UDWORD BLINK_INTERVAL = GAME_TICKS_PER_SEC / 1;
 static const UDWORD BLINK_HALF_INTERVAL = BLINK_INTERVAL / 2;
 static const float OVERLAY_OPACITY = 0.5f;
+static const uint64_t RADAR_TILE_KEY_INVALID = UINT64_MAX;
+static const uint64_t RADAR_TILE_KEY_BORDER = UINT64_MAX - 1;
 
 // taken from https://en.wikipedia.org/wiki/Alpha_compositing
 PIELIGHT inline mix(PIELIGHT over, PIELIGHT base)
@@ -199,7 +210,7 @@ PIELIGHT inline applyAlpha(PIELIGHT color, float alpha)
 	return ret;
 }
 
-static void DrawRadarTiles();
+static bool DrawRadarTiles();
 static void DrawRadarObjects();
 static void DrawRadarExtras(const glm::mat4 &modelViewProjectionMatrix);
 static void DrawNorth(const glm::mat4 &modelViewProjectionMatrix);
@@ -261,6 +272,11 @@ bool resizeRadar()
 	if (radarOverlayBuffer)
 	{
 		free(radarOverlayBuffer);
+		radarOverlayBuffer = nullptr;
+	}
+	if (skipDisplayOnlyWork())
+	{
+		return true; // the radar is never drawn, so don't allocate its bitmaps
 	}
 	radarTexWidth = static_cast<size_t>(std::abs(scrollMaxX - scrollMinX));
 	radarTexHeight = static_cast<size_t>(std::abs(scrollMaxY - scrollMinY));
@@ -268,6 +284,9 @@ bool resizeRadar()
 	radarBitmap.allocate(radarTexWidth, radarTexHeight, 4, true);
 	radarOverlayBuffer = (uint32_t*)malloc(radarBufferSize);
 	memset(radarOverlayBuffer, 0, radarBufferSize);
+	radarTerrainColours.assign(radarTexWidth * radarTexHeight, WZCOL_BLACK);
+	radarTileKeys.assign(radarTexWidth * radarTexHeight, RADAR_TILE_KEY_INVALID);
+	radarOverlayPixels.clear();
 	frameSkip = 0;
 	if (rotateRadar)
 	{
@@ -289,6 +308,9 @@ bool ShutdownRadar()
 	radarBitmap.clear();
 	free(radarOverlayBuffer);
 	radarOverlayBuffer = nullptr;
+	radarTerrainColours.clear();
+	radarTileKeys.clear();
+	radarOverlayPixels.clear();
 	frameSkip = 0;
 	if (pRadarWidget)
 	{
@@ -376,10 +398,15 @@ void drawRadar()
 
 	if (frameSkip <= 0)
 	{
-		DrawRadarTiles();
+		const bool hadObjects = !radarOverlayPixels.empty();
+		clearMinimapOverlay();
+		const bool terrainChanged = DrawRadarTiles();
 		DrawRadarObjects();
 		applyMinimapOverlay();
-		pie_DownLoadRadar(radarBitmap);
+		if (terrainChanged || hadObjects || !radarOverlayPixels.empty())
+		{
+			pie_DownLoadRadar(radarBitmap);
+		}
 		frameSkip = RADAR_FRAME_SKIP;
 	}
 	frameSkip--;
@@ -494,36 +521,68 @@ static PIELIGHT inline appliedRadarColour(RADAR_DRAW_MODE drawMode, MAPTILE *WTi
 	return WScr;
 }
 
-/** Draw the map tiles on the radar. */
-static void DrawRadarTiles()
+static inline void setRadarPixel(size_t pos, PIELIGHT colour)
+{
+	unsigned char* pixel = radarBitmap.bmp_w() + pos * 4;
+	ASSERT(pos * 4 + 3 < radarBitmap.size_in_bytes(), "Buffer overrun");
+	pixel[0] = colour.byte.r;
+	pixel[1] = colour.byte.g;
+	pixel[2] = colour.byte.b;
+	pixel[3] = colour.byte.a;
+}
+
+/** Everything appliedRadarColour() reads from the tile, packed together. */
+static inline uint64_t radarTileKey(MAPTILE *psTile, bool revealed)
 {
-	SDWORD	x, y;
-	size_t radarBufferSize2 = radarBitmap.size_in_bytes();
-	unsigned char* pRaderBuffer = radarBitmap.bmp_w();
+	const bool visible = TEST_TILE_VISIBLE_TO_SELECTEDPLAYER(psTile);
+	const bool sensor = (revealed || visible) && (radarDrawMode == RADAR_MODE_TERRAIN || radarDrawMode == RADAR_MODE_COMBINED) && hasSensorOnTile(psTile, selectedPlayer);
+	return (uint64_t)psTile->texture | (uint64_t)psTile->illumination << 16 | (uint64_t)(uint32_t)psTile->height << 24
+	       | (uint64_t)visible << 56 | (uint64_t)sensor << 57;
+}
 
-	for (x = scrollMinX; x < scrollMaxX; x++)
+/** Draw the map tiles on the radar. Only tiles that changed since the last call are redrawn, returns whether there were any. */
+static bool DrawRadarTiles()
+{
+	const bool revealed = getRevealStatus();
+	if (radarDrawMode != radarKeysDrawMode || revealed != radarKeysRevealed)
 	{
-		for (y = scrollMinY; y < scrollMaxY; y++)
+		std::fill(radarTileKeys.begin(), radarTileKeys.end(), RADAR_TILE_KEY_INVALID);
+		radarKeysDrawMode = radarDrawMode;
+		radarKeysRevealed = revealed;
+	}
+
+	bool changed = false;
+	for (SDWORD y = scrollMinY; y < scrollMaxY; y++)
+	{
+		for (SDWORD x = scrollMinX; x < scrollMaxX; x++)
 		{
 			MAPTILE	*psTile = mapTile(x, y);
-			size_t pixelStartPos = (radarTexWidth * (y - scrollMinY) + (x - scrollMinX)) * 4;
+			size_t pos = radarTexWidth * (y - scrollMinY) + (x - scrollMinX);
 
-			ASSERT(pixelStartPos < radarBufferSize2, "Buffer overrun");
-			if (y == scrollMinY || x == scrollMinX || y == scrollMaxY - 1 || x == scrollMaxX - 1)
+			ASSERT(pos < radarTileKeys.size(), "Buffer overrun");
+			const bool border = y == scrollMinY || x == scrollMinX || y == scrollMaxY - 1 || x == scrollMaxX - 1;
+			const uint64_t key = border ? RADAR_TILE_KEY_BORDER : radarTileKey(psTile, revealed);
+			if (key == radarTileKeys[pos])
 			{
-				pRaderBuffer[pixelStartPos] = WZCOL_BLACK.byte.r;
-				pRaderBuffer[pixelStartPos + 1] = WZCOL_BLACK.byte.g;
-				pRaderBuffer[pixelStartPos + 2] = WZCOL_BLACK.byte.b;
-				pRaderBuffer[pixelStartPos + 3] = WZCOL_BLACK.byte.a;
 				continue;
 			}
-			auto radarColor = appliedRadarColour(radarDrawMode, psTile);
-			pRaderBuffer[pixelStartPos] = radarColor.byte.r;
-			pRaderBuffer[pixelStartPos + 1] = radarColor.byte.g;
-			pRaderBuffer[pixelStartPos + 2] = radarColor.byte.b;
-			pRaderBuffer[pixelStartPos + 3] = radarColor.byte.a;
+			radarTileKeys[pos] = key;
+			radarTerrainColours[pos] = border ? WZCOL_BLACK : appliedRadarColour(radarDrawMode, psTile);
+			setRadarPixel(pos, radarTerrainColours[pos]);
+			changed = true;
 		}
 	}
+	return changed;
+}
+
+static inline void setRadarOverlay(size_t pos, UDWORD colour)
+{
+	ASSERT(pos * sizeof(*radarOverlayBuffer) < radarBufferSize, "Buffer overrun");
+	if (radarOverlayBuffer[pos] == 0)
+	{
+		radarOverlayPixels.push_back(pos);
+	}
+	radarOverlayBuffer[pos] = colour;
 }
 
 /** Draw the droids and structure positions on the radar. */
@@ -532,7 +591,6 @@ static void DrawRadarObjects()
 	UBYTE				clan;
 	PIELIGHT			playerCol;
 	PIELIGHT			flashCol;
-	memset(radarOverlayBuffer, 0, radarBufferSize);
 	bool blinkState = (gameTime - lastBlink) / BLINK_HALF_INTERVAL;
 
 	/* Show droids on map - go through all players */
@@ -576,78 +634,83 @@ static void DrawRadarObjects()
 				int	y = psDroid->pos.y / TILE_UNITS;
 				size_t	pos = (x - scrollMinX) + (y - scrollMinY) * radarTexWidth;
 
-				ASSERT(pos * sizeof(*radarOverlayBuffer) < radarBufferSize, "Buffer overrun");
 				if (clan == selectedPlayer && gameTime > HIT_NOTIFICATION && gameTime - psDroid->timeLastHit < HIT_NOTIFICATION)
 				{
 					if (psDroid->selected && !blinkState)
-						radarOverlayBuffer[pos] = applyAlpha(flashCol, OVERLAY_OPACITY).rgba;
+						setRadarOverlay(pos, applyAlpha(flashCol, OVERLAY_OPACITY).rgba);
 					else
-						radarOverlayBuffer[pos] = flashCol.rgba;
+						setRadarOverlay(pos, flashCol.rgba);
 				}
 				else
 				{
 					if (psDroid->selected && !blinkState)
-						radarOverlayBuffer[pos] = applyAlpha(playerCol, OVERLAY_OPACITY).rgba;
+						setRadarOverlay(pos, applyAlpha(playerCol, OVERLAY_OPACITY).rgba);
 					else
-						radarOverlayBuffer[pos] = playerCol.rgba;
+						setRadarOverlay(pos, playerCol.rgba);
 				}
 			}
 		}
 	}
 
-	/* Do the same for structures */
-	for (SDWORD x = scrollMinX; x < scrollMaxX; x++)
+	/* Do the same for structures, painting every tile of their footprint */
+	for (clan = 0; clan < MAX_PLAYERS; clan++)
 	{
-		for (SDWORD y = scrollMinY; y < scrollMaxY; y++)
+		//see if have to draw enemy/ally color
+		if (bEnemyAllyRadarColor)
 		{
-			MAPTILE		*psTile = mapTile(x, y);
-			STRUCTURE	*psStruct;
-			size_t		pos = (x - scrollMinX) + (y - scrollMinY) * radarTexWidth;
+			if (clan == selectedPlayer)
+			{
+				playerCol = colRadarMe;
+			}
+			else
+			{
+				playerCol = (selectedPlayer < MAX_PLAYERS && aiCheckAlliances(selectedPlayer, clan) ? colRadarAlly : colRadarEnemy);
+			}
+		}
+		else
+		{
+			//original 8-color mode
+			playerCol = clanColours[getPlayerColour(clan)];
+		}
+		flashCol = flashColours[getPlayerColour(clan)];
 
-			ASSERT(pos * sizeof(*radarOverlayBuffer) < radarBufferSize, "Buffer overrun");
-			if (!TileHasStructure(psTile))
+		for (STRUCTURE *psStruct : apsStructLists[clan])
+		{
+			if (!psStruct->visibleForLocalDisplay()
+			    && !(bMultiPlayer && alliancesSharedVision(game.alliance)
+			         && selectedPlayer < MAX_PLAYERS && aiCheckAlliances(selectedPlayer, psStruct->player)))
 			{
 				continue;
 			}
-			psStruct = (STRUCTURE *)psTile->psObject;
-			clan = psStruct->player;
 
-			//see if have to draw enemy/ally color
-			if (bEnemyAllyRadarColor)
+			UDWORD colour;
+			if (clan == selectedPlayer && gameTime > HIT_NOTIFICATION && gameTime - psStruct->timeLastHit < HIT_NOTIFICATION)
 			{
-				if (clan == selectedPlayer)
-				{
-					playerCol = colRadarMe;
-				}
+				if (psStruct->player == selectedPlayer && psStruct->selected && !blinkState)
+					colour = applyAlpha(flashCol, OVERLAY_OPACITY).rgba;
 				else
-				{
-					playerCol = (selectedPlayer < MAX_PLAYERS && aiCheckAlliances(selectedPlayer, clan) ? colRadarAlly : colRadarEnemy);
-				}
+					colour = flashCol.rgba;
 			}
 			else
 			{
-				//original 8-color mode
-				playerCol = clanColours[getPlayerColour(clan)];
+				if (psStruct->player == selectedPlayer && psStruct->selected && !blinkState)
+					colour = applyAlpha(playerCol, OVERLAY_OPACITY).rgba;
+				else
+					colour = playerCol.rgba;
 			}
-			flashCol = flashColours[getPlayerColour(clan)];
 
-			if (psStruct->visibleForLocalDisplay()
-			    || (bMultiPlayer && alliancesSharedVision(game.alliance)
-			        && selectedPlayer < MAX_PLAYERS && aiCheckAlliances(selectedPlayer, psStruct->player)))
+			const StructureBounds b = getStructureBounds(psStruct);
+			const int x1 = std::max<int>(b.map.x, scrollMinX), x2 = std::min<int>(b.map.x + b.size.x, scrollMaxX);
+			const int y1 = std::max<int>(b.map.y, scrollMinY), y2 = std::min<int>(b.map.y + b.size.y, scrollMaxY);
+			for (int y = y1; y < y2; y++)
 			{
-				if (clan == selectedPlayer && gameTime > HIT_NOTIFICATION && gameTime - psStruct->timeLastHit < HIT_NOTIFICATION)
+				for (int x = x1; x < x2; x++)
 				{
-					if (psStruct->player == selectedPlayer && psStruct->selected && !blinkState)
-						radarOverlayBuffer[pos] = applyAlpha(flashCol, OVERLAY_OPACITY).rgba;
-					else
-						radarOverlayBuffer[pos] = flashCol.rgba;
-				}
-				else
-				{
-					if (psStruct->player == selectedPlayer && psStruct->selected && !blinkState)
-						radarOverlayBuffer[pos] = applyAlpha(playerCol, OVERLAY_OPACITY).rgba;
-					else
-						radarOverlayBuffer[pos] = playerCol.rgba;
+					if (mapTile(x, y)->psObject != psStruct)
+					{
+						continue;  // Only the tiles the structure actually sits on
+					}
+					setRadarOverlay((x - scrollMinX) + (y - scrollMinY) * radarTexWidth, colour);
 				}
 			}
 		}
@@ -658,24 +721,22 @@ static void DrawRadarObjects()
 
 static void applyMinimapOverlay()
 {
-	size_t radarTexCount = radarTexWidth * radarTexHeight;
-	size_t radarBufferSize2 = radarBitmap.size_in_bytes();
-	unsigned char* pRaderBuffer = radarBitmap.bmp_w();
-	ASSERT(radarTexCount * static_cast<size_t>(radarBitmap.channels()) <= radarBufferSize2, "Buffer overrun");
-	ASSERT(radarTexCount * static_cast<size_t>(radarBitmap.channels()) <= radarBufferSize, "Buffer overrun");
-	for (size_t i = 0; i < radarTexCount; i++)
+	for (size_t pos : radarOverlayPixels)
+	{
+		PIELIGHT overColor = PLfromUDWORD(radarOverlayBuffer[pos]);
+		setRadarPixel(pos, mix(overColor, radarTerrainColours[pos]));
+	}
+}
+
+/** Puts the terrain back under the objects from the last refresh, instead of redrawing the whole map. */
+static void clearMinimapOverlay()
+{
+	for (size_t pos : radarOverlayPixels)
 	{
-		if (radarOverlayBuffer[i] == 0)
-			continue;
-		size_t pixelStartPos = (i * 4);
-		PIELIGHT baseColor = pal_RGBA(pRaderBuffer[pixelStartPos], pRaderBuffer[pixelStartPos + 1], pRaderBuffer[pixelStartPos + 2], pRaderBuffer[pixelStartPos + 3]);
-		PIELIGHT overColor = PLfromUDWORD(radarOverlayBuffer[i]);
-		PIELIGHT mixedColor = mix(overColor, baseColor);
-		pRaderBuffer[pixelStartPos] = mixedColor.byte.r;
-		pRaderBuffer[pixelStartPos + 1] = mixedColor.byte.g;
-		pRaderBuffer[pixelStartPos + 2] = mixedColor.byte.b;
-		pRaderBuffer[pixelStartPos + 3] = mixedColor.byte.a;
+		radarOverlayBuffer[pos] = 0;
+		setRadarPixel(pos, radarTerrainColours[pos]);
 	}
+	radarOverlayPixels.clear();
 }
 
 /** Rotate an array of 2d vectors about a given angle, also translates them after rotating. */
@@ -823,6 +884,7 @@ void radarColour(UDWORD tileNumber, uint8_t r, uint8_t g, uint8_t b)
 	tileColours[tileNumber].byte.g = g;
 	tileColours[tileNumber].byte.b = b;
 	tileColours[tileNumber].byte.a = 255;
+	std::fill(radarTileKeys.begin(), radarTileKeys.end(), RADAR_TILE_KEY_INVALID);
 }
 
 
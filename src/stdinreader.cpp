@@ -26,6 +26,7 @@
 #include "multistat.h"
 #include "multilobbycommands.h"
 #include "clparse.h"
+#include "profiling.h"
 
 #include <string>
 #include <atomic>
@@ -1040,6 +1041,18 @@ int cmdInputThreadFunc(void *)
 				}
 			}
 		}
+		else if(!strncmpl(line, "trace dump"))
+		{
+			// Safe from this thread, and doesn't wait for the main loop (which may be what's being looked at)
+			if (profiling::dumpTrace())
+			{
+				wz_command_interface_output_onmainthread("WZCMD info: Profiling trace written\n");
+			}
+			else
+			{
+				wz_command_interface_output_onmainthread("WZCMD error: Failed to write profiling trace! (Not started with --profile-trace?)\n");
+			}
+		}
 		else if(!strncmpl(line, "shutdown now"))
 		{
 			inexit = true;
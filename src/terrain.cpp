@@ -47,6 +47,7 @@
 #include "lib/ivis_opengl/pielighting.h"
 #include "lib/ivis_opengl/piematrix.h"
 #include "lib/ivis_opengl/piedraw.h"
+#include "lib/ivis_opengl/culling.h"
 #include <glm/mat4x4.hpp>
 #ifndef GLM_ENABLE_EXPERIMENTAL
 	#define GLM_ENABLE_EXPERIMENTAL
@@ -61,10 +62,14 @@
 #include "loop.h"
 #include "wzcrashhandlingproviders.h"
 #include "lighting.h"
+#include "wrappers.h"
 
 #include "profiling.h"
+#include "parallel.h"
 
 #include <cstdint>
+#include <algorithm>
+#include <limits>
 
 // TODO: Fix and remove after merging terrain rendering changes
 #if defined(__clang__)
@@ -96,10 +101,21 @@ struct Sector
 	int decalSize = 0;           ///< Size of the part of the decal VBO we are going to use
 	int terrainAndDecalOffset = 0;
 	int terrainAndDecalSize = 0;
+	float minHeight = 0.f;   ///< Lowest terrain or water vertex, for frustum culling
+	float maxHeight = 0.f;   ///< Highest terrain or water vertex, for frustum culling
 	bool draw;               ///< Do we draw this sector this frame?
 	bool dirty;              ///< Do we need to update the geometry for this sector?
 };
 
+/// A node of the quadtree over the sectors, used to frustum cull many sectors at once
+struct SectorQuadNode
+{
+	int x1, y1, x2, y2;      ///< Sectors covered, from (x1, y1) up to but not including (x2, y2)
+	float minHeight;         ///< Lowest vertex of all sectors covered
+	float maxHeight;         ///< Highest vertex of all sectors covered
+	int children[4];         ///< Indices of the child nodes, -1 if unused. All -1 for a single sector
+};
+
 // VBO for gfx_api::TerrainLayer and TerrainDepth
 struct TerrainVertex
 {
@@ -115,6 +131,16 @@ struct DecalVertex
 
 using WaterVertex = glm::vec4; // w is depth
 
+/// New geometry for a dirty sector, built off the main thread before it is uploaded
+struct SectorRebuild
+{
+	int x, y;
+	std::vector<TerrainVertex> geometry;
+	std::vector<WaterVertex> water;
+	std::vector<DecalVertex> decals;
+	std::vector<gfx_api::TerrainDecalVertex> terrainDecals;
+};
+
 /// The lightmap texture
 static gfx_api::texture* lightmap_texture = nullptr;
 /// When are we going to update the lightmap next?
@@ -135,6 +161,21 @@ struct LightmapCalculatedValues
 static LightmapCalculatedValues lightmapValues;
 /// Ticks per lightmap refresh
 static const unsigned int LIGHTMAP_REFRESH = 80;
+/// A rectangle of tiles whose lightmap texels may have changed, from (x1, y1) up to but not including (x2, y2)
+struct LightmapDirtyRect
+{
+	int x1, y1, x2, y2;
+};
+/// Past this many dirty rects, they are collapsed into their bounding box
+#define LIGHTMAP_MAX_DIRTY_RECTS 64
+/// Areas of the lightmap to recalculate on the next refresh
+static std::vector<LightmapDirtyRect> lightmapDirtyRects;
+/// Areas being recalculated by the current refresh
+static std::vector<LightmapDirtyRect> lightmapUpdateRects;
+/// Holds a changed area of the lightmap while it is uploaded
+static iV_Image lightmapSubImage;
+/// Value of showGateways at the last lightmap refresh
+static bool lightmapShowGateways = false;
 
 /// VBOs
 static gfx_api::buffer *geometryVBO = nullptr, *geometryIndexVBO = nullptr, *textureVBO = nullptr, *textureIndexVBO = nullptr, *decalVBO = nullptr;
@@ -159,7 +200,15 @@ static int xSectors, ySectors;
 /// Did we initialise the terrain renderer yet?
 static bool terrainInitialised = false;
 
-static std::vector<gfx_api::TerrainDecalVertex> terrainDecalVertexUpdateBuffer;
+/// Quadtree over the sectors, the root is the first node
+static std::vector<SectorQuadNode> sectorQuadTree;
+/// Have sector height ranges changed since the quadtree was last refreshed?
+static bool sectorQuadHeightsDirty = false;
+/// Dirty sectors in view, rebuilt this frame. Reused to avoid repeated allocations
+static std::vector<SectorRebuild> sectorRebuilds;
+static size_t sectorRebuildCount = 0;
+/// Fewest sectors worth handing to a worker thread
+#define SECTOR_REBUILD_CHUNK_SIZE 1
 
 /// Helper to specify the offset in a VBO
 #define BUFFER_OFFSET(i) (reinterpret_cast<char *>(i))
@@ -663,34 +712,77 @@ static void setSectorDecalVertex_SinglePass(int x, int y, gfx_api::TerrainDecalV
 }
 
 /**
- * Update the sector for when the terrain is changed.
+ * Set the height range of a sector from its geometry, for culling.
+ */
+static void setSectorHeightRange(Sector &sector, const TerrainVertex *geometry, const WaterVertex *water)
+{
+	float minHeight = std::numeric_limits<float>::max();
+	float maxHeight = std::numeric_limits<float>::lowest();
+	for (int i = 0; i < sector.geometrySize; ++i)
+	{
+		minHeight = std::min(minHeight, geometry[i].pos.y);
+		maxHeight = std::max(maxHeight, geometry[i].pos.y);
+	}
+	for (int i = 0; i < sector.waterSize; ++i)
+	{
+		minHeight = std::min(minHeight, water[i].y);
+		maxHeight = std::max(maxHeight, water[i].y);
+	}
+	sector.minHeight = minHeight;
+	sector.maxHeight = maxHeight;
+}
+
+/**
+ * Calculate the new geometry of a sector for when the terrain is changed.
+ * Only reads the map and writes to rebuild and the sector's height range, so it is safe to run on worker threads.
  */
-static void updateSectorGeometry(int x, int y)
+static void buildSectorGeometry(SectorRebuild &rebuild)
 {
-	TerrainVertex *geometry;
-	WaterVertex *water;
-	DecalVertex *decaldata;
+	const int x = rebuild.x, y = rebuild.y;
+	Sector &sector = sectors[x * ySectors + y];
 	int geometrySize = 0;
 	int waterSize = 0;
-	int decalSize = 0;
 
-	geometry = new TerrainVertex[sectors[x * ySectors + y].geometrySize];
-	water = (WaterVertex *)malloc(sizeof(WaterVertex) * sectors[x * ySectors + y].waterSize);
+	rebuild.geometry.resize(sector.geometrySize);
+	rebuild.water.resize(sector.waterSize);
+	setSectorGeometry(x, y, rebuild.geometry.data(), rebuild.water.data(), &geometrySize, &waterSize);
+	ASSERT(geometrySize == sector.geometrySize, "something went seriously wrong updating the terrain");
+	ASSERT(waterSize    == sector.waterSize   , "something went seriously wrong updating the terrain");
+	setSectorHeightRange(sector, rebuild.geometry.data(), rebuild.water.data());
 
-	setSectorGeometry(x, y, geometry, water, &geometrySize, &waterSize);
-	ASSERT(geometrySize == sectors[x * ySectors + y].geometrySize, "something went seriously wrong updating the terrain");
-	ASSERT(waterSize    == sectors[x * ySectors + y].waterSize   , "something went seriously wrong updating the terrain");
+	if (terrainShaderType == TerrainShaderType::FALLBACK)
+	{
+		int decalSize = 0;
+		rebuild.decals.resize(std::max(sector.decalSize, 0));
+		if (sector.decalSize > 0)
+		{
+			setSectorDecals(x, y, rebuild.decals.data(), &decalSize);
+			ASSERT(decalSize == sector.decalSize   , "the amount of decals has changed");
+		}
+	}
+	else
+	{
+		int terrainDecalSize = 0;
+		rebuild.terrainDecals.resize(sector.terrainAndDecalSize);
+		setSectorDecalVertex_SinglePass(x, y, rebuild.terrainDecals.data(), &terrainDecalSize);
+		ASSERT(terrainDecalSize == sector.terrainAndDecalSize, "Sizes don't match!");
+	}
+}
+
+/**
+ * Upload the geometry built by buildSectorGeometry.
+ */
+static void updateSectorGeometry(const SectorRebuild &rebuild)
+{
+	const int x = rebuild.x, y = rebuild.y;
 
 	geometryVBO->update(sizeof(TerrainVertex)*sectors[x * ySectors + y].geometryOffset,
-							sizeof(TerrainVertex)*sectors[x * ySectors + y].geometrySize, geometry,
+							sizeof(TerrainVertex)*sectors[x * ySectors + y].geometrySize, rebuild.geometry.data(),
 							gfx_api::buffer::update_flag::non_overlapping_updates_promise);
 	waterVBO->update(sizeof(WaterVertex)*sectors[x * ySectors + y].waterOffset,
-					 sizeof(WaterVertex)*sectors[x * ySectors + y].waterSize, water,
+					 sizeof(WaterVertex)*sectors[x * ySectors + y].waterSize, rebuild.water.data(),
 					 gfx_api::buffer::update_flag::non_overlapping_updates_promise);
 
-	delete[] geometry;
-	free(water);
-
 	if (terrainShaderType == TerrainShaderType::FALLBACK)
 	{
 		if (sectors[x * ySectors + y].decalSize <= 0)
@@ -699,40 +791,79 @@ static void updateSectorGeometry(int x, int y)
 			return;
 		}
 
-		decaldata = (DecalVertex *)malloc(sizeof(DecalVertex) * sectors[x * ySectors + y].decalSize);
-		setSectorDecals(x, y, decaldata, &decalSize);
-		ASSERT(decalSize == sectors[x * ySectors + y].decalSize   , "the amount of decals has changed");
-
-		if (decalSize > 0)
+		if (decalVBO)
 		{
-			if (decalVBO)
-			{
-				decalVBO->update(sizeof(DecalVertex)*sectors[x * ySectors + y].decalOffset,
-								 sizeof(DecalVertex)*sectors[x * ySectors + y].decalSize, decaldata,
-								 gfx_api::buffer::update_flag::non_overlapping_updates_promise);
-			}
-			else
-			{
-				// didn't have decals, but now we do??
-				// code needs a refactoring if this is the case
-				ASSERT(false, "Didn't have decals, but now we do. Unsupported.");
-			}
+			decalVBO->update(sizeof(DecalVertex)*sectors[x * ySectors + y].decalOffset,
+							 sizeof(DecalVertex)*sectors[x * ySectors + y].decalSize, rebuild.decals.data(),
+							 gfx_api::buffer::update_flag::non_overlapping_updates_promise);
+		}
+		else
+		{
+			// didn't have decals, but now we do??
+			// code needs a refactoring if this is the case
+			ASSERT(false, "Didn't have decals, but now we do. Unsupported.");
 		}
-
-		free(decaldata);
 	}
 	else
 	{
-		terrainDecalVertexUpdateBuffer.resize(sectors[x * ySectors + y].terrainAndDecalSize); // reuse a buffer to avoid repeated allocations if possible
-		int terrainDecalSize = 0;
-		setSectorDecalVertex_SinglePass(x, y, terrainDecalVertexUpdateBuffer.data(), &terrainDecalSize);
-		ASSERT(terrainDecalSize == sectors[x * ySectors + y].terrainAndDecalSize, "Sizes don't match!");
 		terrainDecalVBO->update(sizeof(gfx_api::TerrainDecalVertex)*sectors[x * ySectors + y].terrainAndDecalOffset,
-							 sizeof(gfx_api::TerrainDecalVertex)*sectors[x * ySectors + y].terrainAndDecalSize, terrainDecalVertexUpdateBuffer.data(),
+							 sizeof(gfx_api::TerrainDecalVertex)*sectors[x * ySectors + y].terrainAndDecalSize, rebuild.terrainDecals.data(),
 							 gfx_api::buffer::update_flag::non_overlapping_updates_promise);
 	}
 }
 
+/**
+ * Build the quadtree node covering sectors (x1, y1) up to but not including (x2, y2), and its children.
+ */
+static int buildSectorQuadNode(int x1, int y1, int x2, int y2)
+{
+	const int index = static_cast<int>(sectorQuadTree.size());
+	sectorQuadTree.push_back({x1, y1, x2, y2, 0.f, 0.f, {-1, -1, -1, -1}});
+	if (x2 - x1 <= 1 && y2 - y1 <= 1)
+	{
+		return index;  // A single sector
+	}
+
+	const int midX = (x1 + x2 + 1) / 2;
+	const int midY = (y1 + y2 + 1) / 2;
+	const int ranges[4][4] = {{x1, y1, midX, midY}, {midX, y1, x2, midY}, {x1, midY, midX, y2}, {midX, midY, x2, y2}};
+	int numChildren = 0;
+	for (const auto &range : ranges)
+	{
+		if (range[0] < range[2] && range[1] < range[3])
+		{
+			const int child = buildSectorQuadNode(range[0], range[1], range[2], range[3]);
+			sectorQuadTree[index].children[numChildren++] = child;  // Not a reference, the vector may have grown
+		}
+	}
+	return index;
+}
+
+/**
+ * Refresh the height ranges of a quadtree node and its children from the sectors.
+ */
+static void updateSectorQuadHeights(int index)
+{
+	SectorQuadNode &node = sectorQuadTree[index];
+	if (node.children[0] == -1)
+	{
+		node.minHeight = sectors[node.x1 * ySectors + node.y1].minHeight;
+		node.maxHeight = sectors[node.x1 * ySectors + node.y1].maxHeight;
+		return;
+	}
+	node.minHeight = std::numeric_limits<float>::max();
+	node.maxHeight = std::numeric_limits<float>::lowest();
+	for (int child : node.children)
+	{
+		if (child != -1)
+		{
+			updateSectorQuadHeights(child);
+			node.minHeight = std::min(node.minHeight, sectorQuadTree[child].minHeight);
+			node.maxHeight = std::max(node.maxHeight, sectorQuadTree[child].maxHeight);
+		}
+	}
+}
+
 /**
  * Mark all tiles that are influenced by this grid point as dirty.
  * Dirty sectors will later get updated by updateSectorGeometry.
@@ -746,11 +877,25 @@ void markTileDirty(int i, int j)
 		return; // will be updated anyway
 	}
 
+	// Widen the height ranges used for culling until the sectors get rebuilt, in case the tile moved out of them
+	float minHeight = 0.f, maxHeight = 0.f;
+	if (tileOnMap(i, j))
+	{
+		minHeight = std::min({map_TileHeight(i, j), map_WaterHeight(i, j), map_TileHeightSurface(i, j)});
+		maxHeight = std::max({map_TileHeight(i, j), map_WaterHeight(i, j), map_TileHeightSurface(i, j)});
+	}
+	auto markSectorDirty = [minHeight, maxHeight](Sector &sector) {
+		sector.dirty = true;
+		sector.minHeight = std::min(sector.minHeight, minHeight);
+		sector.maxHeight = std::max(sector.maxHeight, maxHeight);
+	};
+	sectorQuadHeightsDirty = true;
+
 	x = i / sectorSize;
 	y = j / sectorSize;
 	if (x < xSectors && y < ySectors) // could be on the lower or left edge of the map
 	{
-		sectors[x * ySectors + y].dirty = true;
+		markSectorDirty(sectors[x * ySectors + y]);
 	}
 
 	// it could be on an edge, so update for all sectors it is in
@@ -758,21 +903,21 @@ void markTileDirty(int i, int j)
 	{
 		if (x - 1 < xSectors && y < ySectors)
 		{
-			sectors[(x - 1)*ySectors + y].dirty = true;
+			markSectorDirty(sectors[(x - 1)*ySectors + y]);
 		}
 	}
 	if (y * sectorSize == j && y > 0)
 	{
 		if (x < xSectors && y - 1 < ySectors)
 		{
-			sectors[x * ySectors + (y - 1)].dirty = true;
+			markSectorDirty(sectors[x * ySectors + (y - 1)]);
 		}
 	}
 	if (x * sectorSize == i && x > 0 && y * sectorSize == j && y > 0)
 	{
 		if (x - 1 < xSectors && y - 1 < ySectors)
 		{
-			sectors[(x - 1)*ySectors + (y - 1)].dirty = true;
+			markSectorDirty(sectors[(x - 1)*ySectors + (y - 1)]);
 		}
 	}
 }
@@ -1105,6 +1250,11 @@ void reloadTerrainTextures()
  */
 bool initTerrain()
 {
+	if (skipDisplayOnlyWork())
+	{
+		return true; // terrain is never drawn, so don't build its geometry or lightmap
+	}
+
 	int i, j, x, y, a, b, absX, absY;
 	PIELIGHT colour[2][2], centerColour;
 	int layer = 0;
@@ -1203,6 +1353,7 @@ bool initTerrain()
 
 			sectors[x * ySectors + y].geometrySize = geometrySize - sectors[x * ySectors + y].geometryOffset;
 			sectors[x * ySectors + y].waterSize = waterSize - sectors[x * ySectors + y].waterOffset;
+			setSectorHeightRange(sectors[x * ySectors + y], geometry + sectors[x * ySectors + y].geometryOffset, water + sectors[x * ySectors + y].waterOffset);
 			// and do the index buffers
 			sectors[x * ySectors + y].geometryIndexOffset = geometryIndexSize;
 			sectors[x * ySectors + y].geometryIndexSize = 0;
@@ -1272,6 +1423,13 @@ bool initTerrain()
 			sectors[x * ySectors + y].waterIndexSize = waterIndexSize - sectors[x * ySectors + y].waterIndexOffset;
 		}
 	}
+	sectorQuadTree.clear();
+	if (xSectors > 0 && ySectors > 0)
+	{
+		buildSectorQuadNode(0, 0, xSectors, ySectors);
+		updateSectorQuadHeights(0);
+	}
+
 	if (geometryVBO)
 		delete geometryVBO;
 	geometryVBO = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer, gfx_api::context::buffer_storage_hint::dynamic_draw, "terrain::geometryVBO");
@@ -1522,7 +1680,9 @@ bool initTerrain()
 	lightmap_texture = gfx_api::context::get().create_texture(1, lightmapPixmap->width(), lightmapPixmap->height(), lightmapPixmap->pixel_format(), "mem::lightmap");
 
 	lightmap_texture->upload(0, *(lightmapPixmap.get()));
+	lightmapShowGateways = showGateways;
 	terrainInitialised = true;
+	markLightmapAllDirty();
 
 	return true;
 }
@@ -1532,8 +1692,11 @@ void shutdownTerrain()
 {
 	if (!sectors)
 	{
-		// This happens in some cases when loading a savegame from level init
-		debug(LOG_ERROR, "Trying to shutdown terrain when we did not need to!");
+		// This happens in some cases when loading a savegame from level init, and always when headless
+		if (!skipDisplayOnlyWork())
+		{
+			debug(LOG_ERROR, "Trying to shutdown terrain when we did not need to!");
+		}
 		return;
 	}
 	delete geometryVBO;
@@ -1564,9 +1727,14 @@ void shutdownTerrain()
 		}
 	}
 	sectors = nullptr;
+	sectorQuadTree.clear();
+	sectorRebuilds.clear();
+	sectorRebuildCount = 0;
 	delete lightmap_texture;
 	lightmap_texture = nullptr;
 	lightmapPixmap = nullptr;
+	lightmapSubImage.clear();
+	lightmapDirtyRects.clear();
 
 	delete groundTexArr; groundTexArr = nullptr;
 	delete groundNormalArr; groundNormalArr = nullptr;
@@ -1585,110 +1753,315 @@ void shutdownTerrain()
 	terrainInitialised = false;
 }
 
-static void updateLightMap(const LightMap& lightmap)
+void markLightmapDirty(int x1, int y1, int x2, int y2)
 {
-	size_t lightmapChannels = lightmapPixmap->channels(); // should always be 4 now...
-	unsigned char* lightMapWritePtr = lightmapPixmap->bmp_w();
-	for (int j = 0; j < mapHeight; ++j)
+	if (!terrainInitialised)
+	{
+		return;  // Everything is refreshed after initTerrain() anyway
+	}
+	x1 = std::max(x1, 0);
+	y1 = std::max(y1, 0);
+	x2 = std::min(x2, mapWidth);
+	y2 = std::min(y2, mapHeight);
+	if (x1 >= x2 || y1 >= y2)
+	{
+		return;
+	}
+	for (const LightmapDirtyRect &rect : lightmapDirtyRects)
 	{
-		for (int i = 0; i < mapWidth; ++i)
+		if (rect.x1 <= x1 && rect.y1 <= y1 && rect.x2 >= x2 && rect.y2 >= y2)
 		{
-			MAPTILE *psTile = mapTile(i, j);
-			PIELIGHT colour = lightmap(i, j);
-			UBYTE level = static_cast<UBYTE>(psTile->level);
+			return;  // Already covered
+		}
+	}
+	if (lightmapDirtyRects.size() >= LIGHTMAP_MAX_DIRTY_RECTS)
+	{
+		// Not refreshed for a while, just keep the bounding box
+		for (const LightmapDirtyRect &rect : lightmapDirtyRects)
+		{
+			x1 = std::min(x1, rect.x1);
+			y1 = std::min(y1, rect.y1);
+			x2 = std::max(x2, rect.x2);
+			y2 = std::max(y2, rect.y2);
+		}
+		lightmapDirtyRects.clear();
+	}
+	lightmapDirtyRects.push_back({x1, y1, x2, y2});
+}
 
-			if (psTile->tileInfoBits & BITS_GATEWAY && showGateways)
-			{
-				colour.byte.g = 255;
-			}
-			if (psTile->tileInfoBits & BITS_MARKED)
+void markLightmapAllDirty()
+{
+	lightmapDirtyRects.clear();
+	markLightmapDirty(0, 0, mapWidth, mapHeight);
+}
+
+/// Joins dirty rects which overlap or touch, so no texel is calculated or uploaded twice
+static void mergeLightmapDirtyRects()
+{
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (size_t a = 0; a < lightmapDirtyRects.size(); ++a)
+		{
+			for (size_t b = a + 1; b < lightmapDirtyRects.size(); ++b)
 			{
-				int m = getModularScaledGraphicsTime(2048, 255);
-				colour.byte.r = MAX(m, 255 - m);
-				level = std::max<UBYTE>(level, colour.byte.r / 2);
+				LightmapDirtyRect &rectA = lightmapDirtyRects[a];
+				const LightmapDirtyRect &rectB = lightmapDirtyRects[b];
+				if (rectA.x1 > rectB.x2 || rectB.x1 > rectA.x2 || rectA.y1 > rectB.y2 || rectB.y1 > rectA.y2)
+				{
+					continue;
+				}
+				rectA.x1 = std::min(rectA.x1, rectB.x1);
+				rectA.y1 = std::min(rectA.y1, rectB.y1);
+				rectA.x2 = std::max(rectA.x2, rectB.x2);
+				rectA.y2 = std::max(rectA.y2, rectB.y2);
+				lightmapDirtyRects[b] = lightmapDirtyRects.back();
+				lightmapDirtyRects.pop_back();
+				merged = true;
+				--b;
 			}
+		}
+	}
+}
+
+/// Calculates the lightmap texel of tile (i, j)
+static void calcLightMapTexel(const LightMap& lightmap, int i, int j, uint8_t *texel)
+{
+	MAPTILE *psTile = mapTile(i, j);
+	PIELIGHT colour = lightmap(i, j);
+	UBYTE level = static_cast<UBYTE>(psTile->level);
+
+	if (psTile->tileInfoBits & BITS_GATEWAY && showGateways)
+	{
+		colour.byte.g = 255;
+	}
+	if (psTile->tileInfoBits & BITS_MARKED)
+	{
+		int m = getModularScaledGraphicsTime(2048, 255);
+		colour.byte.r = MAX(m, 255 - m);
+		level = std::max<UBYTE>(level, colour.byte.r / 2);
+	}
+
+	texel[0] = colour.byte.r;
+	texel[1] = colour.byte.g;
+	texel[2] = colour.byte.b;
+	// store the "brightness" level in byte.a
+	// NOTE: This differs depending on whether using the single-pass terrain shader or the fallback terrain shaders
+	// (For more, see avUpdateTiles() and getTileIllumination())
+	texel[3] = level;
+
+	if (!pie_GetFogStatus())
+	{
+		// fade to black at the edges of the visible terrain area
+		const float playerX = map_coordf(playerPos.p.x);
+		const float playerY = map_coordf(playerPos.p.z);
+
+		const float distA = i - (playerX - visibleTiles.x / 2);
+		const float distB = (playerX + visibleTiles.x / 2) - i;
+		const float distC = j - (playerY - visibleTiles.y / 2);
+		const float distD = (playerY + visibleTiles.y / 2) - j;
+		float darken, distToEdge;
+
+		// calculate the distance to the closest edge of the visible map
+		// determine the smallest distance
+		distToEdge = distA;
+		if (distB < distToEdge)
+		{
+			distToEdge = distB;
+		}
+		if (distC < distToEdge)
+		{
+			distToEdge = distC;
+		}
+		if (distD < distToEdge)
+		{
+			distToEdge = distD;
+		}
 
-			lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 0] = colour.byte.r;
-			lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 1] = colour.byte.g;
-			lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 2] = colour.byte.b;
-			// store the "brightness" level in byte.a
-			// NOTE: This differs depending on whether using the single-pass terrain shader or the fallback terrain shaders
-			// (For more, see avUpdateTiles() and getTileIllumination())
-			lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 3] = level;
+		darken = (distToEdge) / 2.0f;
+		if (darken <= 0)
+		{
+			texel[0] = 0;
+			texel[1] = 0;
+			texel[2] = 0;
+			texel[3] = 0;
+		}
+		else if (darken < 1)
+		{
+			texel[0] *= darken;
+			texel[1] *= darken;
+			texel[2] *= darken;
+			texel[3] *= darken;
+		}
+	}
+}
 
-			if (!pie_GetFogStatus())
+/// Recalculates the dirty areas of the lightmap, and uploads the texels which actually changed
+static void updateLightMap(const LightMap& lightmap)
+{
+	if (!pie_GetFogStatus() || lightmapShowGateways != showGateways)
+	{
+		// The edge fade follows the camera, and gateways are all over the map
+		lightmapShowGateways = showGateways;
+		markLightmapAllDirty();
+	}
+	mergeLightmapDirtyRects();
+	std::swap(lightmapUpdateRects, lightmapDirtyRects);
+	lightmapDirtyRects.clear();
+
+	size_t lightmapChannels = lightmapPixmap->channels(); // should always be 4 now...
+	unsigned char* lightMapWritePtr = lightmapPixmap->bmp_w();
+	for (const LightmapDirtyRect &rect : lightmapUpdateRects)
+	{
+		LightmapDirtyRect changed = {rect.x2, rect.y2, rect.x1, rect.y1};
+		LightmapDirtyRect marked = {rect.x2, rect.y2, rect.x1, rect.y1};
+		for (int j = rect.y1; j < rect.y2; ++j)
+		{
+			for (int i = rect.x1; i < rect.x2; ++i)
 			{
-				// fade to black at the edges of the visible terrain area
-				const float playerX = map_coordf(playerPos.p.x);
-				const float playerY = map_coordf(playerPos.p.z);
-
-				const float distA = i - (playerX - visibleTiles.x / 2);
-				const float distB = (playerX + visibleTiles.x / 2) - i;
-				const float distC = j - (playerY - visibleTiles.y / 2);
-				const float distD = (playerY + visibleTiles.y / 2) - j;
-				float darken, distToEdge;
-
-				// calculate the distance to the closest edge of the visible map
-				// determine the smallest distance
-				distToEdge = distA;
-				if (distB < distToEdge)
-				{
-					distToEdge = distB;
-				}
-				if (distC < distToEdge)
-				{
-					distToEdge = distC;
-				}
-				if (distD < distToEdge)
-				{
-					distToEdge = distD;
-				}
+				uint8_t texel[4];
+				calcLightMapTexel(lightmap, i, j, texel);
 
-				darken = (distToEdge) / 2.0f;
-				if (darken <= 0)
+				unsigned char *dst = &lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels];
+				if (memcmp(dst, texel, sizeof(texel)) != 0)
 				{
-					lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 0] = 0;
-					lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 1] = 0;
-					lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 2] = 0;
-					lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 3] = 0;
+					memcpy(dst, texel, sizeof(texel));
+					changed.x1 = std::min(changed.x1, i);
+					changed.y1 = std::min(changed.y1, j);
+					changed.x2 = std::max(changed.x2, i + 1);
+					changed.y2 = std::max(changed.y2, j + 1);
 				}
-				else if (darken < 1)
+				if (mapTile(i, j)->tileInfoBits & BITS_MARKED)
 				{
-					lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 0] *= darken;
-					lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 1] *= darken;
-					lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 2] *= darken;
-					lightMapWritePtr[(i + j * lightmapWidth) * lightmapChannels + 3] *= darken;
+					marked.x1 = std::min(marked.x1, i);
+					marked.y1 = std::min(marked.y1, j);
+					marked.x2 = std::max(marked.x2, i + 1);
+					marked.y2 = std::max(marked.y2, j + 1);
 				}
 			}
 		}
+
+		// Marked tiles keep flashing until unmarked
+		markLightmapDirty(marked.x1, marked.y1, marked.x2, marked.y2);
+
+		if (changed.x1 >= changed.x2)
+		{
+			continue;  // Nothing changed here
+		}
+		const size_t width = changed.x2 - changed.x1;
+		const size_t height = changed.y2 - changed.y1;
+		if (!lightmapSubImage.allocate(width, height, lightmapChannels))
+		{
+			debug(LOG_ERROR, "Out of memory!");
+			lightmap_texture->upload(0, *(lightmapPixmap.get()));
+			return;
+		}
+		unsigned char *subWritePtr = lightmapSubImage.bmp_w();
+		for (size_t row = 0; row < height; ++row)
+		{
+			memcpy(&subWritePtr[row * width * lightmapChannels], &lightMapWritePtr[(changed.x1 + (changed.y1 + row) * lightmapWidth) * lightmapChannels], width * lightmapChannels);
+		}
+		lightmap_texture->upload_sub(0, changed.x1, changed.y1, lightmapSubImage);
 	}
 }
 
-static void cullTerrain()
+/// Decide whether to draw each sector covered by the quadtree node, and queue the dirty ones that will be drawn for rebuilding
+static void cullSectorQuadNode(int index, const ViewFrustumPlanes &frustum, bool inside)
 {
-	for (int x = 0; x < xSectors; x++)
+	const SectorQuadNode &node = sectorQuadTree[index];
+
+	if (!inside)
 	{
-		for (int y = 0; y < ySectors; y++)
+		// Bounding box of the node, remember that map y is world -z
+		const glm::vec3 boxMin(world_coord(node.x1 * sectorSize), node.minHeight, -world_coord(node.y2 * sectorSize));
+		const glm::vec3 boxMax(world_coord(node.x2 * sectorSize), node.maxHeight, -world_coord(node.y1 * sectorSize));
+		const FrustumIntersection intersection = intersectBoundingBox(frustum, boxMin, boxMax);
+		if (intersection == FrustumIntersection::Outside)
 		{
-			float xPos = world_coord(x * sectorSize + sectorSize / 2);
-			float yPos = world_coord(y * sectorSize + sectorSize / 2);
-			float distance = pow(playerPos.p.x - xPos, 2) + pow(playerPos.p.z - yPos, 2);
+			// Entirely off screen
+			for (int x = node.x1; x < node.x2; x++)
+			{
+				for (int y = node.y1; y < node.y2; y++)
+				{
+					sectors[x * ySectors + y].draw = false;
+				}
+			}
+			return;
+		}
+		inside = intersection == FrustumIntersection::Inside;  // Otherwise the children need checking
+	}
 
-			if (distance > pow((double)world_coord(terrainDistance), 2))
+	if (node.children[0] != -1)
+	{
+		for (int child : node.children)
+		{
+			if (child != -1)
 			{
-				sectors[x * ySectors + y].draw = false;
+				cullSectorQuadNode(child, frustum, inside);
 			}
-			else
+		}
+		return;
+	}
+
+	const int x = node.x1, y = node.y1;
+	float xPos = world_coord(x * sectorSize + sectorSize / 2);
+	float yPos = world_coord(y * sectorSize + sectorSize / 2);
+	float distance = pow(playerPos.p.x - xPos, 2) + pow(playerPos.p.z - yPos, 2);
+
+	if (distance > pow((double)world_coord(terrainDistance), 2))
+	{
+		sectors[x * ySectors + y].draw = false;
+	}
+	else
+	{
+		sectors[x * ySectors + y].draw = true;
+		if (sectors[x * ySectors + y].dirty)
+		{
+			if (sectorRebuildCount == sectorRebuilds.size())
 			{
-				sectors[x * ySectors + y].draw = true;
-				if (sectors[x * ySectors + y].dirty)
-				{
-					updateSectorGeometry(x, y);
-					sectors[x * ySectors + y].dirty = false;
-				}
+				sectorRebuilds.emplace_back();
 			}
+			sectorRebuilds[sectorRebuildCount].x = x;
+			sectorRebuilds[sectorRebuildCount].y = y;
+			++sectorRebuildCount;
+			sectors[x * ySectors + y].dirty = false;
+		}
+	}
+}
+
+static void cullTerrain(const glm::mat4 &mvp)
+{
+	if (sectorQuadTree.empty())
+	{
+		return;
+	}
+
+	if (sectorQuadHeightsDirty)
+	{
+		updateSectorQuadHeights(0);
+		sectorQuadHeightsDirty = false;
+	}
+
+	sectorRebuildCount = 0;
+	cullSectorQuadNode(0, extractFrustumPlanes(mvp), false);
+	if (sectorRebuildCount == 0)
+	{
+		return;
+	}
+
+	// Building the vertices is the expensive part, and each sector only reads the map, so spread them over the worker threads
+	parallelFor(sectorRebuildCount, SECTOR_REBUILD_CHUNK_SIZE, [](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+		{
+			buildSectorGeometry(sectorRebuilds[i]);
 		}
+	});
+	for (size_t i = 0; i < sectorRebuildCount; ++i)
+	{
+		updateSectorGeometry(sectorRebuilds[i]);
 	}
+	sectorQuadHeightsDirty = true;  // Rebuilding tightened the height ranges
 }
 
 static void drawDepthOnly(const glm::mat4 &ModelViewProjection, const glm::vec4 &paramsXLight, const glm::vec4 &paramsYLight, bool withOffset)
@@ -1733,48 +2106,6 @@ static void drawDepthOnly(const glm::mat4 &ModelViewProjection, const glm::vec4
 	gfx_api::context::get().unbind_index_buffer(*geometryIndexVBO);
 }
 
-static void drawDepthOnlyForDepthMap(const glm::mat4 &ModelViewProjection, const glm::vec4 &paramsXLight, const glm::vec4 &paramsYLight, bool withOffset)
-{
-	const auto &renderState = getCurrentRenderState();
-
-	// bind the vertex buffer
-	gfx_api::TerrainDepthOnlyForDepthMap::get().bind();
-	gfx_api::TerrainDepthOnlyForDepthMap::get().bind_textures(lightmap_texture);
-	gfx_api::TerrainDepthOnlyForDepthMap::get().bind_vertex_buffers(geometryVBO);
-	gfx_api::TerrainDepthOnlyForDepthMap::get().bind_constants({ ModelViewProjection, /*paramsXLight, paramsYLight, glm::vec4(0.f), glm::vec4(0.f), glm::mat4(1.f), glm::mat4(1.f),
-	glm::vec4(0.f), */ renderState.fogEnabled, renderState.fogBegin, renderState.fogEnd, /*0, 0*/ });
-	gfx_api::context::get().bind_index_buffer(*geometryIndexVBO, gfx_api::index_type::u32);
-
-//	if (withOffset)
-//	{
-//		// draw slightly higher distance than it actually is so it will not
-//		// by accident obscure the actual terrain
-//		gfx_api::context::get().set_polygon_offset(0.1f, 1.f);
-//	}
-
-	for (int x = 0; x < xSectors; x++)
-	{
-		for (int y = 0; y < ySectors; y++)
-		{
-			if (sectors[x * ySectors + y].draw)
-			{
-				addDrawRangeElements<gfx_api::TerrainDepthOnlyForDepthMap>(
-					sectors[x * ySectors + y].geometryOffset,
-					sectors[x * ySectors + y].geometryOffset + sectors[x * ySectors + y].geometrySize,
-					sectors[x * ySectors + y].geometryIndexSize,
-					sectors[x * ySectors + y].geometryIndexOffset);
-			}
-		}
-	}
-	finishDrawRangeElements<gfx_api::TerrainDepthOnlyForDepthMap>();
-//	if (withOffset)
-//	{
-//		gfx_api::context::get().set_polygon_offset(0.f, 0.f);
-//	}
-	gfx_api::TerrainDepthOnlyForDepthMap::get().unbind_vertex_buffers(geometryVBO);
-	gfx_api::context::get().unbind_index_buffer(*geometryIndexVBO);
-}
-
 glm::vec4 getFogColorVec4()
 {
 	const auto &renderState = getCurrentRenderState();
@@ -1967,7 +2298,7 @@ static void drawTerrainCombined(const glm::mat4 &ModelViewProjection, const glm:
 
 }
 
-void perFrameTerrainUpdates(const LightMap& lightMap)
+void perFrameTerrainUpdates(const LightMap& lightMap, const glm::mat4 &mvp)
 {
 	WZ_PROFILE_SCOPE(perFrameTerrainUpdates);
 	///////////////////////////////////
@@ -1978,13 +2309,11 @@ void perFrameTerrainUpdates(const LightMap& lightMap)
 	{
 		lightmapLastUpdate = realTime;
 		updateLightMap(lightMap);
-
-		lightmap_texture->upload(0, *(lightmapPixmap.get()));
 	}
 
 	///////////////////////////////////
 	// terrain culling
-	cullTerrain();
+	cullTerrain(mvp);
 }
 
 gfx_api::texture* getTerrainLightmapTexture()
@@ -1997,11 +2326,6 @@ const glm::mat4& getModelUVLightmapMatrix()
 	return lightmapValues.ModelUVLightmap;
 }
 
-void drawTerrainDepthOnly(const glm::mat4 &mvp)
-{
-	drawDepthOnlyForDepthMap(mvp, lightmapValues.paramsXLight, lightmapValues.paramsYLight, false);
-}
-
 /**
  * Update the lightmap and draw the terrain and decals.
  * This function first draws the terrain in black, and then uses additive blending to put the terrain layers
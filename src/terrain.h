@@ -34,8 +34,7 @@ void loadTerrainTextures(MAP_TILESET mapTileset);
 bool initTerrain();
 void shutdownTerrain();
 
-void perFrameTerrainUpdates(const LightMap& lightData);
-void drawTerrainDepthOnly(const glm::mat4 &mvp);
+void perFrameTerrainUpdates(const LightMap& lightData, const glm::mat4 &mvp);
 void drawTerrain(const glm::mat4 &mvp, const glm::mat4& viewMatrix, const Vector3f &cameraPos, const Vector3f &sunPos, const ShadowCascadesInfo& shadowMVPMatrix);
 void drawWater(const glm::mat4 &ModelViewProjection, const Vector3f &cameraPos, const Vector3f &sunPos);
 
@@ -48,6 +47,9 @@ gfx_api::texture* getTerrainLightmapTexture();
 const glm::mat4& getModelUVLightmapMatrix();
 
 void markTileDirty(int i, int j);
+/// Marks the lightmap of tiles from (x1, y1) up to but not including (x2, y2) for recalculation on the next refresh
+void markLightmapDirty(int x1, int y1, int x2, int y2);
+void markLightmapAllDirty();
 
 enum TerrainShaderType
 {
@@ -34,6 +34,7 @@
 #include "lib/sound/audio.h"
 #include "lib/framework/wzapp.h"
 
+#include "benchmark.h"
 #include "clparse.h"
 #include "frontend.h"
 #include "keyedit.h"
@@ -111,9 +112,9 @@ static void setupLoadingScreen()
 
 bool recalculateEffectiveHeadlessValue()
 {
-	if (hostlaunch == HostLaunch::Skirmish || hostlaunch == HostLaunch::Autohost || hostlaunch == HostLaunch::LoadReplay || autogame_enabled())
+	if (hostlaunch == HostLaunch::Skirmish || hostlaunch == HostLaunch::Autohost || hostlaunch == HostLaunch::LoadReplay || autogame_enabled() || benchmarkEnabled())
 	{
-		// only support headless mode if hostlaunch is --skirmish or --autogame
+		// only support headless mode if hostlaunch is --skirmish or --autogame, or when benchmarking
 		return bHeadlessAutoGameModeCLIOption;
 	}
 	return false;
@@ -141,6 +142,12 @@ bool headlessGameMode()
 	return bActualHeadlessAutoGameMode;
 }
 
+bool skipDisplayOnlyWork()
+{
+	// The benchmark renders everything on the null backend, to measure the CPU side of drawing
+	return bActualHeadlessAutoGameMode && !benchmarkEnabled();
+}
+
 
 // //////////////////////////////////////////////////////////////////
 // Initialise frontend globals and statics.
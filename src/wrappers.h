@@ -49,6 +49,9 @@ HostLaunch getHostLaunch();
 
 void setHeadlessGameMode(bool enabled);
 bool headlessGameMode();
+/// True if nothing will ever be drawn (headless mode), so purely visual work - effects, tile lighting, the radar bitmap and
+/// terrain geometry - is skipped. Game state must not depend on any of it, so simulation results are unaffected.
+bool skipDisplayOnlyWork();
 
 bool frontendInitVars();
 TITLECODE titleLoop();
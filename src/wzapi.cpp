@@ -80,6 +80,7 @@
 #include "data.h"
 #include "gamehistorylogger.h"
 #include "hci/quickchat.h"
+#include "terrain.h"
 
 #include <list>
 
@@ -900,6 +901,7 @@ wzapi::no_return_value wzapi::hackMarkTiles(WZAPI_PARAMS(optional<wzapi::label_o
 				MAPTILE *psTile = mapTile(x, y);
 				psTile->tileInfoBits |= BITS_MARKED;
 			}
+			markLightmapAllDirty();
 		}
 	}
 	else // clear all marks